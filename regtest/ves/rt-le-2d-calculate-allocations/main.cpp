@@ -0,0 +1,93 @@
+#include "plumed/core/PlumedMain.h"
+#include "plumed/core/ActionSet.h"
+#include "plumed/core/Action.h"
+#include "plumed/tools/Stopwatch.h"
+#include <cstdlib>
+#include <new>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/*
+  Checks that VES_LINEAR_EXPANSION does not allocate heap memory when the
+  bias is evaluated once the first steps have been done. All the allocations
+  done by the process are counted by replacing the global operator new.
+  The timings are only written to the standard output as they are not
+  reproducible.
+*/
+
+static unsigned long nallocations=0;
+
+void* operator new(std::size_t size) {
+  nallocations++;
+  void* ptr=std::malloc(size>0 ? size : 1);
+  if(!ptr) throw std::bad_alloc();
+  return ptr;
+}
+
+void* operator new[](std::size_t size) {
+  nallocations++;
+  void* ptr=std::malloc(size>0 ? size : 1);
+  if(!ptr) throw std::bad_alloc();
+  return ptr;
+}
+
+void operator delete(void* ptr) noexcept {std::free(ptr);}
+
+void operator delete[](void* ptr) noexcept {std::free(ptr);}
+
+using namespace PLMD;
+
+int main() {
+
+  PlumedMain p;
+  int natoms=2;
+  p.cmd("setNatoms",&natoms);
+  p.cmd("setLogFile","test.log");
+  p.cmd("init");
+
+  p.readInputLine("d1: DISTANCE ATOMS=1,2 COMPONENTS NOPBC");
+  p.readInputLine("bf1: BF_LEGENDRE ORDER=20 MINIMUM=-3.0 MAXIMUM=3.0");
+  p.readInputLine("bf2: BF_CHEBYSHEV ORDER=15 MINIMUM=-3.0 MAXIMUM=3.0");
+  p.readInputLine("b1: VES_LINEAR_EXPANSION ARG=d1.x,d1.y BASIS_FUNCTIONS=bf1,bf2 TEMP=300.0 GRID_BINS=20");
+  p.readInputLine("b2: VES_LINEAR_EXPANSION ARG=d1.x,d1.y BASIS_FUNCTIONS=bf1,bf2 TEMP=300.0 GRID_BINS=20 FACTORIZED_EVALUATION");
+
+  std::vector<double> positions(3*natoms,0.0);
+  std::vector<double> masses(natoms,1.0);
+  std::vector<double> forces(3*natoms,0.0);
+  std::vector<double> box(9,0.0);
+  std::vector<double> virial(9,0.0);
+
+  // warm-up with a few normal steps
+  for(int step=0; step<10; step++) {
+    positions[3]=0.1*step; positions[4]=-0.05*step; positions[5]=0.2;
+    p.cmd("setStep",&step);
+    p.cmd("setPositions",&positions[0]);
+    p.cmd("setBox",&box[0]);
+    p.cmd("setForces",&forces[0]);
+    p.cmd("setVirial",&virial[0]);
+    p.cmd("setMasses",&masses[0]);
+    p.cmd("calc");
+  }
+
+  std::ofstream ofs("output");
+  const unsigned ncalls=1000;
+  std::vector<std::string> labels;
+  labels.push_back("b1");
+  labels.push_back("b2");
+  for(unsigned i=0; i<labels.size(); i++) {
+    Action* action=p.getActionSet().selectWithLabel<Action*>(labels[i]);
+    Stopwatch sw;
+    sw.start();
+    unsigned long nallocations_before=nallocations;
+    for(unsigned n=0; n<ncalls; n++) {action->calculate();}
+    unsigned long nallocations_calculate=nallocations-nallocations_before;
+    sw.stop();
+    ofs<<labels[i]<<": heap allocations in "<<ncalls<<" calls of calculate(): "<<nallocations_calculate<<"\n";
+    std::cout<<labels[i]<<": "<<sw;
+  }
+  ofs.close();
+
+  return 0;
+}
@@ -29,6 +29,9 @@
 #include "core/FlexibleBin.h"
 #include "tools/Matrix.h"
 #include "tools/Random.h"
+#include "tools/OpenMP.h"
+#include "tools/Communicator.h"
+#include "tools/HillsBinaryFile.h"
 #include <string>
 #include <cstring>
 #include "tools/File.h"
@@ -36,6 +39,8 @@
 #include <limits>
 #include <ctime>
 #include <memory>
+#include <algorithm>
+#include <unistd.h>
 
 #define DP2CUTOFF 6.25
 
@@ -134,6 +139,26 @@ for replica exchange methods to be computed correctly.
 
 Multiple walkers  \cite multiplewalkers can also be used. See below the examples.
 
+When a grid is used, each hill is normally added to the grid as soon as it is deposited
+(or, with multiple walkers, as soon as it is read). With the keyword GRID_PENDING_HILLS the
+new hills are instead kept in a buffer and their bias and forces are calculated analytically,
+on top of the grid. Once the buffer holds the given number of hills they are all added to the grid
+in a single pass over the grid points they cover. The buffer is also emptied whenever the whole grid is
+needed (e.g. when it is written to file or when DAMPFACTOR or CALC_MAX_BIAS are used). This is useful
+with many walkers or with large grids, where adding every hill separately is expensive. Notice that
+the bias given by the hills in the buffer is not interpolated, so that the results are slightly
+different from the ones obtained when each hill is added to the grid immediately.
+
+With the flag BINARY_HILLS the hills are written in a binary format instead of text.
+Each hill is stored as a record of fixed length, with the time, the center, the widths, the height
+and the bias factor, after a short header with the names and the periodicity of the variables.
+The widths are stored as they are used internally, i.e. for multivariate hills the upper triangle of the
+inverse covariance matrix is stored. The binary files are smaller, are written without any formatting and
+are memory-mapped when read, which makes restarting and reading the hills of other walkers much faster
+when there are many hills. Binary hills files are recognized automatically when restarting,
+when reading the hills of other walkers and by \ref sum_hills. Notice that the hills cannot be appended
+to a file in a different format, so that a restart has to use the same format of the previous run.
+
 
 The c(t) reweighting factor can also be calculated on the fly using the equations
 presented in \cite Tiwary_jp504920s.
@@ -233,6 +258,22 @@ where all the walkers are located. WALKERS_RSTRIDE is the number of step between
 one update and the other. Since version 2.2.5, hills files are automatically
 flushed every WALKERS_RSTRIDE steps.
 
+\par
+With WALKERS_MPI every walker keeps its own copy of the bias grid and adds to it the hills
+of all the walkers. If many walkers run on the same node, the WALKERS_SHM flag can be
+used to have a single grid in shared memory for all the walkers on the node, which is
+created as a file in WALKERS_SHM_DIR (by default /dev/shm). Each hill is then added to
+the grid only once on each node, while hills are still exchanged among all the walkers
+with MPI. All the processes of a walker should run on the same node.
+\plumedfile
+DISTANCE ATOMS=3,5 LABEL=d1
+METAD ...
+   ARG=d1 SIGMA=0.05 HEIGHT=0.3 PACE=500 LABEL=restraint
+   GRID_MIN=0 GRID_MAX=5 GRID_BIN=500
+   WALKERS_MPI WALKERS_SHM
+... METAD
+\endplumedfile
+
 \par
 The c(t) reweighting factor can be calculated on the fly using the equations
 presented in \cite Tiwary_jp504920s as described above.
@@ -369,6 +410,8 @@ private:
   bool storeOldGrids_;
   int wgridstride_;
   bool grid_;
+  unsigned grid_pending_max_;
+  vector<Gaussian> pending_hills_;
   double height0_;
   double biasf_;
   static const size_t n_tempering_options_ = 1;
@@ -390,6 +433,12 @@ private:
   bool walkers_mpi;
   unsigned mpi_nw_;
   unsigned mpi_mw_;
+  bool walkers_shm_;
+  string walkers_shm_dir_;
+  Communicator shm_comm_;
+  unsigned shm_nw_;
+  unsigned shm_mw_;
+  unsigned long shm_nhills_;
   bool acceleration;
   double acc;
   double acc_restart_mean_;
@@ -400,6 +449,10 @@ private:
   vector<vector<double> > transitionwells_;
   vector<std::unique_ptr<IFile>> ifiles;
   vector<string> ifilesnames;
+  bool binary_hills_;
+  vector<std::unique_ptr<HillsBinaryFile>> ifilesbinary;
+  vector<bool> ifilesdetected;
+  vector<size_t> ifilesnext;
   double uppI_;
   double lowI_;
   bool doInt_;
@@ -414,12 +467,16 @@ private:
   void   readTemperingSpecs(TemperingSpecs &t_specs);
   void   logTemperingSpecs(const TemperingSpecs &t_specs);
   void   readGaussians(IFile*);
+  void   readGaussians(HillsBinaryFile&,size_t&);
+  void   detectHillsFormat(unsigned);
   void   writeGaussian(const Gaussian&,OFile&);
   void   addGaussian(const Gaussian&);
+  void   flushPendingHills();
+  void   shmBarrier();
   double getHeight(const vector<double>&);
   void   temperHeight(double &height, const TemperingSpecs &t_specs, const double tempering_bias);
   double getBiasAndDerivatives(const vector<double>&,double* der=NULL);
-  double evaluateGaussian(const vector<double>&, const Gaussian&,double* der=NULL);
+  double evaluateGaussian(const vector<double>&, const Gaussian&,double* der=NULL,double* dp=NULL);
   double getGaussianNormalization( const Gaussian& );
   vector<unsigned> getGaussianSupport(const Gaussian&);
   bool   scanOneHill(IFile *ifile,  vector<Value> &v, vector<double> &center, vector<double>  &sigma, double &height, bool &multivariate);
@@ -452,6 +509,7 @@ void MetaD::registerKeywords(Keywords& keys) {
   keys.add("compulsory","FILE","HILLS","a file in which the list of added hills is stored");
   keys.add("optional","HEIGHT","the heights of the Gaussian hills. Compulsory unless TAU and either BIASFACTOR or DAMPFACTOR are given");
   keys.add("optional","FMT","specify format for HILLS files (useful for decrease the number of digits in regtests)");
+  keys.addFlag("BINARY_HILLS",false,"write the HILLS file in a binary format instead of text");
   keys.add("optional","BIASFACTOR","use well tempered metadynamics and use this biasfactor.  Please note you must also specify temp");
   keys.add("optional","RECT","list of bias factors for all the replicas");
   keys.add("optional","DAMPFACTOR","damp hills with exp(-max(V)/(kbT*DAMPFACTOR)");
@@ -476,6 +534,7 @@ void MetaD::registerKeywords(Keywords& keys) {
   keys.add("optional","GRID_WSTRIDE","write the grid to a file every N steps");
   keys.add("optional","GRID_WFILE","the file on which to write the grid");
   keys.add("optional","GRID_RFILE","a grid file from which the bias should be read at the initial step of the simulation");
+  keys.add("optional","GRID_PENDING_HILLS","the number of hills that are kept in a buffer, and calculated analytically, before they are all added to the grid together");
   keys.addFlag("STORE_GRIDS",false,"store all the grid files the calculation generates. They will be deleted if this keyword is not present");
   keys.add("optional","ADAPTIVE","use a geometric (=GEOM) or diffusion (=DIFF) based hills width scheme. Sigma is one number that has distance units or timestep dimensions");
   keys.add("optional","WALKERS_ID", "walker id");
@@ -486,6 +545,8 @@ void MetaD::registerKeywords(Keywords& keys) {
   keys.add("optional","SIGMA_MAX","the upper bounds for the sigmas (in CV units) when using adaptive hills. Negative number means no bounds ");
   keys.add("optional","SIGMA_MIN","the lower bounds for the sigmas (in CV units) when using adaptive hills. Negative number means no bounds ");
   keys.addFlag("WALKERS_MPI",false,"Switch on MPI version of multiple walkers - not compatible with WALKERS_* options other than WALKERS_DIR");
+  keys.addFlag("WALKERS_SHM",false,"Use together with WALKERS_MPI to share a single bias grid in memory among the walkers running on the same node");
+  keys.add("compulsory","WALKERS_SHM_DIR","/dev/shm","the directory, on a memory-backed file system, where the grid shared with WALKERS_SHM is created");
   keys.addFlag("ACCELERATION",false,"Set to TRUE if you want to compute the metadynamics acceleration factor.");
   keys.add("optional","ACCELERATION_RFILE","a data file from which the acceleration should be read at the initial step of the simulation");
   keys.addFlag("CALC_MAX_BIAS", false, "Set to TRUE if you want to compute the maximum of the metadynamics V(s, t)");
@@ -507,7 +568,7 @@ void MetaD::registerTemperingKeywords(const std::string &name_stem, const std::s
 MetaD::MetaD(const ActionOptions& ao):
   PLUMED_BIAS_INIT(ao),
 // Grid stuff initialization
-  wgridstride_(0), grid_(false),
+  wgridstride_(0), grid_(false), grid_pending_max_(0),
 // Metadynamics basic parameters
   height0_(std::numeric_limits<double>::max()), biasf_(-1.0), dampfactor_(0.0),
   tt_specs_(false, "TT", "Transition Tempered", -1.0, 0.0, 1.0),
@@ -518,9 +579,11 @@ MetaD::MetaD(const ActionOptions& ao):
 // Multiple walkers initialization
   mw_n_(1), mw_dir_(""), mw_id_(0), mw_rstride_(1),
   walkers_mpi(false), mpi_nw_(0), mpi_mw_(0),
+  walkers_shm_(false), walkers_shm_dir_(""), shm_comm_(), shm_nw_(1), shm_mw_(0), shm_nhills_(0),
   acceleration(false), acc(0.0), acc_restart_mean_(0.0),
   calc_max_bias_(false), max_bias_(0.0),
   calc_transition_bias_(false), transition_bias_(0.0),
+  binary_hills_(false),
 // Interval initialization
   uppI_(-1), lowI_(-1), doInt_(false),
   isFirstStep(true),
@@ -588,6 +651,8 @@ MetaD::MetaD(const ActionOptions& ao):
   if(stride_<=0 ) error("frequency for hill addition is nonsensical");
   string hillsfname="HILLS";
   parse("FILE",hillsfname);
+  parseFlag("BINARY_HILLS",binary_hills_);
+  if(binary_hills_ && Tools::extension(hillsfname)=="gz") error("BINARY_HILLS cannot be used with a compressed HILLS file");
 
   // Manually set to calculate special bias quantities
   // throughout the course of simulation. (These are chosen due to
@@ -721,9 +786,11 @@ MetaD::MetaD(const ActionOptions& ao):
   }
   string gridreadfilename_;
   parse("GRID_RFILE",gridreadfilename_);
+  parse("GRID_PENDING_HILLS",grid_pending_max_);
 
   if(!grid_&&gridfilename_.length()> 0) error("To write a grid you need first to define it!");
   if(!grid_&&gridreadfilename_.length()>0) error("To read a grid you need first to define it!");
+  if(!grid_&&grid_pending_max_>0) error("GRID_PENDING_HILLS can only be used with a grid");
 
   if(grid_) {
     parseVector("REWEIGHTING_NGRID",rewf_grid_);
@@ -750,6 +817,15 @@ MetaD::MetaD(const ActionOptions& ao):
 
   // MPI version
   parseFlag("WALKERS_MPI",walkers_mpi);
+  parseFlag("WALKERS_SHM",walkers_shm_);
+  parse("WALKERS_SHM_DIR",walkers_shm_dir_);
+  if(walkers_shm_) {
+    if(!walkers_mpi) error("WALKERS_SHM can only be used together with WALKERS_MPI");
+    if(!grid_) error("WALKERS_SHM can only be used with a grid");
+    if(sparsegrid) error("WALKERS_SHM cannot be used with GRID_SPARSE");
+    if(gridreadfilename_.length()>0) error("WALKERS_SHM cannot be used with GRID_RFILE");
+    if(grid_pending_max_>0) error("WALKERS_SHM cannot be used with GRID_PENDING_HILLS");
+  }
 
   // Inteval keyword
   vector<double> tmpI(2);
@@ -781,6 +857,7 @@ MetaD::MetaD(const ActionOptions& ao):
   log.printf("  Gaussian height %f\n",height0_);
   log.printf("  Gaussian deposition pace %d\n",stride_);
   log.printf("  Gaussian file %s\n",hillsfname.c_str());
+  if(binary_hills_) log.printf("  Gaussians are written in binary format\n");
   if(welltemp_) {
     log.printf("  Well-Tempered Bias Factor %f\n",biasf_);
     log.printf("  Hills relaxation time (tau) %f\n",tau);
@@ -856,6 +933,7 @@ MetaD::MetaD(const ActionOptions& ao):
     if(spline) {log.printf("  Grid uses spline interpolation\n");}
     if(sparsegrid) {log.printf("  Grid uses sparse grid\n");}
     if(wgridstride_>0) {log.printf("  Grid is written on file %s with stride %d\n",gridfilename_.c_str(),wgridstride_);}
+    if(grid_pending_max_>0) {log.printf("  Hills are kept in a buffer and added to the grid every %u hills\n",grid_pending_max_);}
   }
 
   if(mw_n_>1) {
@@ -877,6 +955,31 @@ MetaD::MetaD(const ActionOptions& ao):
       // info abount number of walkers and walker index
       comm.Bcast(mpi_nw_,0);
       comm.Bcast(mpi_mw_,0);
+      if(walkers_shm_) {
+        // the walkers running on the same node are found from the host names
+        vector<char> host(256,0);
+        gethostname(&host[0],host.size()-1);
+        vector<char> walker_host(host);
+        if(comm.Get_rank()==0 && mpi_nw_>1) {
+          vector<char> all_hosts(mpi_nw_*host.size());
+          multi_sim_comm.Allgather(host,all_hosts);
+          // the walkers on a node are labelled by the first one of them
+          unsigned first=mpi_mw_;
+          for(unsigned i=0; i<mpi_nw_; i++) {
+            if(std::equal(host.begin(),host.end(),all_hosts.begin()+i*host.size())) {first=i; break;}
+          }
+          multi_sim_comm.Split(first,mpi_mw_,shm_comm_);
+          shm_nw_=shm_comm_.Get_size();
+          shm_mw_=shm_comm_.Get_rank();
+        }
+        comm.Bcast(walker_host,0);
+        comm.Bcast(shm_nw_,0);
+        comm.Bcast(shm_mw_,0);
+        int otherhost=(walker_host==host ? 0 : 1);
+        comm.Sum(otherhost);
+        if(otherhost>0) error("with WALKERS_SHM all the processes of a walker should run on the same node");
+        log.printf("  Bias grid shared in memory among the %u walkers on this node (in %s)\n",shm_nw_,walkers_shm_dir_.c_str());
+      }
     }
   }
 
@@ -1028,7 +1131,24 @@ MetaD::MetaD(const ActionOptions& ao):
       if(mesh>0.5*sigma0_[i]) log<<"  WARNING: Using a METAD with a Grid Spacing larger than half of the Gaussians width can produce artifacts\n";
     }
     std::string funcl=getLabel() + ".bias";
-    if(!sparsegrid) {BiasGrid_.reset(new Grid(funcl,getArguments(),gmin,gmax,gbin,spline,true));}
+    if(walkers_shm_) {
+      // the first walker on the node creates the shared grid and then the others attach to it,
+      // the file can then be removed as the grid stays shared among the walkers attached to it
+      int pid=0;
+      const bool creator=(comm.Get_rank()==0 && shm_mw_==0);
+      if(creator) pid=getpid();
+      if(comm.Get_rank()==0) shm_comm_.Bcast(pid,0);
+      comm.Bcast(pid,0);
+      string shmpath;
+      Tools::convert(pid,shmpath);
+      shmpath=walkers_shm_dir_+"/plumed."+getLabel()+"."+shmpath+".grid";
+      if(creator) BiasGrid_.reset(new SharedGrid(funcl,getArguments(),gmin,gmax,gbin,spline,true,shmpath,true));
+      shmBarrier();
+      if(!creator) BiasGrid_.reset(new SharedGrid(funcl,getArguments(),gmin,gmax,gbin,spline,true,shmpath,false));
+      shmBarrier();
+      if(creator) dynamic_cast<SharedGrid*>(BiasGrid_.get())->removeFile();
+    }
+    else if(!sparsegrid) {BiasGrid_.reset(new Grid(funcl,getArguments(),gmin,gmax,gbin,spline,true));}
     else {BiasGrid_.reset(new SparseGrid(funcl,getArguments(),gmin,gmax,gbin,spline,true));}
     std::vector<std::string> actualmin=BiasGrid_->getMin();
     std::vector<std::string> actualmax=BiasGrid_->getMax();
@@ -1040,6 +1160,10 @@ MetaD::MetaD(const ActionOptions& ao):
 
   // creating vector of ifile* for hills reading
   // open all files at the beginning and read Gaussians if restarting
+  ifilesbinary.resize(mw_n_);
+  ifilesnext.assign(mw_n_,0);
+  ifilesdetected.assign(mw_n_,false);
+  bool hillsexist=false;
   for(int i=0; i<mw_n_; ++i) {
     string fname;
     if(mw_dir_!="") {
@@ -1065,15 +1189,23 @@ MetaD::MetaD(const ActionOptions& ao):
     ifile->link(*this);
     if(ifile->FileExist(fname)) {
       ifile->open(fname);
-      if(getRestart()&&!restartedFromGrid) {
+      detectHillsFormat(i);
+      if(getRestart()&&!restartedFromGrid&&ifilesdetected[i]) {
         log.printf("  Restarting from %s:",ifilesnames[i].c_str());
-        readGaussians(ifiles[i].get());
+        if(ifilesbinary[i]) readGaussians(*ifilesbinary[i],ifilesnext[i]);
+        else readGaussians(ifiles[i].get());
       }
       ifiles[i]->reset(false);
       // close only the walker own hills file for later writing
-      if(i==mw_id_) ifiles[i]->close();
+      if(i==mw_id_) {
+        ifiles[i]->close();
+        hillsexist=true;
+      }
     }
   }
+  // add the hills read when restarting to the grid
+  if(grid_) flushPendingHills();
+  if(walkers_shm_) shmBarrier();
 
   comm.Barrier();
   // this barrier is needed when using walkers_mpi
@@ -1099,6 +1231,7 @@ MetaD::MetaD(const ActionOptions& ao):
   if(getRestart() && rewf_grid_.size()>0 ) computeReweightingFactor();
   // Calculate all special bias quantities desired if restarting with nonzero bias.
   if(getRestart() && calc_max_bias_) {
+    flushPendingHills();
     max_bias_ = BiasGrid_->getMaxValue();
     getPntrToComponent("maxbias")->set(max_bias_);
   }
@@ -1131,17 +1264,46 @@ MetaD::MetaD(const ActionOptions& ao):
     hillsOfile_.enforceSuffix("");
   }
   if(mw_n_>1) hillsOfile_.enforceSuffix("");
+  // when restarting the new hills are appended, so the format of the existing file should be the same
+  if(getRestart() && hillsexist && ifilesdetected[mw_id_]) {
+    if(binary_hills_ && !ifilesbinary[mw_id_]) error("cannot append hills in binary format to the text file "+ifilesnames[mw_id_]);
+    if(!binary_hills_ && ifilesbinary[mw_id_]) error("cannot append hills in text format to the binary file "+ifilesnames[mw_id_]+", use BINARY_HILLS");
+  }
+  const bool writeheader=!(getRestart() && ifilesbinary[mw_id_]);
+  // the walker own hills are never read again
+  ifilesbinary[mw_id_].reset();
   hillsOfile_.open(ifilesnames[mw_id_]);
-  if(fmt.length()>0) hillsOfile_.fmtField(fmt);
-  hillsOfile_.addConstantField("multivariate");
-  hillsOfile_.addConstantField("kerneltype");
-  if(doInt_) {
-    hillsOfile_.addConstantField("lower_int").printField("lower_int",lowI_);
-    hillsOfile_.addConstantField("upper_int").printField("upper_int",uppI_);
-  }
   hillsOfile_.setHeavyFlush();
-  // output periodicities of variables
-  for(unsigned i=0; i<getNumberOfArguments(); ++i) hillsOfile_.setupPrintValue( getPntrToArgument(i) );
+  if(binary_hills_) {
+    if(writeheader) {
+      vector<string> names(getNumberOfArguments()), pmin(getNumberOfArguments()), pmax(getNumberOfArguments());
+      for(unsigned i=0; i<getNumberOfArguments(); ++i) {
+        names[i]=getPntrToArgument(i)->getName();
+        if(getPntrToArgument(i)->isPeriodic()) getPntrToArgument(i)->getDomain(pmin[i],pmax[i]);
+      }
+      HillsBinaryFile::Header extra;
+      if(doInt_) {
+        string lows, upps;
+        Tools::convert(lowI_,lows);
+        Tools::convert(uppI_,upps);
+        extra.push_back(std::make_pair("lower_int",lows));
+        extra.push_back(std::make_pair("upper_int",upps));
+      }
+      HillsBinaryFile::writeHeader(hillsOfile_,names,pmin,pmax,adaptive_!=FlexibleBin::none,extra);
+      // other walkers might look for the header as soon as the file exists
+      hillsOfile_.flush();
+    }
+  } else {
+    if(fmt.length()>0) hillsOfile_.fmtField(fmt);
+    hillsOfile_.addConstantField("multivariate");
+    hillsOfile_.addConstantField("kerneltype");
+    if(doInt_) {
+      hillsOfile_.addConstantField("lower_int").printField("lower_int",lowI_);
+      hillsOfile_.addConstantField("upper_int").printField("upper_int",uppI_);
+    }
+    // output periodicities of variables
+    for(unsigned i=0; i<getNumberOfArguments(); ++i) hillsOfile_.setupPrintValue( getPntrToArgument(i) );
+  }
 
   bool concurrent=false;
   const ActionSet&actionSet(plumed.getActionSet());
@@ -1235,9 +1397,59 @@ void MetaD::readGaussians(IFile *ifile)
   log.printf("      %d Gaussians read\n",nhills);
 }
 
+void MetaD::readGaussians(HillsBinaryFile &binfile, size_t &next)
+{
+  unsigned ncv=getNumberOfArguments();
+  // look for the records appended since the last time
+  binfile.update();
+  int nhills=0;
+  if(next<binfile.numberOfRecords()) {
+    const vector<string> & names=binfile.getNames();
+    if(names.size()!=ncv) error("in hills file "+binfile.getPath()+" the number of variables does not match the number of arguments");
+    for(unsigned i=0; i<ncv; ++i) {
+      const string & name=getPntrToArgument(i)->getName();
+      if(names[i]!=name) error("in hills file "+binfile.getPath()+" variable "+names[i]+" does not match argument "+name);
+      bool match=(binfile.headerFieldExists("min_"+name)==getPntrToArgument(i)->isPeriodic());
+      if(match && getPntrToArgument(i)->isPeriodic()) {
+        string rmin, rmax; getPntrToArgument(i)->getDomain( rmin, rmax );
+        match=(binfile.getHeaderField("min_"+name)==rmin && binfile.getHeaderField("max_"+name)==rmax);
+      }
+      if(!match) error("in hills file periodicity for variable " + name + " does not match periodicity in input");
+    }
+    vector<double> center(ncv);
+    vector<double> sigma(binfile.getSigmaSize());
+    for(; next<binfile.numberOfRecords(); ++next) {
+      center.assign(binfile.getCenter(next),binfile.getCenter(next)+ncv);
+      sigma.assign(binfile.getSigma(next),binfile.getSigma(next)+binfile.getSigmaSize());
+      double height=binfile.getHeight(next);
+      nhills++;
+// note that for gamma=1 we store directly -F
+      if(welltemp_ && biasf_>1.0) {height*=(biasf_-1.0)/biasf_;}
+      addGaussian(Gaussian(center,sigma,height,binfile.isMultivariate()));
+    }
+  }
+  log.printf("      %d Gaussians read\n",nhills);
+}
+
+void MetaD::detectHillsFormat(unsigned i)
+{
+  // a binary file is only recognized once its first bytes have been written,
+  // until then the format is left undecided and nothing is read
+  const string path=ifiles[i]->getPath();
+  if(!HillsBinaryFile::canDetectFormat(path)) return;
+  ifilesdetected[i]=true;
+  if(HillsBinaryFile::isBinaryFile(path)) ifilesbinary[i].reset(new HillsBinaryFile(path));
+}
+
 void MetaD::writeGaussian(const Gaussian& hill, OFile&file)
 {
   unsigned ncv=getNumberOfArguments();
+  if(binary_hills_) {
+    double height=hill.height;
+    if(welltemp_ && biasf_>1.0) height*=biasf_/(biasf_-1.0);
+    HillsBinaryFile::writeRecord(file,getTimeStep()*getStep(),hill.center,hill.sigma,height,biasf_);
+    return;
+  }
   file.printField("time",getTimeStep()*getStep());
   for(unsigned i=0; i<ncv; ++i) {
     file.printField(getPntrToArgument(i),hill.center[i]);
@@ -1288,14 +1500,48 @@ void MetaD::writeGaussian(const Gaussian& hill, OFile&file)
 
 void MetaD::addGaussian(const Gaussian& hill)
 {
+  if(walkers_shm_) {
+    // each hill is added to the shared grid by only one of the walkers on the node (the walkers
+    // get the hills in the same order), and by only one of its processes
+    const bool mine=(shm_nhills_%shm_nw_==shm_mw_);
+    shm_nhills_++;
+    if(!mine || comm.Get_rank()!=0) return;
+  }
   if(!grid_) hills_.push_back(hill);
-  else {
+  else if(grid_pending_max_>0) {
+    pending_hills_.push_back(hill);
+    if(pending_hills_.size()>=grid_pending_max_) flushPendingHills();
+  } else if(!hill.multivariate && !doInt_) {
+    // the Gaussian is the product of one-dimensional Gaussians, these are tabulated
+    // on the points of the support along each dimension and then added to the grid
+    unsigned ncv=getNumberOfArguments();
+    vector<unsigned> nneighb=getGaussianSupport(hill);
+    vector<vector<unsigned> > box_indices;
+    vector<vector<double> > box_points;
+    BiasGrid_->getNeighborBox(hill.center,nneighb,box_indices,box_points);
+    vector<vector<double> > values(ncv), derivs(ncv), dp2(ncv);
+    for(unsigned i=0; i<ncv; ++i) {
+      // the height is included in the Gaussian along the first dimension
+      const double prefactor=(i==0) ? hill.height : 1.0;
+      const unsigned n=box_points[i].size();
+      values[i].resize(n);
+      derivs[i].resize(n);
+      dp2[i].resize(n);
+      for(unsigned k=0; k<n; ++k) {
+        const double dp=difference(i,hill.center[i],box_points[i][k])*hill.invsigma[i];
+        dp2[i][k]=0.5*dp*dp;
+        values[i][k]=prefactor*exp(-dp2[i][k]);
+        derivs[i][k]=-values[i][k]*dp*hill.invsigma[i];
+      }
+    }
+    BiasGrid_->addProductFunction(box_indices,values,derivs,dp2,DP2CUTOFF);
+  } else {
     unsigned ncv=getNumberOfArguments();
     vector<unsigned> nneighb=getGaussianSupport(hill);
     vector<Grid::index_t> neighbors=BiasGrid_->getNeighbors(hill.center,nneighb);
     vector<double> der(ncv);
     vector<double> xx(ncv);
-    if(comm.Get_size()==1) {
+    if(comm.Get_size()==1 || walkers_shm_) {
       for(unsigned i=0; i<neighbors.size(); ++i) {
         Grid::index_t ineigh=neighbors[i];
         for(unsigned j=0; j<ncv; ++j) der[j]=0.0;
@@ -1324,6 +1570,84 @@ void MetaD::addGaussian(const Gaussian& hill)
   }
 }
 
+void MetaD::shmBarrier()
+{
+  // wait for all the processes of the walkers sharing the grid
+  comm.Barrier();
+  if(comm.Get_rank()==0) shm_comm_.Barrier();
+  comm.Barrier();
+}
+
+void MetaD::flushPendingHills()
+{
+  if(pending_hills_.size()==0) return;
+  unsigned ncv=getNumberOfArguments();
+  unsigned nhills=pending_hills_.size();
+  // the grid points in the support of each hill and their union
+  vector<vector<Grid::index_t> > hill_points(nhills);
+  vector<Grid::index_t> points;
+  for(unsigned h=0; h<nhills; ++h) {
+    vector<unsigned> nneighb=getGaussianSupport(pending_hills_[h]);
+    hill_points[h]=BiasGrid_->getNeighbors(pending_hills_[h].center,nneighb);
+    // with periodic variables a wide hill could wrap onto the same points twice
+    std::sort(hill_points[h].begin(),hill_points[h].end());
+    hill_points[h].erase(std::unique(hill_points[h].begin(),hill_points[h].end()),hill_points[h].end());
+    points.insert(points.end(),hill_points[h].begin(),hill_points[h].end());
+  }
+  std::sort(points.begin(),points.end());
+  points.erase(std::unique(points.begin(),points.end()),points.end());
+  // the hills are bucketed per point, hills[offsets[p]] to hills[offsets[p+1]-1]
+  // are the ones whose support contains points[p], in the order of deposition
+  vector<unsigned> offsets(points.size()+1,0);
+  for(unsigned h=0; h<nhills; ++h) {
+    for(unsigned k=0; k<hill_points[h].size(); ++k) {
+      offsets[std::lower_bound(points.begin(),points.end(),hill_points[h][k])-points.begin()+1]++;
+    }
+  }
+  for(unsigned p=0; p<points.size(); ++p) offsets[p+1]+=offsets[p];
+  vector<unsigned> hills(offsets[points.size()]);
+  vector<unsigned> filled(offsets.begin(),offsets.end()-1);
+  for(unsigned h=0; h<nhills; ++h) {
+    for(unsigned k=0; k<hill_points[h].size(); ++k) {
+      hills[filled[std::lower_bound(points.begin(),points.end(),hill_points[h][k])-points.begin()]++]=h;
+    }
+  }
+  // each point gets the sum of all its hills in one go, the points are
+  // shared among the processes and then among the threads
+  unsigned stride=comm.Get_size();
+  unsigned rank=comm.Get_rank();
+  vector<double> allbias(points.size(),0.0);
+  vector<double> allder(ncv*points.size(),0.0);
+  unsigned nt=OpenMP::getNumThreads();
+  if(points.size()<4*nt*stride) nt=1;
+  #pragma omp parallel num_threads(nt)
+  {
+    vector<unsigned> indices(ncv);
+    vector<double> xx(ncv);
+    vector<double> dp(ncv);
+    #pragma omp for
+    for(unsigned p=rank; p<points.size(); p+=stride) {
+      BiasGrid_->getIndices(points[p],indices);
+      BiasGrid_->getPoint(indices,xx);
+      double bias=0.0;
+      for(unsigned e=offsets[p]; e<offsets[p+1]; ++e) {
+        bias+=evaluateGaussian(xx,pending_hills_[hills[e]],&allder[ncv*p],&dp[0]);
+      }
+      allbias[p]=bias;
+    }
+  }
+  if(stride>1) {
+    comm.Sum(allbias);
+    comm.Sum(allder);
+  }
+  vector<double> der(ncv);
+  for(unsigned p=0; p<points.size(); ++p) {
+    for(unsigned i=0; i<ncv; ++i) der[i]=allder[ncv*p+i];
+    BiasGrid_->addValueAndDerivatives(points[p],allbias[p],der);
+  }
+  pending_hills_.clear();
+}
+
 vector<unsigned> MetaD::getGaussianSupport(const Gaussian& hill)
 {
   vector<unsigned> nneigh;
@@ -1404,6 +1728,10 @@ double MetaD::getBiasAndDerivatives(const vector<double>& cv, double* der)
     } else {
       bias = BiasGrid_->getValue(cv);
     }
+    // hills that are not yet on the grid
+    for(unsigned i=0; i<pending_hills_.size(); ++i) {
+      bias+=evaluateGaussian(cv,pending_hills_[i],der);
+    }
   }
 
   return bias;
@@ -1433,8 +1761,11 @@ double MetaD::getGaussianNormalization( const Gaussian& hill )
   return norm*pow(2*pi,static_cast<double>(ncv)/2.0);
 }
 
-double MetaD::evaluateGaussian(const vector<double>& cv, const Gaussian& hill, double* der)
+double MetaD::evaluateGaussian(const vector<double>& cv, const Gaussian& hill, double* der, double* dp)
 {
+  // dp is the scratch space for the differences, dp_ is used if it is not given
+  // (which is not thread safe)
+  if(!dp) dp=dp_.get();
   double dp2=0.0;
   double bias=0.0;
   // I use a pointer here because cv is const (and should be const)
@@ -1463,7 +1794,7 @@ double MetaD::evaluateGaussian(const vector<double>& cv, const Gaussian& hill, d
     }
     for(unsigned i=0; i<cv.size(); ++i) {
       double dp_i=difference(i,hill.center[i],pcv[i]);
-      dp_[i]=dp_i;
+      dp[i]=dp_i;
       for(unsigned j=i; j<cv.size(); ++j) {
         if(i==j) {
           dp2+=dp_i*dp_i*mymatrix(i,j)*0.5;
@@ -1479,7 +1810,7 @@ double MetaD::evaluateGaussian(const vector<double>& cv, const Gaussian& hill, d
         for(unsigned i=0; i<cv.size(); ++i) {
           double tmp=0.0;
           for(unsigned j=0; j<cv.size(); ++j) {
-            tmp += dp_[j]*mymatrix(i,j)*bias;
+            tmp += dp[j]*mymatrix(i,j)*bias;
           }
           der[i]-=tmp;
         }
@@ -1487,15 +1818,14 @@ double MetaD::evaluateGaussian(const vector<double>& cv, const Gaussian& hill, d
     }
   } else {
     for(unsigned i=0; i<cv.size(); ++i) {
-      double dp=difference(i,hill.center[i],pcv[i])*hill.invsigma[i];
-      dp2+=dp*dp;
-      dp_[i]=dp;
+      dp[i]=difference(i,hill.center[i],pcv[i])*hill.invsigma[i];
+      dp2+=dp[i]*dp[i];
     }
     dp2*=0.5;
     if(dp2<DP2CUTOFF) {
       bias=hill.height*exp(-dp2);
       if(der) {
-        for(unsigned i=0; i<cv.size(); ++i) {der[i]+=-bias*dp_[i]*hill.invsigma[i];}
+        for(unsigned i=0; i<cv.size(); ++i) {der[i]+=-bias*dp[i]*hill.invsigma[i];}
       }
     }
   }
@@ -1521,6 +1851,7 @@ double MetaD::getHeight(const vector<double>& cv)
   }
   if(dampfactor_>0.0) {
     plumed_assert(BiasGrid_);
+    flushPendingHills();
     double m=BiasGrid_->getMaxValue();
     height*=exp(-m/(kbt_*(dampfactor_)));
   }
@@ -1645,6 +1976,8 @@ void MetaD::update() {
         addGaussian(newhill);
         writeGaussian(newhill,hillsOfile_);
       }
+      // the hills added by the other walkers on the node should be on the shared grid
+      if(walkers_shm_) shmBarrier();
     } else {
       Gaussian newhill=Gaussian(cv,thissigma,height,multivariate);
       addGaussian(newhill);
@@ -1664,6 +1997,7 @@ void MetaD::update() {
 
   // dump grid on file
   if(wgridstride_>0&&(getStep()%wgridstride_==0||getCPT())) {
+    flushPendingHills();
     // in case old grids are stored, a sequence of grids should appear
     // this call results in a repetition of the header:
     if(storeOldGrids_) gridfile_.clearFields();
@@ -1698,12 +2032,20 @@ void MetaD::update() {
         if(ifiles[i]->FileExist(ifilesnames[i])) {
           ifiles[i]->open(ifilesnames[i]);
           ifiles[i]->reset(false);
+          detectHillsFormat(i);
         }
         // otherwise read the new Gaussians
       } else {
+        // the file was too short to tell its format when it was opened
+        if(!ifilesdetected[i]) detectHillsFormat(i);
+        if(!ifilesdetected[i]) continue;
         log.printf("  Reading hills from %s:",ifilesnames[i].c_str());
-        readGaussians(ifiles[i].get());
-        ifiles[i]->reset(false);
+        if(ifilesbinary[i]) {
+          readGaussians(*ifilesbinary[i],ifilesnext[i]);
+        } else {
+          readGaussians(ifiles[i].get());
+          ifiles[i]->reset(false);
+        }
       }
     }
   }
@@ -1711,6 +2053,7 @@ void MetaD::update() {
   bool bias_has_changed = (nowAddAHill || (mw_n_ > 1 && getStep() % mw_rstride_ == 0));
   if(getStep()%(stride_*rewf_ustride_)==0 && nowAddAHill && rewf_grid_.size()>0 ) computeReweightingFactor();
   if (calc_max_bias_ && bias_has_changed) {
+    flushPendingHills();
     max_bias_ = BiasGrid_->getMaxValue();
     getPntrToComponent("maxbias")->set(max_bias_);
   }
@@ -1800,6 +2143,9 @@ void MetaD::computeReweightingFactor()
     return;
   }
 
+  // the bias is evaluated on many points, so it is cheaper to have all hills on the grid
+  flushPendingHills();
+
   // Recover the minimum values for the grid
   unsigned ncv=getNumberOfArguments();
   unsigned ntotgrid=1;
@@ -1854,6 +2200,7 @@ double MetaD::getTransitionBarrierBias() {
     // starting well. With this choice the searches will terminate in one step until
     // transitionwell_[1] is sampled.
   } else {
+    flushPendingHills();
     double least_transition_bias, curr_transition_bias;
     vector<double> sink = transitionwells_[0];
     vector<double> source = transitionwells_[1];
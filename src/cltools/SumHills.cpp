@@ -34,6 +34,7 @@
 #include "tools/File.h"
 #include "core/Value.h"
 #include "tools/Matrix.h"
+#include "tools/HillsBinaryFile.h"
 
 using namespace std;
 
@@ -56,6 +57,8 @@ The default name for the output file will be fes.dat
 Note that starting from this version plumed will automatically detect the
 number of the variables you have and their periodicity.
 Additionally, if you use flexible hills (multivariate gaussians), plumed will understand it from the HILLS file.
+Hills files written in the binary format (see the BINARY_HILLS flag of \ref METAD) are
+also detected automatically and can be used with --hills and --histo in the same way.
 
 now sum_hills tool accepts als multiple files that will be integrated one after the other
 
@@ -538,7 +541,38 @@ bool CLToolSumHills::findCvsAndPeriodic(std::string filename, std::vector< std::
   IFile ifile;
   ifile.allowIgnoredFields();
   std::vector<std::string> fields;
-  if(ifile.FileExist(filename)) {
+  if(ifile.FileExist(filename) && HillsBinaryFile::isBinaryFile(ifile.getPath())) {
+    // binary hills files have all the information in the header
+    cvs.clear(); pmin.clear(); pmax.clear();
+    HillsBinaryFile binfile(ifile.getPath());
+    const std::vector<std::string> & names=binfile.getNames();
+    for(unsigned i=0; i<names.size(); i++) {
+      std::vector<std::string> ss;
+      size_t dot=names[i].find_first_of('.');
+      if(dot!=std::string::npos) {
+        ss.push_back(names[i].substr(0,dot));
+        ss.push_back(names[i].substr(dot+1));
+      } else {
+        ss.push_back(names[i]);
+      }
+      cvs.push_back(ss);
+      pmin.push_back("none");
+      pmax.push_back("none");
+      if(binfile.headerFieldExists("min_"+names[i])) {
+        pmin[i]=binfile.getHeaderField("min_"+names[i]);
+        pmax[i]=binfile.getHeaderField("max_"+names[i]);
+      }
+    }
+    multivariate=binfile.isMultivariate();
+    if(binfile.headerFieldExists("lower_int")) {
+      lowI_=binfile.getHeaderField("lower_int");
+      uppI_=binfile.getHeaderField("upper_int");
+    } else {
+      lowI_="-1.";
+      uppI_="-1.";
+    }
+    return true;
+  } else if(ifile.FileExist(filename)) {
     cvs.clear(); pmin.clear(); pmax.clear();
     ifile.open(filename);
     ifile.scanFieldList(fields);
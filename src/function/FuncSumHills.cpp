@@ -24,6 +24,7 @@
 #include "tools/Exception.h"
 #include "tools/Communicator.h"
 #include "tools/BiasRepresentation.h"
+#include "tools/HillsBinaryFile.h"
 #include "tools/File.h"
 #include "tools/Tools.h"
 #include "tools/Stopwatch.h"
@@ -56,6 +57,8 @@ There are currently no examples for this keyword.
 class FilesHandler {
   vector <string> filenames;
   vector <std::unique_ptr<IFile>>  ifiles;
+  vector <std::unique_ptr<HillsBinaryFile>>  binfiles;
+  size_t nextrecord;
   Action *action;
   Log *log;
   bool parallelread;
@@ -65,10 +68,12 @@ public:
   FilesHandler(const vector<string> &filenames, const bool &parallelread,  Action &myaction, Log &mylog);
   bool readBunch(BiasRepresentation *br, int stride);
   bool scanOneHill(BiasRepresentation *br, IFile *ifile );
+  bool scanOneHill(BiasRepresentation *br, const HillsBinaryFile &binfile );
+  void openFile(unsigned i);
   void getMinMaxBin(vector<Value*> vals, Communicator &cc, vector<double> &vmin, vector<double> &vmax, vector<unsigned> &vbin);
   void getMinMaxBin(vector<Value*> vals, Communicator &cc, vector<double> &vmin, vector<double> &vmax, vector<unsigned> &vbin, vector<double> &histosigma);
 };
-FilesHandler::FilesHandler(const vector<string> &filenames, const bool &parallelread, Action &action, Log &mylog ):filenames(filenames),log(&mylog),parallelread(parallelread),beingread(0),isopen(false) {
+FilesHandler::FilesHandler(const vector<string> &filenames, const bool &parallelread, Action &action, Log &mylog ):filenames(filenames),binfiles(filenames.size()),nextrecord(0),log(&mylog),parallelread(parallelread),beingread(0),isopen(false) {
   this->action=&action;
   for(unsigned i=0; i<filenames.size(); i++) {
     std::unique_ptr<IFile> ifile(new IFile());
@@ -94,12 +99,12 @@ bool FilesHandler::readBunch(BiasRepresentation *br, int stride = -1) {
     ff=ifiles[beingread].get();
     if(!isopen) {
       (*log)<<"  opening file "<<filenames[beingread]<<"\n";
-      ff->open(filenames[beingread]); isopen=true;
+      openFile(beingread); isopen=true;
     }
     int n;
     while(true) {
       bool fileisover=true;
-      while(scanOneHill(br,ff)) {
+      while(binfiles[beingread] ? scanOneHill(br,*binfiles[beingread]) : scanOneHill(br,ff)) {
         // here do the dump if needed
         n=br->getNumberOfKernels();
         if(stride>0 && n%stride==0 && n!=0  ) {
@@ -111,11 +116,12 @@ bool FilesHandler::readBunch(BiasRepresentation *br, int stride = -1) {
       if(fileisover) {
         (*log)<<"  closing file "<<filenames[beingread]<<"\n";
         ff->close();
+        binfiles[beingread].reset();
         isopen=false;
         (*log)<<"  now total "<<br->getNumberOfKernels()<<" kernels \n";
         beingread++;
         if(beingread<ifiles.size()) {
-          ff=ifiles[beingread].get(); ff->open(filenames[beingread]);
+          ff=ifiles[beingread].get(); openFile(beingread);
           (*log)<<"  opening file "<<filenames[beingread]<<"\n";
           isopen=true;
         } else {
@@ -133,6 +139,14 @@ bool FilesHandler::readBunch(BiasRepresentation *br, int stride = -1) {
   }
   return morefiles;
 }
+// binary hills files are memory-mapped and read record by record
+void FilesHandler::openFile(unsigned i) {
+  ifiles[i]->open(filenames[i]);
+  if(HillsBinaryFile::isBinaryFile(ifiles[i]->getPath())) {
+    binfiles[i].reset(new HillsBinaryFile(ifiles[i]->getPath()));
+    nextrecord=0;
+  }
+}
 void FilesHandler::getMinMaxBin(vector<Value*> vals, Communicator &cc, vector<double> &vmin, vector<double> &vmax, vector<unsigned> &vbin) {
   // create the representation (no grid)
   BiasRepresentation br(vals,cc);
@@ -166,6 +180,15 @@ bool FilesHandler::scanOneHill(BiasRepresentation *br, IFile *ifile ) {
   }
 }
 
+bool FilesHandler::scanOneHill(BiasRepresentation *br, const HillsBinaryFile &binfile ) {
+  if(nextrecord<binfile.numberOfRecords()) {
+    br->pushKernel(binfile,nextrecord);
+    nextrecord++;
+    return true;
+  } else {
+    return false;
+  }
+}
 
 double  mylog( double v1 ) {
   return log(v1);
@@ -526,7 +549,7 @@ FuncSumHills::FuncSumHills(const ActionOptions&ao):
           log<<"  Bias: Projecting on subgrid... \n";
           BiasWeight Bw(beta);
           Grid biasGrid=*(biasrep->getGridPtr());
-          Grid smallGrid=biasGrid.project(proj,&Bw);
+          Grid smallGrid=biasGrid.project(proj,&Bw,&comm);
           OFile gridfile; gridfile.link(*this);
           std::ostringstream ostr; ostr<<nfiles;
           string myout;
@@ -64,6 +64,8 @@
 #include "CompiledExpression.h"
 #include "Operation.h"
 #include "ParsedExpression.h"
+#include <algorithm>
+#include <cmath>
 #include <utility>
 
 namespace PLMD {
@@ -77,9 +79,26 @@ CompiledExpression::CompiledExpression() : jitCode(NULL) {
 }
 
 CompiledExpression::CompiledExpression(const ParsedExpression& expression) : jitCode(NULL) {
-    ParsedExpression expr = expression.optimize(); // Just in case it wasn't already optimized.
+    compileExpressions(vector<ParsedExpression>(1, expression));
+}
+
+CompiledExpression::CompiledExpression(const vector<ParsedExpression>& expressions) : jitCode(NULL) {
+    if (expressions.size() == 0)
+        throw Exception("CompiledExpression: no expressions given");
+#ifdef LEPTON_USE_JIT
+    if (expressions.size() > 1)
+        throw Exception("CompiledExpression: evaluating several expressions at once is not supported with JIT compilation");
+#endif
+    compileExpressions(expressions);
+}
+
+void CompiledExpression::compileExpressions(const vector<ParsedExpression>& expressions) {
     vector<pair<ExpressionTreeNode, int> > temps;
-    compileExpression(expr.getRootNode(), temps);
+    for (int i = 0; i < (int) expressions.size(); i++) {
+        ParsedExpression expr = expressions[i].optimize(); // Just in case it wasn't already optimized.
+        compileExpression(expr.getRootNode(), temps);
+        resultIndices.push_back(findTempIndex(expr.getRootNode(), temps));
+    }
     int maxArguments = 1;
     for (int i = 0; i < (int) operation.size(); i++)
         if (operation[i]->getNumArguments() > maxArguments)
@@ -103,6 +122,7 @@ CompiledExpression::CompiledExpression(const CompiledExpression& expression) : j
 CompiledExpression& CompiledExpression::operator=(const CompiledExpression& expression) {
     arguments = expression.arguments;
     target = expression.target;
+    resultIndices = expression.resultIndices;
     variableIndices = expression.variableIndices;
     variableNames = expression.variableNames;
     workspace.resize(expression.workspace.size());
@@ -215,10 +235,187 @@ double CompiledExpression::evaluate() const {
             workspace[target[step]] = operation[step]->evaluate(&argValues[0], dummyVariables);
         }
     }
-    return workspace[workspace.size()-1];
+    return workspace[resultIndices[0]];
 #endif
 }
 
+int CompiledExpression::getNumResults() const {
+    return (int) resultIndices.size();
+}
+
+double CompiledExpression::getResult(int i) const {
+    return workspace[resultIndices[i]];
+}
+
+// Number of values that evaluateBatch() pushes through the list of operations at a time.
+static const int batchBlockSize = 64;
+
+void CompiledExpression::evaluateBatch(const string& variable, int n, const double* values, double* results) const {
+    evaluateBatch(vector<string>(1, variable), n, vector<const double*>(1, values), results);
+}
+
+void CompiledExpression::evaluateBatch(const vector<string>& variables, int n, const vector<const double*>& values, double* results) const {
+    if (variables.size() != values.size())
+        throw Exception("evaluateBatch: the number of variables does not match the number of arrays of values");
+    batchWorkspace.resize(workspace.size()*batchBlockSize);
+    batchScratch.resize(batchBlockSize);
+
+    // All variables start from their current value, the ones that are given are then overwritten block by block.
+
+    for (map<string, int>::const_iterator iter = variableIndices.begin(); iter != variableIndices.end(); ++iter) {
+        map<string, double*>::const_iterator pointer = variablePointers.find(iter->first);
+        double value = (pointer != variablePointers.end() ? *pointer->second : workspace[iter->second]);
+        fill(batchWorkspace.begin()+iter->second*batchBlockSize, batchWorkspace.begin()+(iter->second+1)*batchBlockSize, value);
+    }
+    vector<pair<double*, const double*> > batchVariables;
+    for (int i = 0; i < (int) variables.size(); i++) {
+        map<string, int>::const_iterator index = variableIndices.find(variables[i]);
+        if (index != variableIndices.end())
+            batchVariables.push_back(make_pair(&batchWorkspace[index->second*batchBlockSize], values[i]));
+    }
+
+    // Loop over blocks of values, for each block the operations are evaluated one after the other.
+
+    for (int start = 0; start < n; start += batchBlockSize) {
+        int blockSize = min(batchBlockSize, n-start);
+        for (int i = 0; i < (int) batchVariables.size(); i++)
+            copy(batchVariables[i].second+start, batchVariables[i].second+start+blockSize, batchVariables[i].first);
+        for (int step = 0; step < (int) operation.size(); step++)
+            evaluateBatchStep(step, blockSize);
+        for (int i = 0; i < (int) resultIndices.size(); i++) {
+            const double* result = &batchWorkspace[resultIndices[i]*batchBlockSize];
+            copy(result, result+blockSize, results+i*n+start);
+        }
+    }
+}
+
+void CompiledExpression::evaluateBatchStep(int step, int n) const {
+    const Operation& op = *operation[step];
+    const vector<int>& args = arguments[step];
+    double* out = &batchWorkspace[target[step]*batchBlockSize];
+    const double* a = &batchWorkspace[args[0]*batchBlockSize];
+    const double* b = NULL;
+    if (op.getNumArguments() > 1)
+        b = &batchWorkspace[(args.size() == 1 ? args[0]+1 : args[1])*batchBlockSize];
+
+    // The most common operations get a simple loop over the values, using the same arithmetic as
+    // Operation::evaluate() such that the results are identical to the ones of evaluate().
+
+    switch (op.getId()) {
+        case Operation::CONSTANT: {
+            double value = dynamic_cast<const Operation::Constant&>(op).getValue();
+            for (int j = 0; j < n; j++)
+                out[j] = value;
+            break;
+        }
+        case Operation::ADD:
+            for (int j = 0; j < n; j++)
+                out[j] = a[j]+b[j];
+            break;
+        case Operation::SUBTRACT:
+            for (int j = 0; j < n; j++)
+                out[j] = a[j]-b[j];
+            break;
+        case Operation::MULTIPLY:
+            for (int j = 0; j < n; j++)
+                out[j] = a[j]*b[j];
+            break;
+        case Operation::DIVIDE:
+            for (int j = 0; j < n; j++)
+                out[j] = a[j]/b[j];
+            break;
+        case Operation::NEGATE:
+            for (int j = 0; j < n; j++)
+                out[j] = -a[j];
+            break;
+        case Operation::SQRT:
+            for (int j = 0; j < n; j++)
+                out[j] = std::sqrt(a[j]);
+            break;
+        case Operation::EXP:
+            for (int j = 0; j < n; j++)
+                out[j] = std::exp(a[j]);
+            break;
+        case Operation::LOG:
+            for (int j = 0; j < n; j++)
+                out[j] = std::log(a[j]);
+            break;
+        case Operation::SIN:
+            for (int j = 0; j < n; j++)
+                out[j] = std::sin(a[j]);
+            break;
+        case Operation::COS:
+            for (int j = 0; j < n; j++)
+                out[j] = std::cos(a[j]);
+            break;
+        case Operation::TANH:
+            for (int j = 0; j < n; j++)
+                out[j] = std::tanh(a[j]);
+            break;
+        case Operation::SQUARE:
+            for (int j = 0; j < n; j++)
+                out[j] = a[j]*a[j];
+            break;
+        case Operation::CUBE:
+            for (int j = 0; j < n; j++)
+                out[j] = a[j]*a[j]*a[j];
+            break;
+        case Operation::RECIPROCAL:
+            for (int j = 0; j < n; j++)
+                out[j] = 1.0/a[j];
+            break;
+        case Operation::ADD_CONSTANT: {
+            double value = dynamic_cast<const Operation::AddConstant&>(op).getValue();
+            for (int j = 0; j < n; j++)
+                out[j] = a[j]+value;
+            break;
+        }
+        case Operation::MULTIPLY_CONSTANT: {
+            double value = dynamic_cast<const Operation::MultiplyConstant&>(op).getValue();
+            for (int j = 0; j < n; j++)
+                out[j] = a[j]*value;
+            break;
+        }
+        case Operation::POWER_CONSTANT: {
+            double value = dynamic_cast<const Operation::PowerConstant&>(op).getValue();
+            int exponent = (int) value;
+            if (exponent == value) {
+                // Integer powers by repeated multiplication, as in PowerConstant::evaluate().
+
+                double* base = &batchScratch[0];
+                for (int j = 0; j < n; j++) {
+                    base[j] = (exponent < 0 ? 1.0/a[j] : a[j]);
+                    out[j] = 1.0;
+                }
+                if (exponent < 0)
+                    exponent = -exponent;
+                while (exponent != 0) {
+                    if ((exponent&1) == 1)
+                        for (int j = 0; j < n; j++)
+                            out[j] *= base[j];
+                    for (int j = 0; j < n; j++)
+                        base[j] *= base[j];
+                    exponent = exponent>>1;
+                }
+            }
+            else
+                for (int j = 0; j < n; j++)
+                    out[j] = std::pow(a[j], value);
+            break;
+        }
+        default: {
+            // Any other operation is evaluated one value at a time.
+
+            int numArguments = op.getNumArguments();
+            for (int j = 0; j < n; j++) {
+                for (int i = 0; i < numArguments; i++)
+                    argValues[i] = batchWorkspace[(args.size() == 1 ? args[0]+i : args[i])*batchBlockSize+j];
+                out[j] = op.evaluate(&argValues[0], dummyVariables);
+            }
+        }
+    }
+}
+
 #ifdef LEPTON_USE_JIT
 static double evaluateOperation(Operation* op, double* args) {
     map<string, double>* dummyVariables = NULL;
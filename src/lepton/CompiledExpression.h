@@ -97,6 +97,12 @@ public:
     CompiledExpression();
     CompiledExpression(const CompiledExpression& expression);
     ~CompiledExpression();
+    /**
+     * Create a CompiledExpression that evaluates several expressions at once, for example a function together
+     * with its derivatives.  Subexpressions that appear in more than one of them are only evaluated once.
+     * The value returned by evaluate() is the one of the first expression, use getResult() to get the others.
+     */
+    explicit CompiledExpression(const std::vector<ParsedExpression>& expressions);
     CompiledExpression& operator=(const CompiledExpression& expression);
     /**
      * Get the names of all variables used by this expression.
@@ -117,9 +123,31 @@ public:
      * Evaluate the expression.  The values of all variables should have been set before calling this.
      */
     double evaluate() const;
+    /**
+     * Get the number of expressions that are evaluated by this CompiledExpression.
+     */
+    int getNumResults() const;
+    /**
+     * Get the value of the i-th expression as computed by the last call to evaluate().
+     */
+    double getResult(int i) const;
+    /**
+     * Evaluate the expression(s) for n different values of a set of variables.  values[k] points to the n values
+     * of the variable variables[k], all other variables keep the value they currently have.  Variables that are
+     * not used by the expression are ignored.  The value of the i-th expression for the j-th set of values is
+     * stored in results[i*n+j].  The operations are applied to blocks of values at a time such that the loops
+     * over the values can be vectorized by the compiler.
+     */
+    void evaluateBatch(const std::vector<std::string>& variables, int n, const std::vector<const double*>& values, double* results) const;
+    /**
+     * Evaluate the expression(s) for n different values of a single variable, see above.
+     */
+    void evaluateBatch(const std::string& variable, int n, const double* values, double* results) const;
 private:
     friend class ParsedExpression;
     CompiledExpression(const ParsedExpression& expression);
+    void compileExpressions(const std::vector<ParsedExpression>& expressions);
+    void evaluateBatchStep(int step, int n) const;
     void compileExpression(const ExpressionTreeNode& node, std::vector<std::pair<ExpressionTreeNode, int> >& temps);
     int findTempIndex(const ExpressionTreeNode& node, std::vector<std::pair<ExpressionTreeNode, int> >& temps);
     std::map<std::string, double*> variablePointers;
@@ -127,10 +155,13 @@ private:
     std::vector<std::vector<int> > arguments;
     std::vector<int> target;
     std::vector<Operation*> operation;
+    std::vector<int> resultIndices;
     std::map<std::string, int> variableIndices;
     std::set<std::string> variableNames;
     mutable std::vector<double> workspace;
     mutable std::vector<double> argValues;
+    mutable std::vector<double> batchWorkspace;
+    mutable std::vector<double> batchScratch;
     std::map<std::string, double> dummyVariables;
     void* jitCode;
 #ifdef LEPTON_USE_JIT
@@ -23,6 +23,7 @@
 #include "core/Value.h"
 #include "Communicator.h"
 #include <iostream>
+#include <algorithm>
 
 namespace PLMD {
 
@@ -154,6 +155,36 @@ void BiasRepresentation::pushKernel( IFile *ifile ) {
       plumed_massert(maxi==maxv,"the input periodicity in hills and in value definition does not match"  );
     }
   }
+  addKernel(std::move(kk));
+}
+void BiasRepresentation::pushKernel( const HillsBinaryFile & file, size_t irecord ) {
+  std::unique_ptr<KernelFunctions> kk;
+  const vector<string> & filenames=file.getNames();
+  vector<double> center(ndim);
+  for(int i=0 ; i<ndim; i++) {
+    unsigned j=std::find(filenames.begin(),filenames.end(),names[i])-filenames.begin();
+    plumed_massert(j<filenames.size(),"variable "+names[i]+" not found in binary hills file "+file.getPath());
+    center[i]=file.getCenter(irecord)[j];
+  }
+  if(histosigma.size()==0) {
+    plumed_massert(filenames==names,"the variables in binary hills file "+file.getPath()+" do not match the ones in input");
+    vector<double> sigma(file.getSigma(irecord),file.getSigma(irecord)+file.getSigmaSize());
+    kk.reset(new KernelFunctions(center,sigma,"gaussian",(file.isMultivariate()?"MULTIVARIATE":"DIAGONAL"),file.getHeight(irecord)));
+  } else {
+    kk.reset(new KernelFunctions(center,histosigma,"gaussian","DIAGONAL",1.0));
+  }
+  biasf.push_back(file.getBiasf(irecord));
+  string mins,maxs,mini,maxi; mins="min_"; maxs="max_";
+  for(int i=0 ; i<ndim; i++) {
+    if(values[i]->isPeriodic()) {
+      values[i]->getDomain(mini,maxi);
+      plumed_massert(file.headerFieldExists(mins+names[i]) && mini==file.getHeaderField(mins+names[i]),"the input periodicity in hills and in value definition does not match"  );
+      plumed_massert(file.headerFieldExists(maxs+names[i]) && maxi==file.getHeaderField(maxs+names[i]),"the input periodicity in hills and in value definition does not match"  );
+    }
+  }
+  addKernel(std::move(kk));
+}
+void BiasRepresentation::addKernel( std::unique_ptr<KernelFunctions> kk ) {
   // if grid is defined then it should be added on the grid
   //cerr<<"now with "<<hills.size()<<endl;
   if(hasgrid) {
@@ -26,6 +26,7 @@
 #include "KernelFunctions.h"
 #include "File.h"
 #include "Grid.h"
+#include "HillsBinaryFile.h"
 #include <memory>
 
 namespace PLMD {
@@ -57,6 +58,8 @@ public:
   void 		addGrid(const std::vector<std::string> & gmin, const std::vector<std::string> & gmax, const std::vector<unsigned> & nbin );
   /// push a kernel on the representation (includes widths and height)
   void 		pushKernel( IFile * ff);
+  /// push the kernel stored in a record of a binary hills file on the representation
+  void 		pushKernel( const HillsBinaryFile & file, size_t irecord);
   /// set the flag that rescales the free energy to the bias
   void 		setRescaledToBias(bool rescaled);
   /// check if the representation is rescaled to the bias
@@ -95,6 +98,8 @@ private:
   std::vector<double> histosigma;
   Communicator& mycomm;
   std::unique_ptr<Grid> BiasGrid_;
+  /// add a kernel, whose bias factor has been already stored, to the grid and to the list
+  void addKernel(std::unique_ptr<KernelFunctions> kk);
 };
 
 }
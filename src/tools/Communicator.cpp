@@ -148,6 +148,22 @@ void Communicator::Sum(Data data) {
 #endif
 }
 
+Communicator::Request Communicator::Isum(Data data) {
+  Request req;
+#if defined(__PLUMED_HAS_MPI)
+  req.r=MPI_REQUEST_NULL;
+#if MPI_VERSION>=3
+  if(initialized()) MPI_Iallreduce(MPI_IN_PLACE,data.pointer,data.size,data.type,MPI_SUM,communicator,&req.r);
+#else
+// MPI_Iallreduce is only available from MPI-3, fall back to a blocking reduction
+  if(initialized()) MPI_Allreduce(MPI_IN_PLACE,data.pointer,data.size,data.type,MPI_SUM,communicator);
+#endif
+#else
+  (void) data;
+#endif
+  return req;
+}
+
 Communicator::Request Communicator::Isend(ConstData data,int source,int tag) {
   Request req;
 #ifdef __PLUMED_HAS_MPI
@@ -234,12 +250,15 @@ bool Communicator::initialized() {
 
 void Communicator::Request::wait(Status&s) {
 #ifdef __PLUMED_HAS_MPI
+// requests returned by collectives that did nothing (e.g. Isum without MPI initialized)
+  if(r==MPI_REQUEST_NULL) return;
   plumed_massert(initialized(),"you are trying to use an MPI function, but MPI is not initialized");
   if(&s==&StatusIgnore) MPI_Wait(&r,MPI_STATUS_IGNORE);
   else MPI_Wait(&r,&s.s);
 #else
+// without MPI requests can only be obtained from collectives that are no-ops
+// (e.g. Isum), so there is nothing to wait for
   (void) s;
-  plumed_merror("you are trying to use an MPI function, but PLUMED has been compiled without MPI support");
 #endif
 }
 
@@ -181,6 +181,14 @@ public:
   template <class T> void Sum(T*buf,int count) {Sum(Data(buf,count));}
 /// Wrapper for MPI_Allreduce with MPI_SUM (reference)
   template <class T> void Sum(T&buf) {Sum(Data(buf));}
+/// Wrapper for non-blocking MPI_Iallreduce with MPI_SUM (data struct).
+/// The sum is done in place and the data should not be touched
+/// until the returned request has been waited for.
+  Request Isum(Data);
+/// Wrapper for non-blocking MPI_Iallreduce with MPI_SUM (pointer)
+  template <class T> Request Isum(T*buf,int count) {return Isum(Data(buf,count));}
+/// Wrapper for non-blocking MPI_Iallreduce with MPI_SUM (reference)
+  template <class T> Request Isum(T&buf) {return Isum(Data(buf));}
 
 /// Wrapper for MPI_Bcast (data struct)
   void Bcast(Data,int);
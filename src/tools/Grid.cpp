@@ -35,6 +35,14 @@
 #include <sstream>
 #include <cstdio>
 #include <cfloat>
+#include <algorithm>
+#include <new>
+#include <cstdint>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 using namespace std;
 namespace PLMD {
@@ -192,6 +200,12 @@ Grid::index_t Grid::getIndex(const vector<double> & x) const {
 // we are flattening arrays using a column-major order
 vector<unsigned> Grid::getIndices(index_t index) const {
   vector<unsigned> indices(dimension_);
+  getIndices(index,indices);
+  return indices;
+}
+
+void Grid::getIndices(index_t index,std::vector<unsigned> & indices) const {
+  plumed_dbg_assert(indices.size()==dimension_);
   index_t kk=index;
   indices[0]=(index%nbin_[0]);
   for(unsigned int i=1; i<dimension_-1; ++i) {
@@ -201,7 +215,6 @@ vector<unsigned> Grid::getIndices(index_t index) const {
   if(dimension_>=2) {
     indices[dimension_-1]=((kk-indices[dimension_-2])/nbin_[dimension_-2]);
   }
-  return indices;
 }
 
 vector<unsigned> Grid::getIndices(const vector<double> & x) const {
@@ -304,6 +317,26 @@ vector<Grid::index_t> Grid::getNeighbors
   return getNeighbors(getIndices(index),nneigh);
 }
 
+void Grid::getNeighborBox(const vector<double> & x,const vector<unsigned> & nneigh,
+                          vector< vector<unsigned> > & box_indices,vector< vector<double> > & box_points) const {
+  plumed_dbg_assert(x.size()==dimension_ && nneigh.size()==dimension_);
+  const vector<unsigned> indices=getIndices(x);
+  box_indices.resize(dimension_);
+  box_points.resize(dimension_);
+  for(unsigned i=0; i<dimension_; ++i) {
+    box_indices[i].clear();
+    box_points[i].clear();
+    const int n=static_cast<int>(nbin_[i]);
+    for(int k=-static_cast<int>(nneigh[i]); k<=static_cast<int>(nneigh[i]); ++k) {
+      int i0=static_cast<int>(indices[i])+k;
+      if(!pbc_[i] && (i0<0 || i0>=n)) continue;
+      if( pbc_[i]) i0=((i0%n)+n)%n;
+      box_indices[i].push_back(static_cast<unsigned>(i0));
+      box_points[i].push_back(min_[i]+(double)(i0)*dx_[i]);
+    }
+  }
+}
+
 vector<Grid::index_t> Grid::getSplineNeighbors(const vector<unsigned> & indices)const {
   plumed_dbg_assert(indices.size()==dimension_);
   vector<index_t> neighbors;
@@ -382,6 +415,81 @@ void Grid::addKernel( const KernelFunctions& kernel ) {
   }
 }
 
+void Grid::addProductFunction(const vector< vector<unsigned> > & box_indices,
+                              const vector< vector<double> > & values,
+                              const vector< vector<double> > & derivs,
+                              const vector< vector<double> > & cutoff_terms, const double cutoff) {
+  plumed_massert(box_indices.size()==dimension_ && values.size()==dimension_ && derivs.size()==dimension_ && cutoff_terms.size()==dimension_,
+                 "addProductFunction: the one-dimensional functions should be given along each dimension of the grid");
+  // the box is split in rows along the first dimension, the rows are enumerated
+  // by the indices along the other dimensions
+  vector<index_t> stride(dimension_);
+  index_t nrows=1;
+  bool duplicates=false;
+  for(unsigned i=0; i<dimension_; ++i) {
+    plumed_massert(values[i].size()==box_indices[i].size() && derivs[i].size()==box_indices[i].size() && cutoff_terms[i].size()==box_indices[i].size(),
+                   "addProductFunction: the one-dimensional functions should be given for all the points of the box");
+    stride[i] = (i==0) ? 1 : stride[i-1]*nbin_[i-1];
+    if(i>0) {
+      nrows*=box_indices[i].size();
+      if(box_indices[i].size()>nbin_[i]) duplicates=true;
+    }
+  }
+  const unsigned nrow=box_indices[0].size();
+  if(nrows==0 || nrow==0) return;
+  // with dense storage the rows are contiguous in memory and are added directly, in parallel
+  // if the box is large enough and no two rows are on the same points (which happens if the
+  // box wraps around a periodic dimension)
+  const bool dense=(grid_.size()==maxsize_);
+  unsigned nt=OpenMP::getNumThreads();
+  if(!dense || duplicates || nrows*nrow<4096) nt=1;
+  #pragma omp parallel num_threads(nt)
+  {
+    vector<double> der(dimension_);
+    vector<double> row_derivs(dimension_);
+    #pragma omp for
+    for(index_t irow=0; irow<nrows; ++irow) {
+      // product of the functions along the dimensions other than the first one
+      index_t row_index=0;
+      double row_value=1.0;
+      double row_cutoff=0.0;
+      for(unsigned j=1; j<dimension_; ++j) row_derivs[j]=1.0;
+      index_t kk=irow;
+      for(unsigned i=1; i<dimension_; ++i) {
+        const unsigned k=kk%box_indices[i].size();
+        kk/=box_indices[i].size();
+        row_index+=stride[i]*box_indices[i][k];
+        row_value*=values[i][k];
+        row_cutoff+=cutoff_terms[i][k];
+        for(unsigned j=1; j<dimension_; ++j) row_derivs[j]*=(j==i) ? derivs[i][k] : values[i][k];
+      }
+      if(row_cutoff>=cutoff) continue;
+      const unsigned* idx0=box_indices[0].data();
+      const double* val0=values[0].data();
+      const double* der0=derivs[0].data();
+      const double* cut0=cutoff_terms[0].data();
+      for(unsigned k=0; k<nrow; ++k) {
+        if(row_cutoff+cut0[k]>=cutoff) continue;
+        const index_t index=row_index+idx0[k];
+        const double value=row_value*val0[k];
+        if(dense) {
+          grid_[index]+=value;
+          if(usederiv_) {
+            der_[index][0]+=row_value*der0[k];
+            for(unsigned j=1; j<dimension_; ++j) der_[index][j]+=row_derivs[j]*val0[k];
+          }
+        } else if(usederiv_) {
+          der[0]=row_value*der0[k];
+          for(unsigned j=1; j<dimension_; ++j) der[j]=row_derivs[j]*val0[k];
+          addValueAndDerivatives(index,value,der);
+        } else {
+          addValue(index,value);
+        }
+      }
+    }
+  }
+}
+
 double Grid::getValue(index_t index) const {
   plumed_dbg_assert(index<maxsize_);
   return grid_[index];
@@ -696,13 +804,107 @@ std::unique_ptr<Grid> Grid::create(const std::string& funcl, const std::vector<V
   return grid;
 }
 
-// Sparse version of grid with map
+// Sparse version of grid with tiles
+const Grid::index_t SparseGrid::nokey_=std::numeric_limits<Grid::index_t>::max();
+
+void SparseGrid::setupTiles() {
+  // tiles have the same number of points along each dimension (at most 64 and
+  // at most 4096 points in total), unless the grid is smaller
+  unsigned edge=1;
+  while(edge<64 && pow(static_cast<double>(edge+1),static_cast<int>(dimension_))<=4096.0) edge++;
+  tile_bin_.resize(dimension_);
+  ntiles_.resize(dimension_);
+  tile_size_=1;
+  for(unsigned i=0; i<dimension_; ++i) {
+    tile_bin_[i]=std::min(edge,nbin_[i]);
+    ntiles_[i]=(nbin_[i]+tile_bin_[i]-1)/tile_bin_[i];
+    tile_size_*=tile_bin_[i];
+  }
+  stride_=(usederiv_ ? 1+dimension_ : 1);
+  clear();
+}
+
 void SparseGrid::clear() {
-  map_.clear();
+  tile_data_.clear();
+  tile_set_.clear();
+  tile_keys_.clear();
+  table_keys_.assign(64,nokey_);
+  table_tiles_.assign(64,0);
+  table_shift_=64-6;
+  npoints_=0;
+}
+
+void SparseGrid::locate(index_t index, index_t & key, unsigned & offset) const {
+  plumed_dbg_assert(index<maxsize_);
+  key=0;
+  offset=0;
+  index_t tile_stride=1;
+  unsigned point_stride=1;
+  for(unsigned i=0; i<dimension_; ++i) {
+    const unsigned j=index%nbin_[i];
+    index/=nbin_[i];
+    key+=tile_stride*(j/tile_bin_[i]);
+    offset+=point_stride*(j%tile_bin_[i]);
+    tile_stride*=ntiles_[i];
+    point_stride*=tile_bin_[i];
+  }
+}
+
+size_t SparseGrid::findSlot(index_t key) const {
+  // Fibonacci hashing, the size of the table is a power of two
+  const size_t mask=table_keys_.size()-1;
+  size_t slot=static_cast<size_t>((static_cast<uint64_t>(key)*UINT64_C(0x9E3779B97F4A7C15))>>table_shift_);
+  while(table_keys_[slot]!=key && table_keys_[slot]!=nokey_) slot=(slot+1)&mask;
+  return slot;
+}
+
+void SparseGrid::growTable() {
+  table_keys_.assign(2*table_keys_.size(),nokey_);
+  table_tiles_.assign(table_keys_.size(),0);
+  table_shift_--;
+  for(unsigned t=0; t<tile_keys_.size(); ++t) {
+    const size_t slot=findSlot(tile_keys_[t]);
+    table_keys_[slot]=tile_keys_[t];
+    table_tiles_[slot]=t;
+  }
+}
+
+const double* SparseGrid::findPointData(index_t index) const {
+  index_t key;
+  unsigned offset;
+  locate(index,key,offset);
+  const size_t slot=findSlot(key);
+  if(table_keys_[slot]==nokey_) return NULL;
+  return &tile_data_[table_tiles_[slot]][offset*stride_];
+}
+
+double* SparseGrid::getPointData(index_t index) {
+  index_t key;
+  unsigned offset;
+  locate(index,key,offset);
+  size_t slot=findSlot(key);
+  if(table_keys_[slot]==nokey_) {
+    // keep the table at most half full
+    if(2*(tile_keys_.size()+1)>table_keys_.size()) {
+      growTable();
+      slot=findSlot(key);
+    }
+    table_keys_[slot]=key;
+    table_tiles_[slot]=tile_keys_.size();
+    tile_keys_.push_back(key);
+    tile_data_.push_back(vector<double>(tile_size_*stride_,0.0));
+    tile_set_.push_back(vector<char>(tile_size_,0));
+  }
+  const unsigned tile=table_tiles_[slot];
+  if(!tile_set_[tile][offset]) {
+    tile_set_[tile][offset]=1;
+    npoints_++;
+  }
+  return &tile_data_[tile][offset*stride_];
 }
 
 Grid::index_t SparseGrid::getSize() const {
-  return map_.size();
+  return npoints_;
 }
 
 Grid::index_t SparseGrid::getMaxSize() const {
@@ -758,47 +960,47 @@ void Grid::findSetOfPointsOnContour(const double& target, const std::vector<bool
 
 double SparseGrid::getValue(index_t index)const {
   plumed_assert(index<maxsize_);
-  double value=0.0;
-  const auto it=map_.find(index);
-  if(it!=map_.end()) value=it->second;
-  return value;
+  const double* point=findPointData(index);
+  if(point) return point[0];
+  return 0.0;
 }
 
 double SparseGrid::getValueAndDerivatives
 (index_t index, vector<double>& der)const {
   plumed_assert(index<maxsize_ && usederiv_ && der.size()==dimension_);
-  double value=0.0;
-  for(unsigned int i=0; i<dimension_; ++i) der[i]=0.0;
-  const auto it=map_.find(index);
-  if(it!=map_.end()) value=it->second;
-  const auto itder=der_.find(index);
-  if(itder!=der_.end()) der=itder->second;
-  return value;
+  const double* point=findPointData(index);
+  if(!point) {
+    for(unsigned int i=0; i<dimension_; ++i) der[i]=0.0;
+    return 0.0;
+  }
+  for(unsigned int i=0; i<dimension_; ++i) der[i]=point[1+i];
+  return point[0];
 }
 
 void SparseGrid::setValue(index_t index, double value) {
   plumed_assert(index<maxsize_ && !usederiv_);
-  map_[index]=value;
+  getPointData(index)[0]=value;
 }
 
 void SparseGrid::setValueAndDerivatives
 (index_t index, double value, vector<double>& der) {
   plumed_assert(index<maxsize_ && usederiv_ && der.size()==dimension_);
-  map_[index]=value;
-  der_[index]=der;
+  double* point=getPointData(index);
+  point[0]=value;
+  for(unsigned int i=0; i<dimension_; ++i) point[1+i]=der[i];
 }
 
 void SparseGrid::addValue(index_t index, double value) {
   plumed_assert(index<maxsize_ && !usederiv_);
-  map_[index]+=value;
+  getPointData(index)[0]+=value;
 }
 
 void SparseGrid::addValueAndDerivatives
 (index_t index, double value, vector<double>& der) {
   plumed_assert(index<maxsize_ && usederiv_ && der.size()==dimension_);
-  map_[index]+=value;
-  der_[index].resize(dimension_);
-  for(unsigned int i=0; i<dimension_; ++i) der_[index][i]+=der[i];
+  double* point=getPointData(index);
+  point[0]+=value;
+  for(unsigned int i=0; i<dimension_; ++i) point[1+i]+=der[i];
 }
 
 void SparseGrid::writeToFile(OFile& ofile) {
@@ -807,8 +1009,26 @@ void SparseGrid::writeToFile(OFile& ofile) {
   double f;
   writeHeader(ofile);
   ofile.fmtField(" "+fmt_);
-  for(const auto & it : map_) {
-    index_t i=it.first;
+  // the points that have been set, in the order of the dense grid
+  vector<index_t> points;
+  points.reserve(npoints_);
+  vector<unsigned> tile_indices(dimension_);
+  vector<unsigned> point_indices(dimension_);
+  for(unsigned t=0; t<tile_keys_.size(); ++t) {
+    index_t key=tile_keys_[t];
+    for(unsigned j=0; j<dimension_; ++j) {tile_indices[j]=key%ntiles_[j]; key/=ntiles_[j];}
+    for(unsigned p=0; p<tile_size_; ++p) {
+      if(!tile_set_[t][p]) continue;
+      unsigned offset=p;
+      for(unsigned j=0; j<dimension_; ++j) {
+        point_indices[j]=tile_indices[j]*tile_bin_[j]+offset%tile_bin_[j];
+        offset/=tile_bin_[j];
+      }
+      points.push_back(getIndex(point_indices));
+    }
+  }
+  std::sort(points.begin(),points.end());
+  for(const auto & i : points) {
     xx=getPoint(i);
     if(usederiv_) {f=getValueAndDerivatives(i,der);}
     else {f=getValue(i);}
@@ -828,6 +1048,112 @@ void SparseGrid::writeToFile(OFile& ofile) {
 }
 
 
+// Version of grid in shared memory
+SharedGrid::SharedGrid(const std::string& funcl, const std::vector<Value*> & args, const std::vector<std::string> & gmin,
+                       const std::vector<std::string> & gmax, const std::vector<unsigned> & nbin, bool dospline, bool usederiv,
+                       const std::string& path, bool create):
+  Grid(funcl,args,gmin,gmax,nbin,dospline,usederiv,false),
+  path_(path),
+  map_pntr_(NULL),
+  map_size_(0),
+  data_(NULL),
+  stride_(usederiv ? 1+dimension_ : 1)
+{
+  map_size_=maxsize_*stride_*sizeof(std::atomic<double>);
+  int fd;
+  if(create) fd=open(path_.c_str(),O_RDWR|O_CREAT|O_TRUNC,0600);
+  else fd=open(path_.c_str(),O_RDWR);
+  if(fd<0) plumed_merror("cannot open the file "+path_+" for the shared grid");
+  if(create && ftruncate(fd,map_size_)!=0) {
+    close(fd);
+    plumed_merror("cannot set the size of the file "+path_+" for the shared grid");
+  }
+  struct stat file_stat;
+  if(fstat(fd,&file_stat)!=0 || static_cast<size_t>(file_stat.st_size)!=map_size_) {
+    close(fd);
+    plumed_merror("the file "+path_+" for the shared grid does not have the expected size");
+  }
+  map_pntr_=mmap(NULL,map_size_,PROT_READ|PROT_WRITE,MAP_SHARED,fd,0);
+  close(fd);
+  if(map_pntr_==MAP_FAILED) plumed_merror("cannot map the file "+path_+" for the shared grid into memory");
+  data_=static_cast<std::atomic<double>*>(map_pntr_);
+  if(create) {
+    for(index_t i=0; i<maxsize_*stride_; ++i) new(data_+i) std::atomic<double>(0.0);
+  }
+  // the atomic operations can only work among processes if they do not need locks
+  plumed_massert(data_[0].is_lock_free(),"atomic operations on doubles are not lock-free, the grid cannot be shared among processes");
+}
+
+SharedGrid::~SharedGrid() {
+  munmap(map_pntr_,map_size_);
+}
+
+void SharedGrid::removeFile() {
+  unlink(path_.c_str());
+}
+
+void SharedGrid::clear() {
+  for(index_t i=0; i<maxsize_*stride_; ++i) data_[i].store(0.0,std::memory_order_relaxed);
+}
+
+// there is no atomic addition for doubles, so it is done with a compare-and-swap loop
+static inline void atomicAdd(std::atomic<double>& a, const double value) {
+  double old=a.load(std::memory_order_relaxed);
+  while(!a.compare_exchange_weak(old,old+value,std::memory_order_relaxed)) {}
+}
+
+double SharedGrid::getValue(index_t index) const {
+  plumed_dbg_assert(index<maxsize_);
+  return data_[index*stride_].load(std::memory_order_relaxed);
+}
+
+double SharedGrid::getValueAndDerivatives
+(index_t index, vector<double>& der) const {
+  plumed_dbg_assert(index<maxsize_ && usederiv_ && der.size()==dimension_);
+  const std::atomic<double>* point=data_+index*stride_;
+  for(unsigned int i=0; i<dimension_; ++i) der[i]=point[1+i].load(std::memory_order_relaxed);
+  return point[0].load(std::memory_order_relaxed);
+}
+
+double SharedGrid::getMinValue() const {
+  double minval=DBL_MAX;
+  for(index_t i=0; i<maxsize_; ++i) minval=std::min(minval,getValue(i));
+  return minval;
+}
+
+double SharedGrid::getMaxValue() const {
+  double maxval=-DBL_MAX;
+  for(index_t i=0; i<maxsize_; ++i) maxval=std::max(maxval,getValue(i));
+  return maxval;
+}
+
+void SharedGrid::setValue(index_t index, double value) {
+  plumed_dbg_assert(index<maxsize_ && !usederiv_);
+  data_[index*stride_].store(value,std::memory_order_relaxed);
+}
+
+void SharedGrid::setValueAndDerivatives
+(index_t index, double value, vector<double>& der) {
+  plumed_dbg_assert(index<maxsize_ && usederiv_ && der.size()==dimension_);
+  std::atomic<double>* point=data_+index*stride_;
+  point[0].store(value,std::memory_order_relaxed);
+  for(unsigned int i=0; i<dimension_; ++i) point[1+i].store(der[i],std::memory_order_relaxed);
+}
+
+void SharedGrid::addValue(index_t index, double value) {
+  plumed_dbg_assert(index<maxsize_ && !usederiv_);
+  atomicAdd(data_[index*stride_],value);
+}
+
+void SharedGrid::addValueAndDerivatives
+(index_t index, double value, vector<double>& der) {
+  plumed_dbg_assert(index<maxsize_ && usederiv_ && der.size()==dimension_);
+  std::atomic<double>* point=data_+index*stride_;
+  atomicAdd(point[0],value);
+  for(unsigned int i=0; i<dimension_; ++i) atomicAdd(point[1+i],der[i]);
+}
+
+
 void Grid::projectOnLowDimension(double &val, std::vector<int> &vHigh, WeightBase * ptr2obj ) {
   unsigned i=0;
   for(i=0; i<vHigh.size(); i++) {
@@ -862,7 +1188,7 @@ void Grid::projectOnLowDimension(double &val, std::vector<int> &vHigh, WeightBas
   }
 }
 
-Grid Grid::project(const std::vector<std::string> & proj, WeightBase *ptr2obj ) {
+Grid Grid::getProjectionGrid(const std::vector<std::string> & proj, std::vector<index_t> & base, std::vector<index_t> & offsets) const {
   // find extrema only for the projection
   vector<string>   smallMin,smallMax;
   vector<unsigned> smallBin;
@@ -870,10 +1196,6 @@ Grid Grid::project(const std::vector<std::string> & proj, WeightBase *ptr2obj )
   vector<bool> smallIsPeriodic;
   vector<string> smallName;
 
-  // check if the two key methods are there
-  WeightBase* pp = dynamic_cast<WeightBase*>(ptr2obj);
-  if (!pp)plumed_merror("This WeightBase is not complete: you need a projectInnerLoop and projectOuterLoop ");
-
   for(unsigned j=0; j<proj.size(); j++) {
     for(unsigned i=0; i<getArgNames().size(); i++) {
       if(proj[j]==getArgNames()[i]) {
@@ -905,40 +1227,60 @@ Grid Grid::project(const std::vector<std::string> & proj, WeightBase *ptr2obj )
     }
     if(doappend)toBeIntegrated.push_back(i);
   }
-  //for(unsigned i=0;i<dimMapping.size();i++ ){
-  //     cerr<<"Dimension to preserve "<<dimMapping[i]<<endl;
-  //}
-  //for(unsigned i=0;i<toBeIntegrated.size();i++ ){
-  //     cerr<<"Dimension to integrate "<<toBeIntegrated[i]<<endl;
-  //}
-
-  // loop over all the points in the Grid, find the corresponding fixed index, rotate over all the other ones
-  for(unsigned i=0; i<smallgrid.getSize(); i++) {
-    std::vector<unsigned> v;
-    v=smallgrid.getIndices(i);
-    std::vector<int> vHigh((getArgNames()).size(),-1);
-    for(unsigned j=0; j<dimMapping.size(); j++)vHigh[dimMapping[j]]=int(v[j]);
-    // the vector vhigh now contains at the beginning the index of the low dimension and -1 for the values that need to be integrated
-    double initval=0.;
-    projectOnLowDimension(initval,vHigh, ptr2obj);
-    smallgrid.setValue(i,initval);
-  }
-  // reset to zero just for biasing (this option can be evtl enabled in a future...)
-  //double vmin;vmin=-smallgrid.getMinValue()+1;
-  for(unsigned i=0; i<smallgrid.getSize(); i++) {
-    //         //if(dynamic_cast<BiasWeight*>(ptr2obj)){
-    //         //        smallgrid.addValue(i,vmin);// go to 1
-    //         //}
-    double vv=smallgrid.getValue(i);
-    smallgrid.setValue(i,ptr2obj->projectOuterLoop(vv));
-    //         //if(dynamic_cast<BiasWeight*>(ptr2obj)){
-    //         //        smallgrid.addValue(i,-vmin);// bring back to the value
-    //         //}
+
+  // stride of each dimension in the flattened (column-major) array
+  vector<index_t> stride(dimension_);
+  stride[0]=1;
+  for(unsigned i=1; i<dimension_; i++) stride[i]=stride[i-1]*nbin_[i-1];
+
+  // first point of the high dimensional grid for each point of the projection
+  base.assign(smallgrid.getSize(),0);
+  for(index_t i=0; i<smallgrid.getSize(); i++) {
+    vector<unsigned> v=smallgrid.getIndices(i);
+    for(unsigned j=0; j<dimMapping.size(); j++) base[i]+=v[j]*stride[dimMapping[j]];
   }
 
+  // offsets of the points that are integrated out, the last dimension runs fastest
+  // such that the terms are summed in the same order as in projectOnLowDimension
+  index_t noffsets=1;
+  for(unsigned j=0; j<toBeIntegrated.size(); j++) noffsets*=nbin_[toBeIntegrated[j]];
+  offsets.assign(noffsets,0);
+  vector<unsigned> counter(toBeIntegrated.size(),0);
+  for(index_t k=0; k<noffsets; k++) {
+    for(unsigned j=0; j<toBeIntegrated.size(); j++) offsets[k]+=counter[j]*stride[toBeIntegrated[j]];
+    for(unsigned j=toBeIntegrated.size(); j-- > 0;) {
+      counter[j]++;
+      if(counter[j]<nbin_[toBeIntegrated[j]]) break;
+      counter[j]=0;
+    }
+  }
   return smallgrid;
 }
 
+const double* Grid::getAllValuesPntr(std::vector<double> & buffer) const {
+  if(grid_.size()==maxsize_) return grid_.data();
+  buffer.resize(maxsize_);
+  for(index_t i=0; i<maxsize_; i++) buffer[i]=getValue(i);
+  return buffer.data();
+}
+
+void Grid::getProjectionRange(Communicator* comm, const index_t npoints, index_t & begin, index_t & end) {
+  begin=0;
+  end=npoints;
+  if(comm!=NULL && comm->Get_size()>1) {
+    index_t nranks=comm->Get_size();
+    index_t rank=comm->Get_rank();
+    index_t chunk=npoints/nranks;
+    index_t remainder=npoints%nranks;
+    begin=rank*chunk+(rank<remainder ? rank : remainder);
+    end=begin+chunk+(rank<remainder ? 1 : 0);
+  }
+}
+
+void Grid::finishProjection(Grid & smallgrid, Communicator* comm) {
+  if(comm!=NULL && comm->Get_size()>1) comm->Sum(smallgrid.grid_);
+}
+
 double Grid::integrate( std::vector<unsigned>& npoints ) {
   plumed_dbg_assert( npoints.size()==dimension_ ); plumed_assert( dospline_ );
 
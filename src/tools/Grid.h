@@ -27,6 +27,9 @@
 #include <map>
 #include <cmath>
 #include <memory>
+#include <limits>
+#include <atomic>
+#include "OpenMP.h"
 
 namespace PLMD {
 
@@ -37,18 +40,22 @@ class WeightBase {
 public:
   virtual double projectInnerLoop(double &input, double &v)=0;
   virtual double projectOuterLoop(double &v)=0;
+/// if the inner loop sums exp(exponent*v) and the outer loop gives prefactor*log(sum)
+/// return true, then the projection is done as a numerically stable log-sum-exp
+  virtual bool projectLogSumExp(double & /*exponent*/, double & /*prefactor*/) const {return false;}
   virtual ~WeightBase() {}
 };
 
-class BiasWeight:public WeightBase {
+class BiasWeight final:public WeightBase {
 public:
   double beta,invbeta;
   explicit BiasWeight(double v) {beta=v; invbeta=1./beta;}
   double projectInnerLoop(double &input, double &v) {return  input+exp(beta*v);}
   double projectOuterLoop(double &v) {return -invbeta*std::log(v);}
+  bool projectLogSumExp(double &exponent, double &prefactor) const {exponent=beta; prefactor=-invbeta; return true;}
 };
 
-class ProbWeight:public WeightBase {
+class ProbWeight final:public WeightBase {
 public:
   double beta,invbeta;
   explicit ProbWeight(double v) {beta=v; invbeta=1./beta;}
@@ -94,6 +101,15 @@ protected:
   std::string fmt_; // format for output
 /// get "neighbors" for spline
   std::vector<index_t> getSplineNeighbors(const std::vector<unsigned> & indices)const;
+/// setup of the projection: the low dimensional grid, the index of the first point of this grid
+/// that is integrated over for each of its points and the offsets of all the points integrated over
+  Grid getProjectionGrid(const std::vector<std::string> & proj, std::vector<index_t> & base, std::vector<index_t> & offsets) const;
+/// the values of all the points, a dense copy is made in buffer for sparse grids
+  const double* getAllValuesPntr(std::vector<double> & buffer) const;
+/// range of points of the projection done by this MPI process
+  static void getProjectionRange(Communicator* comm, const index_t npoints, index_t & begin, index_t & end);
+/// sum the projection over the MPI processes
+  static void finishProjection(Grid & smallgrid, Communicator* comm);
 
 
 public:
@@ -140,6 +156,7 @@ public:
   std::vector<double> getPoint(const std::vector<unsigned> & indices) const;
   std::vector<double> getPoint(const std::vector<double> & x) const;
 /// faster versions relying on preallocated vectors
+  void getIndices(index_t index,std::vector<unsigned> & indices) const;
   void getPoint(index_t index,std::vector<double> & point) const;
   void getPoint(const std::vector<unsigned> & indices,std::vector<double> & point) const;
   void getPoint(const std::vector<double> & x,std::vector<double> & point) const;
@@ -148,6 +165,10 @@ public:
   std::vector<index_t> getNeighbors(index_t index,const std::vector<unsigned> & neigh) const;
   std::vector<index_t> getNeighbors(const std::vector<unsigned> & indices,const std::vector<unsigned> & neigh) const;
   std::vector<index_t> getNeighbors(const std::vector<double> & x,const std::vector<unsigned> & neigh) const;
+/// get the same neighbors as getNeighbors as a box, given by the indices and the coordinates
+/// of the points along each dimension, periodic dimensions are wrapped around
+  void getNeighborBox(const std::vector<double> & x,const std::vector<unsigned> & neigh,
+                      std::vector< std::vector<unsigned> > & box_indices,std::vector< std::vector<double> > & box_points) const;
 /// get nearest neighbors (those separated by exactly one lattice unit)
   std::vector<index_t> getNearestNeighbors(const index_t index) const;
   std::vector<index_t> getNearestNeighbors(const std::vector<unsigned> &indices) const;
@@ -202,6 +223,13 @@ public:
   virtual void applyFunctionAllValuesAndDerivatives( double (*func)(double val), double (*funcder)(double valder) );
 /// add a kernel function to the grid
   void addKernel( const KernelFunctions& kernel );
+/// add a function that is a product of one-dimensional functions to a box of points (see getNeighborBox),
+/// given by the values and derivatives of the one-dimensional functions on the points along each dimension,
+/// the points where the sum of the (non-negative) cutoff terms of each dimension is not below cutoff are skipped
+  void addProductFunction(const std::vector< std::vector<unsigned> > & box_indices,
+                          const std::vector< std::vector<double> > & values,
+                          const std::vector< std::vector<double> > & derivs,
+                          const std::vector< std::vector<double> > & cutoff_terms, const double cutoff);
 
 /// dump grid on file
   virtual void writeToFile(OFile&);
@@ -210,9 +238,12 @@ public:
 
   virtual ~Grid() {}
 
-/// project a high dimensional grid onto a low dimensional one: this should be changed at some time
-/// to enable many types of weighting
-  Grid project( const std::vector<std::string> & proj, WeightBase *ptr2obj  );
+/// project a high dimensional grid onto a low dimensional one using the weighting given by
+/// the WeightBase, the points of the projection are split between the threads and the MPI processes
+/// of comm if given (all processes should have the same grid), the weight is a template parameter
+/// such that the inner loop can be inlined for weights that are declared final
+  template<class W>
+  Grid project( const std::vector<std::string> & proj, W *ptr2obj, Communicator* comm=NULL );
   void projectOnLowDimension(double &val, std::vector<int> &varHigh, WeightBase* ptr2obj );
 /// set output format
   void setOutputFmt(const std::string & ss) {fmt_=ss;}
@@ -228,11 +259,40 @@ public:
 };
 
 
+/// Sparse version of the grid: the points are stored in tiles of neighboring points, which are
+/// allocated the first time one of their points is set and are found through a hash table.
+/// Values and derivatives of the points of a tile are stored one after the other.
 class SparseGrid : public Grid
 {
 
-  std::map<index_t,double> map_;
-  std::map< index_t,std::vector<double> > der_;
+/// number of points of a tile along each dimension
+  std::vector<unsigned> tile_bin_;
+/// number of tiles along each dimension
+  std::vector<unsigned> ntiles_;
+  unsigned tile_size_;
+/// number of doubles stored for each point (value and derivatives)
+  unsigned stride_;
+/// values and derivatives, which points have been set and the key of each allocated tile
+  std::vector< std::vector<double> > tile_data_;
+  std::vector< std::vector<char> > tile_set_;
+  std::vector<index_t> tile_keys_;
+/// open addressing hash table from the key of a tile to its position in tile_data_
+  std::vector<index_t> table_keys_;
+  std::vector<unsigned> table_tiles_;
+  unsigned table_shift_;
+  index_t npoints_;
+  static const index_t nokey_;
+
+  void setupTiles();
+/// key of the tile of a point and the position of the point in the tile
+  void locate(index_t index, index_t & key, unsigned & offset) const;
+/// slot of the hash table with the given key, or the empty slot where it should be added
+  size_t findSlot(index_t key) const;
+  void growTable();
+/// data of a point, NULL if its tile is not allocated
+  const double* findPointData(index_t index) const;
+/// data of a point, which is marked as set (allocating its tile if needed)
+  double* getPointData(index_t index);
 
 protected:
   void clear();
@@ -241,7 +301,12 @@ public:
   SparseGrid(const std::string& funcl, const std::vector<Value*> & args, const std::vector<std::string> & gmin,
              const std::vector<std::string> & gmax,
              const std::vector<unsigned> & nbin, bool dospline, bool usederiv):
-    Grid(funcl,args,gmin,gmax,nbin,dospline,usederiv,false) {}
+    Grid(funcl,args,gmin,gmax,nbin,dospline,usederiv,false),
+    tile_size_(0),
+    stride_(0),
+    table_shift_(0),
+    npoints_(0)
+  {setupTiles();}
 
   index_t getSize() const;
   index_t getMaxSize() const;
@@ -273,6 +338,113 @@ public:
 
   virtual ~SparseGrid() {}
 };
+
+
+/// Grid with the values and derivatives stored in a memory-mapped file, such that
+/// it can be shared among processes running on the same node (e.g. using a file in /dev/shm).
+/// Values and derivatives are added atomically, so that several processes can add to the grid at the same time.
+class SharedGrid : public Grid
+{
+
+  std::string path_;
+  void* map_pntr_;
+  size_t map_size_;
+/// value and derivatives of each point, one after the other
+  std::atomic<double>* data_;
+  unsigned stride_;
+
+  SharedGrid(const SharedGrid&);
+  SharedGrid& operator=(const SharedGrid&);
+
+protected:
+  void clear();
+
+public:
+/// if create is true the file is created (and the grid cleared), otherwise the grid is attached to an existing file
+  SharedGrid(const std::string& funcl, const std::vector<Value*> & args, const std::vector<std::string> & gmin,
+             const std::vector<std::string> & gmax, const std::vector<unsigned> & nbin, bool dospline, bool usederiv,
+             const std::string& path, bool create);
+
+/// remove the file, the grid remains shared among the processes that are already attached to it
+  void removeFile();
+
+/// this is to access to Grid:: version of these methods (allowing overloading of virtual methods)
+  using Grid::getValue;
+  using Grid::getValueAndDerivatives;
+  using Grid::setValue;
+  using Grid::setValueAndDerivatives;
+  using Grid::addValue;
+  using Grid::addValueAndDerivatives;
+
+/// get grid value
+  double getValue(index_t index) const;
+/// get grid value and derivatives
+  double getValueAndDerivatives(index_t index, std::vector<double>& der) const;
+/// get minimum value
+  double getMinValue() const;
+/// get maximum value
+  double getMaxValue() const;
+
+/// set grid value
+  void setValue(index_t index, double value);
+/// set grid value and derivatives
+  void setValueAndDerivatives(index_t index, double value, std::vector<double>& der);
+/// add to grid value
+  void addValue(index_t index, double value);
+/// add to grid value and derivatives
+  void addValueAndDerivatives(index_t index, double value, std::vector<double>& der);
+
+  virtual ~SharedGrid();
+};
+
+
+template<class W>
+Grid Grid::project(const std::vector<std::string> & proj, W *ptr2obj, Communicator* comm) {
+  std::vector<index_t> base;
+  std::vector<index_t> offsets;
+  Grid smallgrid=getProjectionGrid(proj,base,offsets);
+  std::vector<double> buffer;
+  const double* values=getAllValuesPntr(buffer);
+  const index_t noffsets=offsets.size();
+  const index_t* offsets_pntr=offsets.data();
+  double exponent=0.0;
+  double prefactor=0.0;
+  const bool logsumexp=ptr2obj->projectLogSumExp(exponent,prefactor);
+  index_t begin;
+  index_t end;
+  getProjectionRange(comm,smallgrid.getSize(),begin,end);
+  #pragma omp parallel for num_threads(OpenMP::getNumThreads())
+  for(index_t i=begin; i<end; i++) {
+    const double* cell=values+base[i];
+    double val;
+    if(logsumexp) {
+      // shift by the largest term such that exp does not overflow
+      double maxterm=-std::numeric_limits<double>::infinity();
+      for(index_t j=0; j<noffsets; j++) {
+        double term=exponent*cell[offsets_pntr[j]];
+        if(term>maxterm) maxterm=term;
+      }
+      if(std::isinf(maxterm)) {
+        val=prefactor*maxterm;
+      } else {
+        double sum=0.0;
+        for(index_t j=0; j<noffsets; j++) sum+=std::exp(exponent*cell[offsets_pntr[j]]-maxterm);
+        val=prefactor*(maxterm+std::log(sum));
+      }
+    } else {
+      double sum=0.0;
+      for(index_t j=0; j<noffsets; j++) {
+        double v=cell[offsets_pntr[j]];
+        sum=ptr2obj->projectInnerLoop(sum,v);
+      }
+      val=ptr2obj->projectOuterLoop(sum);
+    }
+    smallgrid.setValue(i,val);
+  }
+  finishProjection(smallgrid,comm);
+  return smallgrid;
+}
+
 }
 
 #endif
@@ -0,0 +1,215 @@
+/* +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+   Copyright (c) 2011-2017 The plumed team
+   (see the PEOPLE file at the root of the distribution for a list of names)
+
+   See http://www.plumed.org for more information.
+
+   This file is part of plumed, version 2.
+
+   plumed is free software: you can redistribute it and/or modify
+   it under the terms of the GNU Lesser General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   plumed is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public License
+   along with plumed.  If not, see <http://www.gnu.org/licenses/>.
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+#include "HillsBinaryFile.h"
+#include "Exception.h"
+#include "OFile.h"
+#include "Tools.h"
+
+#include <cstring>
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace PLMD {
+
+const std::string HillsBinaryFile::magic_ = "PLMDHILB";
+
+std::string HillsBinaryFile::getByteOrder() {
+  const uint32_t one = 1;
+  unsigned char first_byte;
+  std::memcpy(&first_byte,&one,1);
+  if(first_byte==1) return "little";
+  else return "big";
+}
+
+HillsBinaryFile::HillsBinaryFile(const std::string& path):
+  path_(path),
+  data_pntr_(NULL),
+  data_size_(0),
+  mapped_(false),
+  buffer_(0),
+  records_offset_(0),
+  multivariate_(false),
+  nsigma_(0),
+  record_size_(0),
+  nrecords_(0)
+{
+  update();
+}
+
+HillsBinaryFile::~HillsBinaryFile() {
+  unmap();
+}
+
+void HillsBinaryFile::map() {
+  int fd = open(path_.c_str(),O_RDONLY);
+  if(fd<0) plumed_merror("cannot open binary hills file "+path_);
+  struct stat file_stat;
+  if(fstat(fd,&file_stat)!=0) {
+    close(fd);
+    plumed_merror("cannot get the size of binary hills file "+path_);
+  }
+  data_size_ = static_cast<size_t>(file_stat.st_size);
+  if(data_size_>0) {
+    void* map_pntr = mmap(NULL,data_size_,PROT_READ,MAP_PRIVATE,fd,0);
+    if(map_pntr!=MAP_FAILED) {
+      data_pntr_ = static_cast<const char*>(map_pntr);
+      mapped_ = true;
+    } else {
+      // memory-mapping is not available, read the whole file instead
+      buffer_.resize(data_size_);
+      std::ifstream ifs(path_.c_str(),std::ios::binary);
+      ifs.read(buffer_.data(),data_size_);
+      if(!ifs) {
+        close(fd);
+        plumed_merror("problem reading binary hills file "+path_);
+      }
+      data_pntr_ = buffer_.data();
+    }
+  }
+  close(fd);
+}
+
+void HillsBinaryFile::unmap() {
+  if(mapped_) munmap(const_cast<char*>(data_pntr_),data_size_);
+  mapped_=false;
+  data_pntr_=NULL;
+  data_size_=0;
+  buffer_.clear();
+}
+
+void HillsBinaryFile::update() {
+  unmap();
+  map();
+  // the header could be incomplete if the file has just been created by another walker
+  if(records_offset_==0) readHeader();
+  if(records_offset_>0 && data_size_>records_offset_) {
+    nrecords_=(data_size_-records_offset_)/(record_size_*sizeof(double));
+  } else {
+    nrecords_=0;
+  }
+}
+
+void HillsBinaryFile::readHeader() {
+  const size_t prefix_size = magic_.size()+sizeof(uint64_t);
+  if(data_size_<prefix_size) return;
+  if(std::memcmp(data_pntr_,magic_.c_str(),magic_.size())!=0) {
+    plumed_merror("file "+path_+" is not a binary hills file");
+  }
+  uint64_t header_size;
+  std::memcpy(&header_size,data_pntr_+magic_.size(),sizeof(uint64_t));
+  if(data_size_<prefix_size+header_size) return;
+  std::string header_str(data_pntr_+prefix_size,header_size);
+  header_str = header_str.substr(0,header_str.find('\0'));
+  std::istringstream header_stream(header_str);
+  std::string line;
+  while(std::getline(header_stream,line)) {
+    size_t pos = line.find(' ');
+    if(pos==std::string::npos) header_[line]="";
+    else header_[line.substr(0,pos)]=line.substr(pos+1);
+  }
+  if(getHeaderField("byte_order")!=getByteOrder()) {
+    plumed_merror("binary hills file "+path_+" was written on a machine with a different byte order ("+header_["byte_order"]+")");
+  }
+  names_=Tools::getWords(getHeaderField("names"));
+  multivariate_=(getHeaderField("multivariate")=="true");
+  unsigned nsigma, record_size;
+  Tools::convert(getHeaderField("nsigma"),nsigma);
+  Tools::convert(getHeaderField("record_size"),record_size);
+  nsigma_=nsigma;
+  record_size_=record_size;
+  plumed_massert(record_size_==names_.size()+nsigma_+3,"inconsistent record size in binary hills file "+path_);
+  records_offset_=prefix_size+header_size;
+}
+
+bool HillsBinaryFile::headerFieldExists(const std::string& key) const {
+  return header_.find(key)!=header_.end();
+}
+
+std::string HillsBinaryFile::getHeaderField(const std::string& key) const {
+  std::map<std::string,std::string>::const_iterator it = header_.find(key);
+  if(it==header_.end()) plumed_merror("cannot find field "+key+" in the header of binary hills file "+path_);
+  return it->second;
+}
+
+void HillsBinaryFile::writeHeader(OFile& ofile, const std::vector<std::string>& names, const std::vector<std::string>& min, const std::vector<std::string>& max, bool multivariate, const Header& extra) {
+  const size_t ncv=names.size();
+  const size_t nsigma=(multivariate ? ncv*(ncv+1)/2 : ncv);
+  std::string header_str = "byte_order "+getByteOrder()+"\n";
+  header_str += "names";
+  for(unsigned i=0; i<ncv; i++) header_str += " "+names[i];
+  header_str += "\n";
+  for(unsigned i=0; i<ncv; i++) {
+    if(min[i].length()>0) {
+      header_str += "min_"+names[i]+" "+min[i]+"\n";
+      header_str += "max_"+names[i]+" "+max[i]+"\n";
+    }
+  }
+  header_str += "kerneltype gaussian\n";
+  header_str += std::string("multivariate ")+(multivariate ? "true" : "false")+"\n";
+  std::string s;
+  Tools::convert(nsigma,s); header_str += "nsigma "+s+"\n";
+  Tools::convert(ncv+nsigma+3,s); header_str += "record_size "+s+"\n";
+  for(unsigned i=0; i<extra.size(); i++) {
+    header_str += extra[i].first+" "+extra[i].second+"\n";
+  }
+  // pad with zeros to a multiple of 8 bytes, so that the records are aligned
+  header_str.resize(8*((header_str.size()+7)/8),'\0');
+  const uint64_t header_size = header_str.size();
+  std::vector<char> prefix(magic_.size()+sizeof(uint64_t));
+  std::memcpy(prefix.data(),magic_.c_str(),magic_.size());
+  std::memcpy(prefix.data()+magic_.size(),&header_size,sizeof(uint64_t));
+  ofile.writeBytes(prefix.data(),prefix.size());
+  ofile.writeBytes(header_str.data(),header_str.size());
+}
+
+void HillsBinaryFile::writeRecord(OFile& ofile, double time, const std::vector<double>& center, const std::vector<double>& sigma, double height, double biasf) {
+  std::vector<double> record;
+  record.reserve(center.size()+sigma.size()+3);
+  record.push_back(time);
+  record.insert(record.end(),center.begin(),center.end());
+  record.insert(record.end(),sigma.begin(),sigma.end());
+  record.push_back(height);
+  record.push_back(biasf);
+  ofile.writeBytes(reinterpret_cast<const char*>(record.data()),record.size()*sizeof(double));
+}
+
+bool HillsBinaryFile::isBinaryFile(const std::string& path) {
+  std::ifstream ifs(path.c_str(),std::ios::binary);
+  if(!ifs) return false;
+  std::string start(magic_.size(),'\0');
+  ifs.read(&start[0],start.size());
+  return ifs && start==magic_;
+}
+
+bool HillsBinaryFile::canDetectFormat(const std::string& path) {
+  struct stat file_stat;
+  if(stat(path.c_str(),&file_stat)!=0) return false;
+  return static_cast<size_t>(file_stat.st_size)>=magic_.size();
+}
+
+}
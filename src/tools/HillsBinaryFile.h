@@ -0,0 +1,123 @@
+/* +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+   Copyright (c) 2011-2017 The plumed team
+   (see the PEOPLE file at the root of the distribution for a list of names)
+
+   See http://www.plumed.org for more information.
+
+   This file is part of plumed, version 2.
+
+   plumed is free software: you can redistribute it and/or modify
+   it under the terms of the GNU Lesser General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   plumed is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public License
+   along with plumed.  If not, see <http://www.gnu.org/licenses/>.
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+#ifndef __PLUMED_tools_HillsBinaryFile_h
+#define __PLUMED_tools_HillsBinaryFile_h
+
+#include <vector>
+#include <string>
+#include <map>
+#include <utility>
+#include <cstddef>
+
+namespace PLMD {
+
+class OFile;
+
+/*
+Binary file with the hills deposited by metadynamics. The file has the layout
+
+  8 bytes   the string "PLMDHILB"
+  8 bytes   length of the header in bytes (unsigned 64 bit integer)
+  header    text with one "key value" pair per line, padded with zeros
+  records   one record of doubles for each hill
+
+The header contains the byte order of the machine that wrote the file, the
+names of the variables, their domains (min_<name> and max_<name>, only
+for periodic variables), whether the hills are multivariate and the
+number of doubles in each record. All the records have the same length:
+
+  time, center (one value per variable), sigma, height, biasf
+
+For diagonal hills sigma contains one width per variable, for multivariate
+hills it contains the upper triangle of the inverse covariance matrix, row by
+row, that is the representation that is used internally. The height is stored
+as in the text format, i.e. rescaled with biasf/(biasf-1) in well-tempered runs.
+
+Since the records have a fixed length, record i is at a known offset from the
+start of the file, and the file can be memory-mapped and used without parsing.
+Records are only appended, and a record that was not completely written
+(e.g. because the file is being written by another walker or because of a crash)
+is ignored.
+*/
+
+/// Reads and writes the binary format of the hills files
+class HillsBinaryFile {
+public:
+  typedef std::vector<std::pair<std::string,std::string> > Header;
+private:
+  std::string path_;
+  const char* data_pntr_;
+  size_t data_size_;
+  bool mapped_;
+  std::vector<char> buffer_;
+  size_t records_offset_;
+  std::map<std::string,std::string> header_;
+  std::vector<std::string> names_;
+  bool multivariate_;
+  size_t nsigma_;
+  size_t record_size_;
+  size_t nrecords_;
+  static const std::string magic_;
+  static std::string getByteOrder();
+  void map();
+  void unmap();
+  void readHeader();
+  HillsBinaryFile(const HillsBinaryFile&);
+  HillsBinaryFile& operator=(const HillsBinaryFile&);
+public:
+/// maps the file read-only into memory
+  explicit HillsBinaryFile(const std::string&);
+  ~HillsBinaryFile();
+/// map the file again to see the records that have been appended in the meanwhile
+  void update();
+/// write the header of a new file, given the names of the variables, their domains
+/// (empty strings for non periodic variables) and any additional field
+  static void writeHeader(OFile&, const std::vector<std::string>& names, const std::vector<std::string>& min, const std::vector<std::string>& max, bool multivariate, const Header& extra);
+/// append one hill to the file
+  static void writeRecord(OFile&, double time, const std::vector<double>& center, const std::vector<double>& sigma, double height, double biasf);
+/// check if a file starts with the header of a binary hills file
+  static bool isBinaryFile(const std::string&);
+/// check if enough of a file has been written to tell whether it is a binary hills file,
+/// a file that has just been created by another walker could still be empty
+  static bool canDetectFormat(const std::string&);
+///
+  std::string getPath() const {return path_;}
+  bool headerFieldExists(const std::string&) const;
+  std::string getHeaderField(const std::string&) const;
+  const std::vector<std::string>& getNames() const {return names_;}
+  bool isMultivariate() const {return multivariate_;}
+  size_t getSigmaSize() const {return nsigma_;}
+/// the number of complete records
+  size_t numberOfRecords() const {return nrecords_;}
+  double getTime(size_t irecord) const {return getRecord(irecord)[0];}
+  const double* getCenter(size_t irecord) const {return getRecord(irecord)+1;}
+  const double* getSigma(size_t irecord) const {return getRecord(irecord)+1+names_.size();}
+  double getHeight(size_t irecord) const {return getRecord(irecord)[1+names_.size()+nsigma_];}
+  double getBiasf(size_t irecord) const {return getRecord(irecord)[2+names_.size()+nsigma_];}
+  const double* getRecord(size_t irecord) const {
+    return reinterpret_cast<const double*>(data_pntr_+records_offset_)+irecord*record_size_;
+  }
+};
+
+}
+
+#endif
@@ -249,6 +249,9 @@ public:
   OFile& clearFields();
 /// Formatted output with explicit format - a la printf
   int printf(const char*fmt,...);
+/// Unformatted output of a block of bytes, e.g. for binary files.
+/// As for printf, only the first process of the linked communicator writes.
+  size_t writeBytes(const char*ptr,size_t s) {return llwrite(ptr,s);}
 /// Formatted output with << operator
   template <class T>
   friend OFile& operator<<(OFile&,const T &);
@@ -250,13 +250,12 @@ void SwitchingFunction::set(const std::string & definition,std::string& errormsg
     type=leptontype;
     std::string func;
     Tools::parse(data,"FUNC",func);
-    lepton::ParsedExpression pe=lepton::Parser::parse(func).optimize(leptonConstants);
+    std::vector<lepton::ParsedExpression> pe;
+    pe.push_back(lepton::Parser::parse(func).optimize(leptonConstants));
+    pe.push_back(lepton::Parser::parse(func).differentiate("x").optimize(leptonConstants));
     lepton_func=func;
     expression.resize(OpenMP::getNumThreads());
-    for(auto & e : expression) e=pe.createCompiledExpression();
-    lepton::ParsedExpression ped=lepton::Parser::parse(func).differentiate("x").optimize(leptonConstants);
-    expression_deriv.resize(OpenMP::getNumThreads());
-    for(auto & e : expression_deriv) e=ped.createCompiledExpression();
+    for(auto & e : expression) e=lepton::CompiledExpression(pe);
   }
   else errormsg="cannot understand switching function type '"+name+"'";
   if( !data.empty() ) {
@@ -399,13 +398,12 @@ double SwitchingFunction::calculate(double distance,double&dfunc)const {
       plumed_assert(t<expression.size());
       try {
         const_cast<lepton::CompiledExpression*>(&expression[t])->getVariableReference("x")=rdist;
-        const_cast<lepton::CompiledExpression*>(&expression_deriv[t])->getVariableReference("x")=rdist;
       } catch(PLMD::lepton::Exception& exc) {
 // this is necessary since in some cases lepton things a variable is not present even though it is present
 // e.g. func=0*x
       }
       result=expression[t].evaluate();
-      dfunc=expression_deriv[t].evaluate();
+      dfunc=expression[t].getResult(1);
     } else plumed_merror("Unknown switching function type");
 // this is for the chain rule:
     dfunc*=invr0;
@@ -75,12 +75,9 @@ class SwitchingFunction {
   double do_rational(double rdist,double&dfunc,int nn,int mm)const;
 /// Function for lepton;
   std::string lepton_func;
-/// Lepton expression.
+/// Lepton expression for the function and its derivative, sharing common subexpressions.
 /// \warning Since lepton::CompiledExpression is mutable, a vector is necessary for multithreading!
   std::vector<lepton::CompiledExpression> expression;
-/// Lepton expression for derivative
-/// \warning Since lepton::CompiledExpression is mutable, a vector is necessary for multithreading!
-  std::vector<lepton::CompiledExpression> expression_deriv;
 public:
   static void registerKeywords( Keywords& keys );
 /// Set a "rational" switching function.
@@ -93,6 +93,7 @@ public:
   static void registerKeywords(Keywords&);
   explicit BF_Chebyshev(const ActionOptions&);
   void getAllValues(const double, double&, bool&, std::vector<double>&, std::vector<double>&) const;
+  void getAllValuesBatch(const size_t, const double*, double*, bool*, double*, double*) const;
   double getInnerProductWeight(const double arg) const;
   std::string getInnerProductWeightStr() const {return "1/sqrt(1-x^2)";}
 };
@@ -126,23 +127,57 @@ void BF_Chebyshev::getAllValues(const double arg, double& argT, bool& inside_ran
   // plumed_assert(derivs.size()==numberOfBasisFunctions());
   inside_range=true;
   argT=translateArgument(arg, inside_range);
-  std::vector<double> derivsT(derivs.size());
+  // derivatives with respect to the translated argument of the two previous orders
+  double derivT_prev=0.0;
+  double derivT_curr=1.0;
   //
   values[0]=1.0;
-  derivsT[0]=0.0;
   derivs[0]=0.0;
   values[1]=argT;
-  derivsT[1]=1.0;
   derivs[1]=intervalDerivf();
   for(unsigned int i=1; i < getOrder(); i++) {
     values[i+1]  = 2.0*argT*values[i]-values[i-1];
-    derivsT[i+1] = 2.0*values[i]+2.0*argT*derivsT[i]-derivsT[i-1];
-    derivs[i+1]  = intervalDerivf()*derivsT[i+1];
+    double derivT_next = 2.0*values[i]+2.0*argT*derivT_curr-derivT_prev;
+    derivs[i+1]  = intervalDerivf()*derivT_next;
+    derivT_prev = derivT_curr;
+    derivT_curr = derivT_next;
   }
   if(!inside_range) {for(unsigned int i=0; i<derivs.size(); i++) {derivs[i]=0.0;}}
 }
 
 
+void BF_Chebyshev::getAllValuesBatch(const size_t nargs, const double* args, double* argsT, bool* inside_range, double* values, double* derivs) const {
+  translateArguments(nargs,args,argsT,inside_range);
+  // derivatives with respect to the translated argument of the two previous orders
+  std::vector<double> derivsT_prev(nargs,0.0);
+  std::vector<double> derivsT_curr(nargs,1.0);
+  //
+  for(size_t k=0; k<nargs; k++) {
+    values[k]=1.0;
+    derivs[k]=0.0;
+    values[nargs+k]=argsT[k];
+    derivs[nargs+k]=intervalDerivf();
+  }
+  for(unsigned int i=1; i < getOrder(); i++) {
+    const double* values_curr = values + i*nargs;
+    const double* values_prev = values + (i-1)*nargs;
+    double* values_next = values + (i+1)*nargs;
+    double* derivs_next = derivs + (i+1)*nargs;
+    for(size_t k=0; k<nargs; k++) {
+      values_next[k] = 2.0*argsT[k]*values_curr[k]-values_prev[k];
+      double derivT_next = 2.0*values_curr[k]+2.0*argsT[k]*derivsT_curr[k]-derivsT_prev[k];
+      derivs_next[k] = intervalDerivf()*derivT_next;
+      derivsT_prev[k] = derivsT_curr[k];
+      derivsT_curr[k] = derivT_next;
+    }
+  }
+  for(unsigned int i=0; i<numberOfBasisFunctions(); i++) {
+    for(size_t k=0; k<nargs; k++) {
+      if(!inside_range[k]) {derivs[i*nargs+k]=0.0;}
+    }
+  }
+}
+
 void BF_Chebyshev::setupUniformIntegrals() {
   for(unsigned int i=0; i<numberOfBasisFunctions(); i++) {
     double io = i;
@@ -24,6 +24,8 @@
 
 #include "core/ActionRegister.h"
 
+#include <cmath>
+
 
 namespace PLMD {
 namespace ves {
@@ -44,10 +46,12 @@ class BF_CubicBspline : public BasisFunctions {
   double inv_spacing_;
   double inv_normfactor_;
   double spline(const double, double&) const;
+  void getSplineWindow(const double, unsigned int&, unsigned int&) const;
 public:
   static void registerKeywords( Keywords&);
   explicit BF_CubicBspline(const ActionOptions&);
   void getAllValues(const double, double&, bool&, std::vector<double>&, std::vector<double>&) const;
+  void getActiveIndices(const double, std::vector<unsigned int>&) const;
 };
 
 
@@ -76,6 +80,7 @@ BF_CubicBspline::BF_CubicBspline(const ActionOptions&ao):
   setNonPeriodic();
   setNonOrthogonal();
   setIntervalBounded();
+  setCompactSupport();
   setType("splines_2nd-order");
   setDescription("Cubic B-splines (2nd order splines)");
   setLabelPrefix("S");
@@ -93,8 +98,16 @@ void BF_CubicBspline::getAllValues(const double arg, double& argT, bool& inside_
   //
   values[0]=1.0;
   derivs[0]=0.0;
-  //
+  // only the four splines centered around argT are non-zero
+  unsigned int ifirst = 0;
+  unsigned int ilast = 0;
+  getSplineWindow(argT,ifirst,ilast);
   for(unsigned int i=1; i < getNumberOfBasisFunctions(); i++) {
+    if(i<ifirst || i>ilast) {
+      values[i]=0.0;
+      derivs[i]=0.0;
+      continue;
+    }
     double argx = ((argT-intervalMin())*inv_spacing_) - (static_cast<double>(i)-2.0);
     values[i]  = spline(argx, derivs[i]);
     derivs[i]*=inv_spacing_;
@@ -103,6 +116,29 @@ void BF_CubicBspline::getAllValues(const double arg, double& argT, bool& inside_
 }
 
 
+void BF_CubicBspline::getActiveIndices(const double argT, std::vector<unsigned int>& active_indices) const {
+  // the constant and the (at most) four splines centered around argT
+  unsigned int ifirst = 0;
+  unsigned int ilast = 0;
+  getSplineWindow(argT,ifirst,ilast);
+  active_indices.resize(1+ilast-ifirst+1);
+  active_indices[0]=0;
+  for(unsigned int i=ifirst; i<=ilast; i++) {active_indices[1+i-ifirst]=i;}
+}
+
+
+void BF_CubicBspline::getSplineWindow(const double argT, unsigned int& ifirst, unsigned int& ilast) const {
+  // spline i is centered at intervalMin()+(i-2)*spacing_ and is zero two spacings away from its center
+  int ilower = static_cast<int>(std::floor((argT-intervalMin())*inv_spacing_))+1;
+  int iupper = ilower+3;
+  int nbasis = static_cast<int>(getNumberOfBasisFunctions());
+  if(ilower<1) {ilower=1;}
+  if(iupper>nbasis-1) {iupper=nbasis-1;}
+  ifirst = static_cast<unsigned int>(ilower);
+  ilast = static_cast<unsigned int>(iupper);
+}
+
+
 double BF_CubicBspline::spline(const double arg, double& deriv) const {
   double value=0.0;
   double x=arg;
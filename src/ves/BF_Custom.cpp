@@ -25,6 +25,9 @@
 #include "core/ActionRegister.h"
 #include "lepton/Lepton.h"
 
+#include <algorithm>
+#include <set>
+
 
 namespace PLMD {
 namespace ves {
@@ -121,19 +124,22 @@ BF_CUSTOM ...
 
 class BF_Custom : public BasisFunctions {
 private:
-  lepton::CompiledExpression transf_value_expression_;
-  lepton::CompiledExpression transf_deriv_expression_;
-  std::vector<lepton::CompiledExpression> bf_values_expressions_;
-  std::vector<lepton::CompiledExpression> bf_derivs_expressions_;
+  // transform function and its derivative, evaluated together
+  lepton::CompiledExpression transf_expression_;
+  // values of basis functions 1 to N-1 followed by their derivatives, evaluated together
+  // such that subexpressions shared between the functions are only computed once
+  lepton::CompiledExpression bf_expression_;
   std::string variable_str_;
   std::string transf_variable_str_;
   bool do_transf_;
   bool check_nan_inf_;
+  void checkValueAndDerivative(const unsigned int, const double, const double) const;
 public:
   static void registerKeywords( Keywords&);
   explicit BF_Custom(const ActionOptions&);
   ~BF_Custom() {};
   void getAllValues(const double, double&, bool&, std::vector<double>&, std::vector<double>&) const;
+  void getAllValuesBatch(const size_t, const double*, double*, bool*, double*, double*) const;
 };
 
 PLUMED_REGISTER_ACTION(BF_Custom,"BF_CUSTOM")
@@ -151,8 +157,6 @@ void BF_Custom::registerKeywords(Keywords& keys) {
 
 BF_Custom::BF_Custom(const ActionOptions&ao):
   PLUMED_VES_BASISFUNCTIONS_INIT(ao),
-  bf_values_expressions_(0),
-  bf_derivs_expressions_(0),
   variable_str_("x"),
   transf_variable_str_("t"),
   do_transf_(false),
@@ -187,23 +191,25 @@ BF_Custom::BF_Custom(const ActionOptions&ao):
   bf_values_parsed[0] = "1";
   bf_derivs_parsed[0] = "0";
   //
-  bf_values_expressions_.resize(getNumberOfBasisFunctions());
-  bf_derivs_expressions_.resize(getNumberOfBasisFunctions());
+  std::vector<lepton::ParsedExpression> bf_values_pe;
+  std::vector<lepton::ParsedExpression> bf_derivs_pe;
   //
   for(unsigned int i=1; i<getNumberOfBasisFunctions(); i++) {
     std::string is; Tools::convert(i,is);
+    std::set<std::string> variables;
     try {
       lepton::ParsedExpression pe_value = lepton::Parser::parse(bf_str[i]).optimize(leptonConstants);
       std::ostringstream tmp_stream; tmp_stream << pe_value;
       bf_values_parsed[i] = tmp_stream.str();
-      bf_values_expressions_[i] = pe_value.createCompiledExpression();
+      variables = pe_value.createCompiledExpression().getVariables();
+      bf_values_pe.push_back(pe_value);
     }
     catch(PLMD::lepton::Exception& exc) {
       plumed_merror("There was some problem in parsing the function "+bf_str[i]+" given in FUNC"+is + " with lepton");
     }
 
     std::vector<std::string> var_str;
-    for(auto &p: bf_values_expressions_[i].getVariables()) {
+    for(auto &p: variables) {
       var_str.push_back(p);
     }
     if(var_str.size()!=1) {
@@ -217,13 +223,16 @@ BF_Custom::BF_Custom(const ActionOptions&ao):
       lepton::ParsedExpression pe_deriv = lepton::Parser::parse(bf_str[i]).differentiate(variable_str_).optimize(leptonConstants);
       std::ostringstream tmp_stream2; tmp_stream2 << pe_deriv;
       bf_derivs_parsed[i] = tmp_stream2.str();
-      bf_derivs_expressions_[i] = pe_deriv.createCompiledExpression();
+      bf_derivs_pe.push_back(pe_deriv);
     }
     catch(PLMD::lepton::Exception& exc) {
       plumed_merror("There was some problem in parsing the derivative of the function "+bf_str[i]+" given in FUNC"+is + " with lepton");
     }
 
   }
+  std::vector<lepton::ParsedExpression> bf_pe(bf_values_pe);
+  bf_pe.insert(bf_pe.end(),bf_derivs_pe.begin(),bf_derivs_pe.end());
+  bf_expression_ = lepton::CompiledExpression(bf_pe);
 
   std::string transf_value_parsed;
   std::string transf_deriv_parsed;
@@ -241,18 +250,21 @@ BF_Custom::BF_Custom(const ActionOptions&ao):
       else {break;}
     }
 
+    std::vector<lepton::ParsedExpression> transf_pe;
+    std::set<std::string> variables;
     try {
       lepton::ParsedExpression pe_value = lepton::Parser::parse(transf_str).optimize(leptonConstants);;
       std::ostringstream tmp_stream; tmp_stream << pe_value;
       transf_value_parsed = tmp_stream.str();
-      transf_value_expression_ = pe_value.createCompiledExpression();
+      variables = pe_value.createCompiledExpression().getVariables();
+      transf_pe.push_back(pe_value);
     }
     catch(PLMD::lepton::Exception& exc) {
       plumed_merror("There was some problem in parsing the function "+transf_str+" given in TRANSFORM with lepton");
     }
 
     std::vector<std::string> var_str;
-    for(auto &p: transf_value_expression_.getVariables()) {
+    for(auto &p: variables) {
       var_str.push_back(p);
     }
     if(var_str.size()!=1) {
@@ -266,11 +278,12 @@ BF_Custom::BF_Custom(const ActionOptions&ao):
       lepton::ParsedExpression pe_deriv = lepton::Parser::parse(transf_str).differentiate(transf_variable_str_).optimize(leptonConstants);;
       std::ostringstream tmp_stream2; tmp_stream2 << pe_deriv;
       transf_deriv_parsed = tmp_stream2.str();
-      transf_deriv_expression_ = pe_deriv.createCompiledExpression();
+      transf_pe.push_back(pe_deriv);
     }
     catch(PLMD::lepton::Exception& exc) {
       plumed_merror("There was some problem in parsing the derivative of the function "+transf_str+" given in TRANSFORM with lepton");
     }
+    transf_expression_ = lepton::CompiledExpression(transf_pe);
   }
   //
   log.printf("  Using the following functions [lepton parsed function and derivative]:\n");
@@ -308,18 +321,13 @@ void BF_Custom::getAllValues(const double arg, double& argT, bool& inside_range,
   //
   if(do_transf_) {
     // has to copy as the function is const
-    lepton::CompiledExpression ce_value = transf_value_expression_;
-    try {
-      ce_value.getVariableReference(transf_variable_str_) = argT;
-    } catch(PLMD::lepton::Exception& exc) {}
-
-    lepton::CompiledExpression ce_deriv = transf_deriv_expression_;
+    lepton::CompiledExpression ce_transf = transf_expression_;
     try {
-      ce_deriv.getVariableReference(transf_variable_str_) = argT;
+      ce_transf.getVariableReference(transf_variable_str_) = argT;
     } catch(PLMD::lepton::Exception& exc) {}
 
-    argT = ce_value.evaluate();
-    transf_derivf = ce_deriv.evaluate();
+    argT = ce_transf.evaluate();
+    transf_derivf = ce_transf.getResult(1);
 
     if(check_nan_inf_ && (std::isnan(argT) || std::isinf(argT)) ) {
       std::string vs; Tools::convert(argT,vs);
@@ -332,38 +340,89 @@ void BF_Custom::getAllValues(const double arg, double& argT, bool& inside_range,
     }
   }
   //
+  lepton::CompiledExpression ce_bf = bf_expression_;
+  try {
+    ce_bf.getVariableReference(variable_str_) = argT;
+  } catch(PLMD::lepton::Exception& exc) {}
+  ce_bf.evaluate();
+  //
+  const unsigned int nfunc = getNumberOfBasisFunctions()-1;
   values[0]=1.0;
   derivs[0]=0.0;
   for(unsigned int i=1; i < getNumberOfBasisFunctions(); i++) {
-    lepton::CompiledExpression ce_value = bf_values_expressions_[i];
-    try {
-      ce_value.getVariableReference(variable_str_) = argT;
-    } catch(PLMD::lepton::Exception& exc) {}
-    values[i] = ce_value.evaluate();
-
-    lepton::CompiledExpression ce_deriv = bf_derivs_expressions_[i];
-    try {
-      ce_deriv.getVariableReference(variable_str_) = argT;
-    } catch(PLMD::lepton::Exception& exc) {}
-    derivs[i] = ce_deriv.evaluate();
+    values[i] = ce_bf.getResult(i-1);
+    derivs[i] = ce_bf.getResult(nfunc+i-1);
     if(do_transf_) {derivs[i]*=transf_derivf;}
     // NaN checks
-    if(check_nan_inf_ && (std::isnan(values[i]) || std::isinf(values[i])) ) {
-      std::string vs; Tools::convert(values[i],vs);
-      std::string is; Tools::convert(i,is);
-      plumed_merror(getName()+" with label "+getLabel()+": problem with the basis function given in FUNC"+is+", it gives "+vs);
+    if(check_nan_inf_) {checkValueAndDerivative(i,values[i],derivs[i]);}
+  }
+  if(!inside_range) {for(unsigned int i=0; i<derivs.size(); i++) {derivs[i]=0.0;}}
+}
+
+
+void BF_Custom::getAllValuesBatch(const size_t nargs, const double* args, double* argsT, bool* inside_range, double* values, double* derivs) const {
+  for(size_t k=0; k<nargs; k++) {
+    bool inside=true;
+    argsT[k]=checkIfArgumentInsideInterval(args[k],inside);
+    inside_range[k]=inside;
+  }
+  std::vector<double> transf_derivf;
+  if(do_transf_) {
+    // transformed arguments followed by the derivatives of the transform function
+    // copy as the CompiledExpression is not thread safe
+    lepton::CompiledExpression ce_transf = transf_expression_;
+    std::vector<double> transf_results(2*nargs);
+    ce_transf.evaluateBatch(transf_variable_str_,nargs,argsT,transf_results.data());
+    std::copy(transf_results.begin(),transf_results.begin()+nargs,argsT);
+    transf_derivf.assign(transf_results.begin()+nargs,transf_results.end());
+    if(check_nan_inf_) {
+      for(size_t k=0; k<nargs; k++) {
+        if(std::isnan(argsT[k]) || std::isinf(argsT[k])) {
+          std::string vs; Tools::convert(argsT[k],vs);
+          plumed_merror(getName()+" with label "+getLabel()+": problem with the transform function, it gives " + vs);
+        }
+        if(std::isnan(transf_derivf[k]) || std::isinf(transf_derivf[k])) {
+          std::string vs; Tools::convert(transf_derivf[k],vs);
+          plumed_merror(getName()+" with label "+getLabel()+": problem with the transform function, its derivative gives " + vs);
+        }
+      }
     }
-    //
-    if(check_nan_inf_ && (std::isnan(derivs[i])|| std::isinf(derivs[i])) ) {
-      std::string vs; Tools::convert(derivs[i],vs);
-      std::string is; Tools::convert(i,is);
-      plumed_merror(getName()+" with label "+getLabel()+": problem with derivative of the basis function given in FUNC"+is+", it gives "+vs);
+  }
+  //
+  // the results are stored function by function, i.e. in the same layout as values and derivs
+  const unsigned int nfunc = getNumberOfBasisFunctions()-1;
+  lepton::CompiledExpression ce_bf = bf_expression_;
+  std::vector<double> bf_results(2*nfunc*nargs);
+  ce_bf.evaluateBatch(variable_str_,nargs,argsT,bf_results.data());
+  for(size_t k=0; k<nargs; k++) {
+    values[k]=1.0;
+    derivs[k]=0.0;
+  }
+  std::copy(bf_results.begin(),bf_results.begin()+nfunc*nargs,values+nargs);
+  std::copy(bf_results.begin()+nfunc*nargs,bf_results.end(),derivs+nargs);
+  for(unsigned int i=1; i<getNumberOfBasisFunctions(); i++) {
+    for(size_t k=0; k<nargs; k++) {
+      if(do_transf_) {derivs[i*nargs+k]*=transf_derivf[k];}
+      if(check_nan_inf_) {checkValueAndDerivative(i,values[i*nargs+k],derivs[i*nargs+k]);}
+      if(!inside_range[k]) {derivs[i*nargs+k]=0.0;}
     }
   }
-  if(!inside_range) {for(unsigned int i=0; i<derivs.size(); i++) {derivs[i]=0.0;}}
 }
 
 
+void BF_Custom::checkValueAndDerivative(const unsigned int i, const double value, const double deriv) const {
+  if(std::isnan(value) || std::isinf(value)) {
+    std::string vs; Tools::convert(value,vs);
+    std::string is; Tools::convert(i,is);
+    plumed_merror(getName()+" with label "+getLabel()+": problem with the basis function given in FUNC"+is+", it gives "+vs);
+  }
+  //
+  if(std::isnan(deriv) || std::isinf(deriv)) {
+    std::string vs; Tools::convert(deriv,vs);
+    std::string is; Tools::convert(i,is);
+    plumed_merror(getName()+" with label "+getLabel()+": problem with derivative of the basis function given in FUNC"+is+", it gives "+vs);
+  }
+}
 
 
 }
@@ -89,6 +89,7 @@ public:
   static void registerKeywords(Keywords&);
   explicit BF_Fourier(const ActionOptions&);
   void getAllValues(const double, double&, bool&, std::vector<double>&, std::vector<double>&) const;
+  void getAllValuesBatch(const size_t, const double*, double*, bool*, double*, double*) const;
 };
 
 
@@ -137,6 +138,34 @@ void BF_Fourier::getAllValues(const double arg, double& argT, bool& inside_range
 }
 
 
+void BF_Fourier::getAllValuesBatch(const size_t nargs, const double* args, double* argsT, bool* inside_range, double* values, double* derivs) const {
+  translateArguments(nargs,args,argsT,inside_range);
+  for(size_t k=0; k<nargs; k++) {
+    values[k]=1.0;
+    derivs[k]=0.0;
+  }
+  for(unsigned int i=1; i < getOrder()+1; i++) {
+    double io = i;
+    double* values_cos = values + (2*i-1)*nargs;
+    double* derivs_cos = derivs + (2*i-1)*nargs;
+    double* values_sin = values + (2*i)*nargs;
+    double* derivs_sin = derivs + (2*i)*nargs;
+    for(size_t k=0; k<nargs; k++) {
+      double cos_tmp = cos(io*argsT[k]);
+      double sin_tmp = sin(io*argsT[k]);
+      values_cos[k] = cos_tmp;
+      derivs_cos[k] = -io*sin_tmp*intervalDerivf();
+      values_sin[k] = sin_tmp;
+      derivs_sin[k] = io*cos_tmp*intervalDerivf();
+    }
+  }
+  for(unsigned int i=0; i<numberOfBasisFunctions(); i++) {
+    for(size_t k=0; k<nargs; k++) {
+      if(!inside_range[k]) {derivs[i*nargs+k]=0.0;}
+    }
+  }
+}
+
 void BF_Fourier::setupLabels() {
   setLabel(0,"1");
   for(unsigned int i=1; i < getOrder()+1; i++) {
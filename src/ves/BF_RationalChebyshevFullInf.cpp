@@ -92,18 +92,20 @@ void BF_RationalChebyshevFullInf::getAllValues(const double arg, double& argT, b
   double derivf = (mapf_*mapf_)/pow(sqtmp,3);
   argT = argT/sqtmp;
   //
-  std::vector<double> derivsT(derivs.size());
+  // derivatives with respect to the translated argument of the two previous orders
+  double derivT_prev=0.0;
+  double derivT_curr=1.0;
   //
   values[0]=1.0;
-  derivsT[0]=0.0;
   derivs[0]=0.0;
   values[1]=argT;
-  derivsT[1]=1.0;
   derivs[1]=derivf;
   for(unsigned int i=1; i < getOrder(); i++) {
     values[i+1]  = 2.0*argT*values[i]-values[i-1];
-    derivsT[i+1] = 2.0*values[i]+2.0*argT*derivsT[i]-derivsT[i-1];
-    derivs[i+1]  = derivf*derivsT[i+1];
+    double derivT_next = 2.0*values[i]+2.0*argT*derivT_curr-derivT_prev;
+    derivs[i+1]  = derivf*derivT_next;
+    derivT_prev = derivT_curr;
+    derivT_curr = derivT_next;
   }
   if(!inside_range) {for(unsigned int i=0; i<derivs.size(); i++) {derivs[i]=0.0;}}
 }
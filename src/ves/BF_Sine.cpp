@@ -87,6 +87,7 @@ public:
   static void registerKeywords(Keywords&);
   explicit BF_Sine(const ActionOptions&);
   void getAllValues(const double, double&, bool&, std::vector<double>&, std::vector<double>&) const;
+  void getAllValuesBatch(const size_t, const double*, double*, bool*, double*, double*) const;
 };
 
 
@@ -133,6 +134,28 @@ void BF_Sine::getAllValues(const double arg, double& argT, bool& inside_range, s
 }
 
 
+void BF_Sine::getAllValuesBatch(const size_t nargs, const double* args, double* argsT, bool* inside_range, double* values, double* derivs) const {
+  translateArguments(nargs,args,argsT,inside_range);
+  for(size_t k=0; k<nargs; k++) {
+    values[k]=1.0;
+    derivs[k]=0.0;
+  }
+  for(unsigned int i=1; i < getOrder()+1; i++) {
+    double io = i;
+    double* values_i = values + i*nargs;
+    double* derivs_i = derivs + i*nargs;
+    for(size_t k=0; k<nargs; k++) {
+      values_i[k] = sin(io*argsT[k]);
+      derivs_i[k] = io*cos(io*argsT[k])*intervalDerivf();
+    }
+  }
+  for(unsigned int i=0; i<numberOfBasisFunctions(); i++) {
+    for(size_t k=0; k<nargs; k++) {
+      if(!inside_range[k]) {derivs[i*nargs+k]=0.0;}
+    }
+  }
+}
+
 void BF_Sine::setupLabels() {
   setLabel(0,"1");
   for(unsigned int i=1; i < getOrder()+1; i++) {
@@ -29,6 +29,8 @@
 #include "tools/Grid.h"
 #include "tools/Tools.h"
 
+#include <memory>
+
 
 namespace PLMD {
 namespace ves {
@@ -57,6 +59,7 @@ BasisFunctions::BasisFunctions(const ActionOptions&ao):
   periodic_(false),
   orthogonal_(false),
   interval_bounded_(true),
+  compact_support_(false),
   interval_intrinsic_min_str_("1.0"),
   interval_intrinsic_max_str_("-1.0"),
   interval_intrinsic_min_(1.0),
@@ -213,6 +216,7 @@ void BasisFunctions::printInfo() const {
   else {
     log.printf("   The basis functions are not orthogonal\n");
   }
+  if(compact_support_) {log.printf("   The basis functions have compact support\n");}
   log.printf("   Order of basis set: %u\n",norder_);
   log.printf("   Number of basis functions: %u\n",nbasis_);
   // log.printf("   Interval of basis set: %f to %f\n",interval_min_,interval_max_);
@@ -273,22 +277,28 @@ std::vector<double> BasisFunctions::numericalTargetDistributionIntegralsFromGrid
   //
   std::vector<double> targetdist_integrals(nbasis_,0.0);
   std::vector<double> integration_weights = GridIntegrationWeights::getIntegrationWeights(grid_pntr);
-
-  for(Grid::index_t k=0; k < grid_pntr->getSize(); k++) {
-    double arg = grid_pntr->getPoint(k)[0];
-    std::vector<double> bf_values(nbasis_);
-    std::vector<double> bf_derivs(nbasis_);
-    bool inside=true;
-    double argT=0.0;
-    getAllValues(arg,argT,inside,bf_values,bf_derivs);
+  //
+  size_t npoints = grid_pntr->getSize();
+  std::vector<double> args(npoints);
+  for(Grid::index_t k=0; k < npoints; k++) {
+    args[k] = grid_pntr->getPoint(k)[0];
+  }
+  std::vector<double> argsT(npoints);
+  std::unique_ptr<bool[]> inside(new bool[npoints]);
+  std::vector<double> bf_values(nbasis_*npoints);
+  std::vector<double> bf_derivs(nbasis_*npoints);
+  getAllValuesBatch(npoints,&args[0],&argsT[0],inside.get(),&bf_values[0],&bf_derivs[0]);
+  //
+  for(Grid::index_t k=0; k < npoints; k++) {
+    double weight = integration_weights[k] * grid_pntr->getValue(k);
     for(unsigned int i=0; i < nbasis_; i++) {
-      targetdist_integrals[i] += (integration_weights[k] * grid_pntr->getValue(k)) * bf_values[i];
+      targetdist_integrals[i] += weight * bf_values[i*npoints+k];
     }
   }
   // assume that the first function is the constant
-  bool inside=true;
+  bool inside_range=true;
   double argT=0.0;
-  targetdist_integrals[0] = getValue(0.0,0,argT,inside);
+  targetdist_integrals[0] = getValue(0.0,0,argT,inside_range);
   return targetdist_integrals;
 }
 
@@ -338,19 +348,54 @@ void BasisFunctions::getAllValuesNumericalDerivs(const double arg, double& argT,
 }
 
 
+void BasisFunctions::getActiveIndices(const double, std::vector<unsigned int>& active_indices) const {
+  active_indices.resize(nbasis_);
+  for(unsigned int i=0; i<nbasis_; i++) {active_indices[i]=i;}
+}
+
+
+void BasisFunctions::getAllValuesBatch(const size_t nargs, const double* args, double* argsT, bool* inside_range, double* values, double* derivs) const {
+  // generic fallback, basis sets with a recurrence that can be vectorized over the arguments should override this
+  std::vector<double> tmp_values(numberOfBasisFunctions());
+  std::vector<double> tmp_derivs(numberOfBasisFunctions());
+  for(size_t i=0; i<nargs; i++) {
+    bool inside=true;
+    getAllValues(args[i],argsT[i],inside,tmp_values,tmp_derivs);
+    inside_range[i]=inside;
+    for(unsigned int n=0; n<numberOfBasisFunctions(); n++) {
+      values[n*nargs+i] = tmp_values[n];
+      derivs[n*nargs+i] = tmp_derivs[n];
+    }
+  }
+}
+
+
 void BasisFunctions::getMultipleValue(const std::vector<double>& args, std::vector<double>& argsT, std::vector<std::vector<double> >& values, std::vector<std::vector<double> >& derivs, const bool numerical_deriv) const {
   argsT.resize(args.size());
   values.clear();
   derivs.clear();
+  if(args.size()==0) {return;}
+  if(!numerical_deriv) {
+    size_t nargs = args.size();
+    std::unique_ptr<bool[]> inside(new bool[nargs]);
+    std::vector<double> tmp_values(getNumberOfBasisFunctions()*nargs);
+    std::vector<double> tmp_derivs(getNumberOfBasisFunctions()*nargs);
+    getAllValuesBatch(nargs,&args[0],&argsT[0],inside.get(),&tmp_values[0],&tmp_derivs[0]);
+    values.assign(nargs,std::vector<double>(getNumberOfBasisFunctions()));
+    derivs.assign(nargs,std::vector<double>(getNumberOfBasisFunctions()));
+    for(size_t i=0; i<nargs; i++) {
+      for(unsigned int n=0; n<getNumberOfBasisFunctions(); n++) {
+        values[i][n] = tmp_values[n*nargs+i];
+        derivs[i][n] = tmp_derivs[n*nargs+i];
+      }
+    }
+    return;
+  }
   for(unsigned int i=0; i<args.size(); i++) {
     std::vector<double> tmp_values(getNumberOfBasisFunctions());
     std::vector<double> tmp_derivs(getNumberOfBasisFunctions());
     bool inside_interval=true;
-    if(!numerical_deriv) {
-      getAllValues(args[i],argsT[i],inside_interval,tmp_values,tmp_derivs);
-    } else {
-      getAllValuesNumericalDerivs(args[i],argsT[i],inside_interval,tmp_values,tmp_derivs);
-    }
+    getAllValuesNumericalDerivs(args[i],argsT[i],inside_interval,tmp_values,tmp_derivs);
     values.push_back(tmp_values);
     derivs.push_back(tmp_derivs);
   }
@@ -438,11 +483,33 @@ std::vector<std::vector<double> > BasisFunctions::getAllInnerProducts() const {
 
 
 std::vector<std::vector<double> > BasisFunctions::getAllInnerProducts(const Grid* grid_pntr) const {
-
+  plumed_massert(grid_pntr->getDimension()==1,"the grid must be one-dimensional");
+  std::vector<double> integration_weights = GridIntegrationWeights::getIntegrationWeights(grid_pntr);
+  // evaluate all the basis functions on the grid once
+  size_t npoints = grid_pntr->getSize();
+  std::vector<double> args(npoints);
+  for(Grid::index_t k=0; k < npoints; k++) {
+    args[k] = grid_pntr->getPoint(k)[0];
+  }
+  std::vector<double> argsT(npoints);
+  std::unique_ptr<bool[]> inside(new bool[npoints]);
+  std::vector<double> values(numberOfBasisFunctions()*npoints);
+  std::vector<double> derivs(numberOfBasisFunctions()*npoints);
+  getAllValuesBatch(npoints,&args[0],&argsT[0],inside.get(),&values[0],&derivs[0]);
+  for(Grid::index_t k=0; k < npoints; k++) {
+    plumed_massert(inside[k],"the basis functions values must be inside the range of the defined interval!");
+  }
+  //
   std::vector<std::vector<double> > inner_products(numberOfBasisFunctions(), std::vector<double>(numberOfBasisFunctions()));
   for(unsigned int i=0; i<numberOfBasisFunctions(); i++) {
+    const double* values_i = &values[i*npoints];
     for(unsigned int j=i; j<numberOfBasisFunctions(); j++) {
-      inner_products[i][j] = inner_products[j][i] = getInnerProduct(i,j,grid_pntr);
+      const double* values_j = &values[j*npoints];
+      double sum = 0.0;
+      for(Grid::index_t k=0; k < npoints; k++) {
+        sum += integration_weights[k]*values_i[k]*values_j[k];
+      }
+      inner_products[i][j] = inner_products[j][i] = sum;
     }
   }
   return inner_products;
@@ -74,6 +74,8 @@ private:
   bool orthogonal_;
   // if the basis functions are defined on a bounded interval or not
   bool interval_bounded_;
+  // if only a few basis functions are non-zero at any argument, see getActiveIndices()
+  bool compact_support_;
   // the intrinsic interval of the basis functions
   std::string interval_intrinsic_min_str_;
   std::string interval_intrinsic_max_str_;
@@ -122,6 +124,7 @@ protected:
   void setNonOrthogonal() {orthogonal_=false;}
   void setIntervalBounded() {interval_bounded_=true;}
   void setIntervalNonBounded() {interval_bounded_=false;}
+  void setCompactSupport() {compact_support_=true;}
   void setType(const std::string& type_in) {type_=type_in;}
   void setDescription(const std::string& description_in) {description_=description_in;}
   //
@@ -158,6 +161,7 @@ public:
   bool arePeriodic() const {return periodic_;}
   bool areOrthogonal() const {return orthogonal_;}
   bool intervalBounded() const {return interval_bounded_;}
+  bool hasCompactSupport() const {return compact_support_;}
   double intervalMin() const {return interval_min_;}
   double intervalMax() const {return interval_max_;}
   double intervalRange() const {return interval_range_;}
@@ -180,6 +184,7 @@ public:
   Action* getPntrToAction() const;
   //
   double translateArgument(const double, bool&) const;
+  void translateArguments(const size_t, const double*, double*, bool*) const;
   double checkIfArgumentInsideInterval(const double, bool&) const;
   //
   void apply() {};
@@ -188,6 +193,12 @@ public:
   double getValue(const double, const unsigned int, double&, bool&) const;
   // calcuate the values for all basis functions
   virtual void getAllValues(const double, double&, bool&, std::vector<double>&, std::vector<double>&) const = 0;
+  // calculate the values for all basis functions for several arguments at once, the values and derivatives
+  // are stored such that the n-th basis function at the i-th argument is found at index n*nargs+i
+  virtual void getAllValuesBatch(const size_t, const double*, double*, bool*, double*, double*) const;
+  // the indices of the basis functions that can be non-zero at a given translated argument (as given by
+  // getAllValues), all other basis functions are zero there. By default all basis functions are active.
+  virtual void getActiveIndices(const double, std::vector<unsigned int>&) const;
   //virtual void get2ndDerivaties(const double, std::vector<double>&)=0;
   void printInfo() const;
   //
@@ -280,6 +291,19 @@ double BasisFunctions::translateArgument(const double arg, bool& inside_interval
 }
 
 
+inline
+void BasisFunctions::translateArguments(const size_t nargs, const double* args, double* argsT, bool* inside_interval) const {
+  // NOTE: only works for symmetric intrinsic intervals
+  for(size_t i=0; i<nargs; i++) {
+    double argT = (args[i]-interval_mean_)*argT_derivf_;
+    inside_interval[i] = (argT >= interval_intrinsic_min_) && (argT <= interval_intrinsic_max_);
+    if(argT < interval_intrinsic_min_) {argT=interval_intrinsic_min_;}
+    if(argT > interval_intrinsic_max_) {argT=interval_intrinsic_max_;}
+    argsT[i] = argT;
+  }
+}
+
+
 inline
 double BasisFunctions::checkIfArgumentInsideInterval(const double arg, bool& inside_interval) const {
   inside_interval=true;
@@ -0,0 +1,377 @@
+/* +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+   Copyright (c) 2016-2017 The VES code team
+   (see the PEOPLE-VES file at the root of this folder for a list of names)
+
+   See http://www.ves-code.org for more information.
+
+   This file is part of VES code module.
+
+   The VES code module is free software: you can redistribute it and/or modify
+   it under the terms of the GNU Lesser General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   The VES code module is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public License
+   along with the VES code module.  If not, see <http://www.gnu.org/licenses/>.
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+#include "BasisFunctions.h"
+#include "LinearBasisSetExpansion.h"
+#include "CoeffsVector.h"
+#include "VesBias.h"
+#include "Optimizer.h"
+#include "TargetDistribution.h"
+
+#include "cltools/CLTool.h"
+#include "cltools/CLToolRegister.h"
+#include "tools/Random.h"
+#include "tools/Communicator.h"
+#include "tools/File.h"
+#include "core/PlumedMain.h"
+#include "core/ActionSet.h"
+#include "core/Value.h"
+
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <chrono>
+
+
+namespace PLMD {
+namespace ves {
+
+//+PLUMEDOC VES_TOOLS ves_benchmark
+/*
+Benchmark the main parts of a VES simulation without running any dynamics.
+
+This tool measures the time spent in the different parts of a VES simulation
+for a linear basis set expansion, such that their performance can be studied
+and compared between different versions of the code without running a
+full MD simulation. A VES bias (\ref VES_LINEAR_EXPANSION) and an
+optimizer are set up for the basis functions and target distribution given
+in the input. Then for a given number of iterations the following parts are
+timed:
+- bias_and_forces: the bias and forces for a CV sample together with the
+derivatives with respect to the coefficients, done for each sample.
+- sampled_averages: adding the derivatives of a sample to the averages
+needed for the gradient and the Hessian, done for each sample.
+- optimizer_update: the update of the coefficients by the optimizer,
+including the reduction of the averages over the MPI processes,
+done once in each iteration.
+- bias_grid and fes_grid: calculating the bias and the free energy
+surface on a grid from the coefficients, done once in each iteration.
+- targetdist: updating a dynamic target distribution, e.g. \ref TD_WELLTEMPERED,
+done once in each iteration. This is skipped for a static target distribution.
+
+The CV samples are drawn from a uniform distribution within the intervals
+of the basis functions. Output files that the VES bias and the optimizer
+always write, e.g., for a dynamic target distribution, are written to the
+current directory as in a simulation.
+
+The benchmark is repeated for each of the number of OpenMP threads given with the
+threads keyword, which sets the PLUMED_NUM_THREADS environment variable. To study
+the performance for different number of MPI processes the tool can be run with mpirun,
+the work is then divided between the processes in the same way as in a
+simulation. The timings, the maximum over all MPI processes, are written
+to a file with one line for each part and number of threads, such that
+results from different runs or different versions of the code can easily
+be compared.
+
+\par Examples
+
+The following input benchmarks a two-dimensional expansion in Legendre
+polynomials with a well-tempered target distribution using 1, 2 and 4 threads.
+\verbatim
+dimension            2
+basis_functions_1    BF_LEGENDRE ORDER=20 MINIMUM=-3.0 MAXIMUM=3.0
+basis_functions_2    BF_LEGENDRE ORDER=20 MINIMUM=-3.0 MAXIMUM=3.0
+target_distribution  TD_WELLTEMPERED BIASFACTOR=10
+optimizer            OPT_AVERAGED_SGD STEPSIZE=0.1
+grid_bins            100
+nsamples             1000
+iterations           10
+threads              1,2,4
+output               benchmark.data
+\endverbatim
+This input is then run by using the following command.
+\verbatim
+plumed ves_benchmark input
+\endverbatim
+The file benchmark.data then contains for each part the number of calls, the total
+time and the average time for each call in seconds.
+
+*/
+//+ENDPLUMEDOC
+
+class BenchmarkLinearExpansion : public PLMD::CLTool {
+public:
+  std::string description() const {return "benchmark the main parts of a VES simulation for a linear basis set expansion";}
+  static void registerKeywords( Keywords& keys );
+  explicit BenchmarkLinearExpansion( const CLToolOptions& co );
+  int main( FILE* in, FILE* out, PLMD::Communicator& pc);
+};
+
+PLUMED_REGISTER_CLTOOL(BenchmarkLinearExpansion,"ves_benchmark")
+
+void BenchmarkLinearExpansion::registerKeywords( Keywords& keys ) {
+  CLTool::registerKeywords( keys );
+  keys.add("compulsory","dimension","1","Number of dimensions, supports 1 to 3.");
+  keys.add("compulsory","basis_functions_1","Basis functions for dimension 1.");
+  keys.add("optional","basis_functions_2","Basis functions for dimension 2 if needed.");
+  keys.add("optional","basis_functions_3","Basis functions for dimension 3 if needed.");
+  keys.add("compulsory","target_distribution","TD_WELLTEMPERED BIASFACTOR=10","The target distribution, the refresh of the target distribution is only timed if it is dynamic.");
+  keys.add("compulsory","optimizer","OPT_AVERAGED_SGD STEPSIZE=0.1","The optimizer together with its keywords, except for BIAS and STRIDE.");
+  keys.add("compulsory","temperature","1.0","The temperature.");
+  keys.add("compulsory","grid_bins","100","The number of grid bins used for the bias, free energy surface and target distribution grids.");
+  keys.add("compulsory","nsamples","1000","The number of CV samples in each iteration.");
+  keys.add("compulsory","iterations","10","The number of iterations.");
+  keys.add("compulsory","threads","1","The number of OpenMP threads, give several values to repeat the benchmark for each of them.");
+  keys.add("compulsory","random_seed","5293818","Value of random number seed.");
+  keys.add("compulsory","output","benchmark.data","Filename of the file with the timings.");
+  keys.add("compulsory","output_fmt","%14.6e","Format of the timings in the output file.");
+  keys.add("compulsory","plumed_log","/dev/null","Filename of the PLUMED log file for the VES bias and the optimizer.");
+}
+
+
+BenchmarkLinearExpansion::BenchmarkLinearExpansion( const CLToolOptions& co ):
+  CLTool(co)
+{
+  inputdata=ifile;
+}
+
+
+int BenchmarkLinearExpansion::main( FILE* /*in*/, FILE* out, PLMD::Communicator& pc) {
+  unsigned int dim;
+  parse("dimension",dim);
+  if(dim<1 || dim>3) {
+    error("the dimension should be 1, 2 or 3");
+  }
+  std::vector<std::string> basisf_keywords(dim);
+  for(unsigned int i=0; i<dim; i++) {
+    std::string is; Tools::convert(i+1,is);
+    parse("basis_functions_"+is,basisf_keywords[i]);
+    if(basisf_keywords[i].size()==0) {
+      error("basis_functions_"+is+" is needed");
+    }
+    if(basisf_keywords[i].at(0)=='{' && basisf_keywords[i].at(basisf_keywords[i].size()-1)=='}') {
+      basisf_keywords[i] = basisf_keywords[i].substr(1,basisf_keywords[i].size()-2);
+    }
+  }
+  std::string targetdist_keyword;
+  parse("target_distribution",targetdist_keyword);
+  std::string optimizer_keyword;
+  parse("optimizer",optimizer_keyword);
+  double temp;
+  parse("temperature",temp);
+  unsigned int grid_bins;
+  parse("grid_bins",grid_bins);
+  unsigned int nsamples;
+  parse("nsamples",nsamples);
+  unsigned int niterations;
+  parse("iterations",niterations);
+  std::vector<unsigned int> nthreads_vec;
+  parseVector("threads",nthreads_vec);
+  int seed;
+  parse("random_seed",seed);
+  if(seed>0) {seed = -seed;}
+  std::string output_fname;
+  parse("output",output_fname);
+  std::string output_fmt;
+  parse("output_fmt",output_fmt);
+  std::string plumed_logfile;
+  parse("plumed_log",plumed_logfile);
+
+  // the VES bias and the optimizer are set up as in a simulation, with constant
+  // values as arguments as the benchmark calls the different parts directly
+  PLMD::PlumedMain* plumed = new PLMD::PlumedMain;
+  if(Communicator::initialized()) {plumed->cmd("setMPIComm",&pc.Get_comm());}
+  unsigned int natoms=1;
+  plumed->cmd("setNatoms",&natoms);
+  plumed->cmd("setMDEngine","ves_benchmark");
+  plumed->cmd("setLogFile",plumed_logfile.c_str());
+  plumed->cmd("setKbT",&temp);
+  plumed->cmd("init");
+  std::string bf_labels;
+  std::string arg_labels;
+  std::vector<BasisFunctions*> basisf_pntrs(dim);
+  std::vector<Value*> args(dim);
+  std::vector<double> interval_min(dim);
+  std::vector<double> interval_range(dim);
+  for(unsigned int i=0; i<dim; i++) {
+    std::string is; Tools::convert(i+1,is);
+    plumed->readInputLine(basisf_keywords[i]+" LABEL=bf"+is);
+    plumed->readInputLine("arg"+is+": CONSTANT VALUE=0.0");
+    bf_labels += (i>0 ? ",bf" : "bf") + is;
+    arg_labels += (i>0 ? ",arg" : "arg") + is;
+    basisf_pntrs[i] = plumed->getActionSet().selectWithLabel<BasisFunctions*>("bf"+is);
+    args[i] = new Value(NULL,"arg"+is,false);
+    args[i]->setNotPeriodic();
+    interval_min[i] = basisf_pntrs[i]->intervalMin();
+    interval_range[i] = basisf_pntrs[i]->intervalMax()-basisf_pntrs[i]->intervalMin();
+  }
+  plumed->readInputLine(targetdist_keyword+" LABEL=td");
+  // a separate target distribution for the expansion used for the benchmark
+  plumed->readInputLine(targetdist_keyword+" LABEL=td_benchmark");
+  std::string temp_str; Tools::convert(temp,temp_str);
+  std::string grid_bins_str; Tools::convert(grid_bins,grid_bins_str);
+  plumed->readInputLine("VES_LINEAR_EXPANSION ARG="+arg_labels+" BASIS_FUNCTIONS="+bf_labels+" TEMP="+temp_str+" GRID_BINS="+grid_bins_str+" TARGET_DISTRIBUTION=td LABEL=ves");
+  TargetDistribution* targetdist_pntr = plumed->getActionSet().selectWithLabel<TargetDistribution*>("td_benchmark");
+  plumed_assert(targetdist_pntr!=NULL);
+  bool dynamic_targetdist = targetdist_pntr->isDynamic();
+  // a dynamic target distribution is not updated by the optimizer as it is timed separately
+  std::string targetdist_stride = dynamic_targetdist ? " TARGETDIST_STRIDE=1000000000" : "";
+  plumed->readInputLine(optimizer_keyword+" BIAS=ves STRIDE=1 COEFFS_OUTPUT=OFF"+targetdist_stride+" LABEL=opt");
+  VesBias* bias_pntr = plumed->getActionSet().selectWithLabel<VesBias*>("ves");
+  Optimizer* optimizer_pntr = plumed->getActionSet().selectWithLabel<Optimizer*>("opt");
+  plumed_assert(bias_pntr!=NULL && optimizer_pntr!=NULL);
+
+  // the expansion shares the coefficients with the VES bias and is set up in the same way
+  LinearBasisSetExpansion* expansion_pntr = new LinearBasisSetExpansion("benchmark",1.0/temp,pc,args,basisf_pntrs,bias_pntr->getCoeffsPntr());
+  expansion_pntr->linkVesBias(bias_pntr);
+  expansion_pntr->setGridBins(grid_bins);
+  expansion_pntr->setupBiasGrid(true);
+  expansion_pntr->setupFesGrid();
+  targetdist_pntr->linkVesBias(bias_pntr);
+  expansion_pntr->setupTargetDistribution(targetdist_pntr);
+  size_t ncoeffs = expansion_pntr->getNumberOfCoeffs();
+  bool compact = expansion_pntr->compactSupport();
+
+  // the same samples on all MPI processes, as in a simulation where the CVs are the same on all processes
+  Random rnd;
+  rnd.setSeed(seed);
+  std::vector<double> samples(dim*nsamples);
+  for(unsigned int s=0; s<nsamples; s++) {
+    for(unsigned int k=0; k<dim; k++) {
+      samples[dim*s+k] = interval_min[k]+rnd.RandU01()*interval_range[k];
+    }
+  }
+
+  enum {bias_and_forces=0, sampled_averages, optimizer_update, bias_grid, fes_grid, targetdist, nstages};
+  const char* stage_names[nstages] = {"bias_and_forces","sampled_averages","optimizer_update","bias_grid","fes_grid","targetdist"};
+
+  OFile ofile;
+  ofile.link(pc);
+  ofile.open(output_fname);
+  if(pc.Get_rank()==0) {
+    fprintf(out,"VES benchmark with %u dimensions and %zu coefficients on %d MPI processes\n",dim,ncoeffs,pc.Get_size());
+    for(unsigned int i=0; i<dim; i++) {
+      fprintf(out,"  basis functions %u: %s\n",i+1,basisf_keywords[i].c_str());
+    }
+    fprintf(out,"  target distribution: %s\n",targetdist_keyword.c_str());
+    fprintf(out,"  optimizer: %s\n",optimizer_keyword.c_str());
+    fprintf(out,"  %u iterations with %u samples each\n",niterations,nsamples);
+  }
+
+  std::vector<double> args_values(dim);
+  std::vector<double> forces(dim);
+  std::vector<double> coeffsderivs_values(ncoeffs);
+  std::vector<double> active_coeffsderivs_values;
+  std::vector<size_t> active_coeffs_indices;
+  // the first update of the optimizer is skipped as in a simulation
+  optimizer_pntr->update();
+  for(unsigned int t=0; t<nthreads_vec.size(); t++) {
+    std::string nthreads_str; Tools::convert(nthreads_vec[t],nthreads_str);
+    setenv("PLUMED_NUM_THREADS",nthreads_str.c_str(),1);
+    std::vector<double> times(nstages,0.0);
+    std::vector<int> ncalls(nstages,0);
+    std::chrono::high_resolution_clock::time_point t0, t1;
+    for(unsigned int iter=0; iter<niterations; iter++) {
+      for(unsigned int s=0; s<nsamples; s++) {
+        std::copy(samples.begin()+dim*s,samples.begin()+dim*(s+1),args_values.begin());
+        bool all_inside = true;
+        t0 = std::chrono::high_resolution_clock::now();
+        if(compact) {
+          expansion_pntr->getBiasAndForcesCompact(args_values,all_inside,forces,active_coeffsderivs_values,active_coeffs_indices);
+        }
+        else {
+          expansion_pntr->getBiasAndForces(args_values,all_inside,forces,coeffsderivs_values);
+        }
+        t1 = std::chrono::high_resolution_clock::now();
+        times[bias_and_forces] += std::chrono::duration<double>(t1-t0).count();
+        ncalls[bias_and_forces]++;
+        //
+        t0 = std::chrono::high_resolution_clock::now();
+        if(compact) {
+          bias_pntr->addToSampledAverages(active_coeffsderivs_values,active_coeffs_indices);
+        }
+        else {
+          bias_pntr->addToSampledAverages(coeffsderivs_values);
+        }
+        t1 = std::chrono::high_resolution_clock::now();
+        times[sampled_averages] += std::chrono::duration<double>(t1-t0).count();
+        ncalls[sampled_averages]++;
+      }
+      //
+      t0 = std::chrono::high_resolution_clock::now();
+      optimizer_pntr->update();
+      t1 = std::chrono::high_resolution_clock::now();
+      times[optimizer_update] += std::chrono::duration<double>(t1-t0).count();
+      ncalls[optimizer_update]++;
+      // the grids are only updated once for each step, so this is reset to force the update
+      expansion_pntr->resetStepOfLastBiasGridUpdate();
+      expansion_pntr->resetStepOfLastFesGridUpdate();
+      t0 = std::chrono::high_resolution_clock::now();
+      expansion_pntr->updateBiasGrid();
+      t1 = std::chrono::high_resolution_clock::now();
+      times[bias_grid] += std::chrono::duration<double>(t1-t0).count();
+      ncalls[bias_grid]++;
+      // the bias grid is already updated so this only includes the FES
+      t0 = std::chrono::high_resolution_clock::now();
+      expansion_pntr->updateFesGrid();
+      t1 = std::chrono::high_resolution_clock::now();
+      times[fes_grid] += std::chrono::duration<double>(t1-t0).count();
+      ncalls[fes_grid]++;
+      if(dynamic_targetdist) {
+        t0 = std::chrono::high_resolution_clock::now();
+        expansion_pntr->updateTargetDistribution();
+        t1 = std::chrono::high_resolution_clock::now();
+        times[targetdist] += std::chrono::duration<double>(t1-t0).count();
+        ncalls[targetdist]++;
+      }
+    }
+    // the slowest MPI process determines the time
+    if(pc.Get_size()>1) {
+      std::vector<double> all_times(pc.Get_size()*nstages);
+      pc.Allgather(times,all_times);
+      for(int r=1; r<pc.Get_size(); r++) {
+        for(unsigned int k=0; k<nstages; k++) {
+          if(all_times[r*nstages+k]>times[k]) {times[k]=all_times[r*nstages+k];}
+        }
+      }
+    }
+    for(unsigned int k=0; k<nstages; k++) {
+      if(ncalls[k]==0) {continue;}
+      double time_per_call = times[k]/ncalls[k];
+      ofile.printField("stage",stage_names[k]);
+      ofile.printField("ndimensions",static_cast<int>(dim));
+      ofile.printField("ncoeffs",static_cast<int>(ncoeffs));
+      ofile.printField("nranks",pc.Get_size());
+      ofile.printField("nthreads",static_cast<int>(nthreads_vec[t]));
+      ofile.printField("ncalls",ncalls[k]);
+      ofile.fmtField(" "+output_fmt);
+      ofile.printField("time_total",times[k]);
+      ofile.printField("time_per_call",time_per_call);
+      ofile.fmtField();
+      ofile.printField();
+      if(pc.Get_rank()==0) {
+        fprintf(out,"  %-18s threads %3u  calls %8d  total %12.6f s  per call %12.6e s\n",stage_names[k],nthreads_vec[t],ncalls[k],times[k],time_per_call);
+      }
+    }
+  }
+  ofile.close();
+
+  delete expansion_pntr;
+  for(unsigned int i=0; i<args.size(); i++) {delete args[i];}
+  delete plumed;
+  return 0;
+}
+
+
+}
+}
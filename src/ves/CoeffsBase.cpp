@@ -31,6 +31,7 @@
 
 #include <vector>
 #include <string>
+#include <sstream>
 
 
 namespace PLMD {
@@ -314,6 +315,22 @@ void CoeffsBase::setType(const CoeffsType coeffs_type) {
 }
 
 
+void CoeffsBase::setType(const std::string& type_str) {
+  if(type_str=="Generic") {
+    coeffs_type_ = Generic;
+  }
+  else if(type_str=="LinearBasisSet") {
+    coeffs_type_ = LinearBasisSet;
+  }
+  else if(type_str=="MultiCoeffs_LinearBasisSet") {
+    coeffs_type_ = MultiCoeffs_LinearBasisSet;
+  }
+  else {
+    plumed_merror("unknown coeffs type "+type_str);
+  }
+}
+
+
 void CoeffsBase::linkVesBias(VesBias* vesbias_pntr_in) {
   vesbias_pntr_ = vesbias_pntr_in;
   action_pntr_ = static_cast<Action*>(vesbias_pntr_in);
@@ -443,6 +460,42 @@ void CoeffsBase::getCoeffsInfoFromFile(IFile& ifile, const bool ignore_coeffs_in
 }
 
 
+void CoeffsBase::writeCoeffsInfoToBinaryHeader(CoeffsBinaryFile::Header& header) const {
+  header.push_back(std::make_pair(field_type_,getTypeStr()));
+  std::string str_tmp;
+  Tools::convert(numberOfDimensions(),str_tmp);
+  header.push_back(std::make_pair(field_ndimensions_,str_tmp));
+  Tools::convert(numberOfCoeffs(),str_tmp);
+  header.push_back(std::make_pair(field_ncoeffs_total_,str_tmp));
+  // the labels of the dimensions are needed to reconstruct the text format
+  std::string dim_labels = "";
+  for(unsigned int k=0; k<numberOfDimensions(); k++) {
+    if(k>0) {dim_labels += " ";}
+    dim_labels += getDimensionLabel(k);
+    Tools::convert(shapeOfIndices(k),str_tmp);
+    header.push_back(std::make_pair(field_shape_prefix_+getDimensionLabel(k),str_tmp));
+  }
+  header.push_back(std::make_pair("dimension_labels",dim_labels));
+}
+
+
+void CoeffsBase::getCoeffsInfoFromBinaryFile(const CoeffsBinaryFile& bfile, const size_t irecord, const bool ignore_coeffs_info) {
+  if(ignore_coeffs_info) {return;}
+  std::string coeffs_type_f = bfile.getHeaderField(irecord,field_type_);
+  unsigned int ndimensions_f = 0;
+  Tools::convert(bfile.getHeaderField(irecord,field_ndimensions_),ndimensions_f);
+  long int long_tmp = 0;
+  Tools::convert(bfile.getHeaderField(irecord,field_ncoeffs_total_),long_tmp);
+  size_t ncoeffs_total_f = static_cast<size_t>(long_tmp);
+  std::vector<unsigned int> indices_shape_f(numberOfDimensions());
+  for(unsigned int k=0; k<numberOfDimensions(); k++) {
+    Tools::convert(bfile.getHeaderField(irecord,field_shape_prefix_+getDimensionLabel(k)),indices_shape_f[k]);
+  }
+  std::string msg_header="Error when reading in coeffs from file " + bfile.getPath() + ": ";
+  checkCoeffsInfo(msg_header, coeffs_type_f, ndimensions_f, ncoeffs_total_f, indices_shape_f);
+}
+
+
 void CoeffsBase::checkCoeffsInfo(const std::string& msg_header, const std::string& coeffs_type_f, const unsigned int ndimensions_f, const size_t ncoeffs_total_f, const std::vector<unsigned int>& indices_shape_f) {
 
   if(coeffs_type_f != getTypeStr()) {
@@ -482,6 +535,34 @@ void CoeffsBase::writeIterationCounterAndTimeToFile(OFile& ofile) const {
 }
 
 
+void CoeffsBase::writeIterationCounterAndTimeToBinaryHeader(CoeffsBinaryFile::Header& header) const {
+  std::string str_tmp;
+  if(time_md>=0.0) {
+    // full precision such that the text format can be reproduced exactly
+    std::ostringstream time_stream;
+    time_stream.precision(17);
+    time_stream << time_md;
+    header.push_back(std::make_pair(field_time_,time_stream.str()));
+  }
+  Tools::convert(iteration_opt,str_tmp);
+  header.push_back(std::make_pair(field_iteration_,str_tmp));
+}
+
+
+bool CoeffsBase::getIterationCounterAndTimeFromBinaryFile(const CoeffsBinaryFile& bfile, const size_t irecord) {
+  bool field_found=false;
+  if(bfile.headerFieldExists(irecord,field_time_)) {
+    field_found=true;
+    Tools::convert(bfile.getHeaderField(irecord,field_time_),time_md);
+  }
+  if(bfile.headerFieldExists(irecord,field_iteration_)) {
+    field_found=true;
+    Tools::convert(bfile.getHeaderField(irecord,field_iteration_),iteration_opt);
+  }
+  return field_found;
+}
+
+
 bool CoeffsBase::getIterationCounterAndTimeFromFile(IFile& ifile) {
   bool field_found=false;
   if(ifile.FieldExist(field_time_)) {
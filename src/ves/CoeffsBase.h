@@ -22,6 +22,8 @@
 #ifndef __PLUMED_ves_CoeffsBase_h
 #define __PLUMED_ves_CoeffsBase_h
 
+#include "CoeffsBinaryFile.h"
+
 #include <vector>
 #include <string>
 
@@ -122,6 +124,7 @@ public:
   CoeffsType getType() const {return coeffs_type_;}
   std::string getTypeStr() const;
   void setType(const CoeffsType coeffs_type);
+  void setType(const std::string&);
   void linkVesBias(VesBias*);
   void linkAction(Action*);
   VesBias* getPntrToVesBias() const {return vesbias_pntr_;}
@@ -141,6 +144,7 @@ public:
   //
   size_t getIndex(const std::vector<unsigned int>&) const;
   std::vector<unsigned int> getIndices(const size_t) const;
+  void getIndices(const size_t, std::vector<unsigned int>&) const;
   bool indicesExist(const std::vector<unsigned int>&) const;
   //
   std::string getCoeffDescription(const size_t index) const {return coeffs_descriptions_[index];}
@@ -160,6 +164,8 @@ public:
   void writeTimeInfoToFile(OFile&, const double) const;
   void getCoeffsInfoFromFile(IFile&, const bool ignore_coeffs_info=false);
   void checkCoeffsInfo(const std::string&, const std::string&, const unsigned int, const size_t, const std::vector<unsigned int>&);
+  void writeCoeffsInfoToBinaryHeader(CoeffsBinaryFile::Header&) const;
+  void getCoeffsInfoFromBinaryFile(const CoeffsBinaryFile&, const size_t, const bool ignore_coeffs_info=false);
   //
   void turnOnIterationCounter() {iteration_and_time_active_=true;}
   void turnOffIterationCounter() {iteration_and_time_active_=false;}
@@ -182,6 +188,8 @@ protected:
   //
   void writeIterationCounterAndTimeToFile(OFile&) const;
   bool getIterationCounterAndTimeFromFile(IFile&);
+  void writeIterationCounterAndTimeToBinaryHeader(CoeffsBinaryFile::Header&) const;
+  bool getIterationCounterAndTimeFromBinaryFile(const CoeffsBinaryFile&, const size_t);
   //
 
 };
@@ -249,6 +257,20 @@ std::vector<unsigned int> CoeffsBase::getIndices(const size_t index) const {
   return indices;
 }
 
+// same as above but writes into an existing vector of size ndimensions_
+inline
+void CoeffsBase::getIndices(const size_t index, std::vector<unsigned int>& indices) const {
+  size_t kk=index;
+  indices[0]=(index%indices_shape_[0]);
+  for(unsigned int i=1; i<ndimensions_-1; ++i) {
+    kk=(kk-indices[i-1])/indices_shape_[i-1];
+    indices[i]=(kk%indices_shape_[i]);
+  }
+  if(ndimensions_>=2) {
+    indices[ndimensions_-1]=((kk-indices[ndimensions_-2])/indices_shape_[ndimensions_-2]);
+  }
+}
+
 
 
 
@@ -0,0 +1,189 @@
+/* +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+   Copyright (c) 2016-2017 The VES code team
+   (see the PEOPLE-VES file at the root of this folder for a list of names)
+
+   See http://www.ves-code.org for more information.
+
+   This file is part of VES code module.
+
+   The VES code module is free software: you can redistribute it and/or modify
+   it under the terms of the GNU Lesser General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   The VES code module is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public License
+   along with the VES code module.  If not, see <http://www.gnu.org/licenses/>.
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+#include "CoeffsBinaryFile.h"
+
+#include "tools/Exception.h"
+#include "tools/OFile.h"
+#include "tools/Tools.h"
+
+#include <cstring>
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+
+namespace PLMD {
+namespace ves {
+
+
+const std::string CoeffsBinaryFile::magic_ = "PLMDVESB";
+
+
+std::string CoeffsBinaryFile::getByteOrder() {
+  const uint32_t one = 1;
+  unsigned char first_byte;
+  std::memcpy(&first_byte,&one,1);
+  if(first_byte==1) {return "little";}
+  else {return "big";}
+}
+
+
+CoeffsBinaryFile::CoeffsBinaryFile(const std::string& path):
+  path_(path),
+  data_pntr_(NULL),
+  data_size_(0),
+  mapped_(false),
+  buffer_(0),
+  headers_(0),
+  values_(0),
+  nvalues_(0)
+{
+  int fd = open(path_.c_str(),O_RDONLY);
+  if(fd<0) {plumed_merror("cannot open binary file "+path_);}
+  struct stat file_stat;
+  if(fstat(fd,&file_stat)!=0) {
+    close(fd);
+    plumed_merror("cannot get the size of binary file "+path_);
+  }
+  data_size_ = static_cast<size_t>(file_stat.st_size);
+  if(data_size_>0) {
+    void* map_pntr = mmap(NULL,data_size_,PROT_READ,MAP_PRIVATE,fd,0);
+    if(map_pntr!=MAP_FAILED) {
+      data_pntr_ = static_cast<const char*>(map_pntr);
+      mapped_ = true;
+    }
+    else {
+      // memory-mapping is not available, read the whole file instead
+      buffer_.resize(data_size_);
+      std::ifstream ifs(path_.c_str(),std::ios::binary);
+      ifs.read(buffer_.data(),data_size_);
+      if(!ifs) {
+        close(fd);
+        plumed_merror("problem reading binary file "+path_);
+      }
+      data_pntr_ = buffer_.data();
+    }
+  }
+  close(fd);
+  indexRecords();
+}
+
+
+CoeffsBinaryFile::~CoeffsBinaryFile() {
+  if(mapped_) {
+    munmap(const_cast<char*>(data_pntr_),data_size_);
+  }
+}
+
+
+void CoeffsBinaryFile::indexRecords() {
+  const size_t prefix_size = magic_.size()+2*sizeof(uint64_t);
+  size_t offset = 0;
+  while(offset+prefix_size<=data_size_) {
+    const char* record = data_pntr_+offset;
+    if(std::memcmp(record,magic_.c_str(),magic_.size())!=0) {
+      std::string rs; Tools::convert(headers_.size(),rs);
+      plumed_merror("file "+path_+" is not a binary coefficient file or record "+rs+" is corrupted");
+    }
+    uint64_t header_size;
+    uint64_t nvalues;
+    std::memcpy(&header_size,record+magic_.size(),sizeof(uint64_t));
+    std::memcpy(&nvalues,record+magic_.size()+sizeof(uint64_t),sizeof(uint64_t));
+    const size_t record_size = prefix_size+header_size+nvalues*sizeof(double);
+    // a record that was not completely written, e.g. due to a crash,
+    // is ignored such that one can restart from the last complete record
+    if(offset+record_size>data_size_) {break;}
+    //
+    std::map<std::string,std::string> header;
+    std::string header_str(record+prefix_size,header_size);
+    header_str = header_str.substr(0,header_str.find('\0'));
+    std::istringstream header_stream(header_str);
+    std::string line;
+    while(std::getline(header_stream,line)) {
+      size_t pos = line.find(' ');
+      if(pos==std::string::npos) {header[line]="";}
+      else {header[line.substr(0,pos)]=line.substr(pos+1);}
+    }
+    if(header["byte_order"]!=getByteOrder()) {
+      plumed_merror("binary file "+path_+" was written on a machine with a different byte order ("+header["byte_order"]+")");
+    }
+    headers_.push_back(header);
+    values_.push_back(reinterpret_cast<const double*>(record+prefix_size+header_size));
+    nvalues_.push_back(nvalues);
+    offset += record_size;
+  }
+}
+
+
+bool CoeffsBinaryFile::headerFieldExists(const size_t irecord, const std::string& key) const {
+  return headers_[irecord].find(key)!=headers_[irecord].end();
+}
+
+
+std::string CoeffsBinaryFile::getHeaderField(const size_t irecord, const std::string& key) const {
+  std::map<std::string,std::string>::const_iterator it = headers_[irecord].find(key);
+  if(it==headers_[irecord].end()) {
+    plumed_merror("cannot find field "+key+" in the header of binary file "+path_);
+  }
+  return it->second;
+}
+
+
+void CoeffsBinaryFile::writeRecord(OFile& ofile, const Header& header, const std::vector<const double*>& values, const size_t nvalues_per_set) {
+  std::string header_str = "byte_order "+getByteOrder()+"\n";
+  for(unsigned int i=0; i<header.size(); i++) {
+    header_str += header[i].first+" "+header[i].second+"\n";
+  }
+  // pad with zeros to a multiple of 8 bytes
+  header_str.resize(8*((header_str.size()+7)/8),'\0');
+  //
+  const uint64_t header_size = header_str.size();
+  const uint64_t nvalues = values.size()*nvalues_per_set;
+  std::vector<char> prefix(magic_.size()+2*sizeof(uint64_t));
+  std::memcpy(prefix.data(),magic_.c_str(),magic_.size());
+  std::memcpy(prefix.data()+magic_.size(),&header_size,sizeof(uint64_t));
+  std::memcpy(prefix.data()+magic_.size()+sizeof(uint64_t),&nvalues,sizeof(uint64_t));
+  ofile.writeBytes(prefix.data(),prefix.size());
+  ofile.writeBytes(header_str.data(),header_str.size());
+  for(unsigned int k=0; k<values.size(); k++) {
+    ofile.writeBytes(reinterpret_cast<const char*>(values[k]),nvalues_per_set*sizeof(double));
+  }
+}
+
+
+bool CoeffsBinaryFile::isBinaryFile(const std::string& path) {
+  std::ifstream ifs(path.c_str(),std::ios::binary);
+  if(!ifs) {return false;}
+  std::string start(magic_.size(),'\0');
+  ifs.read(&start[0],start.size());
+  return ifs && start==magic_;
+}
+
+
+}
+}
@@ -0,0 +1,98 @@
+/* +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+   Copyright (c) 2016-2017 The VES code team
+   (see the PEOPLE-VES file at the root of this folder for a list of names)
+
+   See http://www.ves-code.org for more information.
+
+   This file is part of VES code module.
+
+   The VES code module is free software: you can redistribute it and/or modify
+   it under the terms of the GNU Lesser General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   The VES code module is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public License
+   along with the VES code module.  If not, see <http://www.gnu.org/licenses/>.
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+#ifndef __PLUMED_ves_CoeffsBinaryFile_h
+#define __PLUMED_ves_CoeffsBinaryFile_h
+
+#include <vector>
+#include <string>
+#include <map>
+#include <utility>
+#include <cstddef>
+
+
+namespace PLMD {
+
+
+class OFile;
+
+
+namespace ves {
+
+/*
+Binary file with records of coefficient data, e.g. coefficients,
+gradients or Hessians, one record for each time the data is written out.
+Each record has the following layout:
+
+  8 bytes   the string "PLMDVESB"
+  8 bytes   length of the header in bytes (unsigned 64 bit integer)
+  8 bytes   number of values (unsigned 64 bit integer)
+  header    text with one "key value" pair per line, padded with zeros
+  values    the values as doubles
+
+All parts have a length that is a multiple of 8 bytes such that the values are
+properly aligned when the file is memory-mapped, so they can be used directly
+without any parsing. The header describes the data (type, shape, labels,
+iteration counter and time) and also contains the byte order of the machine
+that wrote the file, which is checked when reading.
+*/
+
+class CoeffsBinaryFile {
+public:
+  typedef std::vector<std::pair<std::string,std::string> > Header;
+private:
+  std::string path_;
+  const char* data_pntr_;
+  size_t data_size_;
+  bool mapped_;
+  std::vector<char> buffer_;
+  std::vector<std::map<std::string,std::string> > headers_;
+  std::vector<const double*> values_;
+  std::vector<size_t> nvalues_;
+  //
+  static const std::string magic_;
+  static std::string getByteOrder();
+  void indexRecords();
+  CoeffsBinaryFile(const CoeffsBinaryFile&);
+  CoeffsBinaryFile& operator=(const CoeffsBinaryFile&);
+public:
+  // maps the file read-only into memory and indexes the records
+  explicit CoeffsBinaryFile(const std::string&);
+  ~CoeffsBinaryFile();
+  // append one record with the given sets of values, each of the same size, to the file
+  static void writeRecord(OFile&, const Header&, const std::vector<const double*>&, const size_t);
+  // check if a file starts with a binary record
+  static bool isBinaryFile(const std::string&);
+  //
+  std::string getPath() const {return path_;}
+  size_t numberOfRecords() const {return headers_.size();}
+  const std::map<std::string,std::string>& getHeader(const size_t irecord) const {return headers_[irecord];}
+  bool headerFieldExists(const size_t, const std::string&) const;
+  std::string getHeaderField(const size_t, const std::string&) const;
+  size_t numberOfValues(const size_t irecord) const {return nvalues_[irecord];}
+  const double* getValues(const size_t irecord) const {return values_[irecord];}
+};
+
+
+}
+}
+
+#endif
@@ -37,6 +37,7 @@
 #include <sstream>
 #include <cstdio>
 #include <cfloat>
+#include <algorithm>
 
 
 namespace PLMD {
@@ -55,6 +56,37 @@ CoeffsMatrix::CoeffsMatrix(
   nrows_(0),
   ncolumns_(0),
   diagonal_(diagonal),
+  bandwidth_(0),
+  row_offsets_(0),
+  column_indices_(0),
+  band_indices_(0),
+  diff_buffer_(0),
+  averaging_counter(0),
+  averaging_exp_decay_(0),
+  mycomm(cc)
+{
+  setupMatrix();
+}
+
+
+CoeffsMatrix::CoeffsMatrix(
+  const std::string& label,
+  const std::vector<std::string>& dimension_labels,
+  const std::vector<unsigned int>& indices_shape,
+  Communicator& cc,
+  const std::vector<unsigned int>& bandwidth,
+  const bool use_iteration_counter):
+  CoeffsBase(label,dimension_labels,indices_shape,use_iteration_counter),
+  data(0),
+  size_(0),
+  nrows_(0),
+  ncolumns_(0),
+  diagonal_(false),
+  bandwidth_(bandwidth),
+  row_offsets_(0),
+  column_indices_(0),
+  band_indices_(0),
+  diff_buffer_(0),
   averaging_counter(0),
   averaging_exp_decay_(0),
   mycomm(cc)
@@ -76,6 +108,11 @@ CoeffsMatrix::CoeffsMatrix(
   nrows_(0),
   ncolumns_(0),
   diagonal_(diagonal),
+  bandwidth_(0),
+  row_offsets_(0),
+  column_indices_(0),
+  band_indices_(0),
+  diff_buffer_(0),
   averaging_counter(0),
   averaging_exp_decay_(0),
   mycomm(cc)
@@ -98,6 +135,11 @@ CoeffsMatrix::CoeffsMatrix(
   nrows_(0),
   ncolumns_(0),
   diagonal_(diagonal),
+  bandwidth_(0),
+  row_offsets_(0),
+  column_indices_(0),
+  band_indices_(0),
+  diff_buffer_(0),
   averaging_counter(0),
   averaging_exp_decay_(0),
   mycomm(cc)
@@ -117,6 +159,36 @@ CoeffsMatrix::CoeffsMatrix(
   nrows_(0),
   ncolumns_(0),
   diagonal_(diagonal),
+  bandwidth_(0),
+  row_offsets_(0),
+  column_indices_(0),
+  band_indices_(0),
+  diff_buffer_(0),
+  averaging_counter(0),
+  averaging_exp_decay_(0),
+  mycomm(cc)
+{
+  setLabels(label);
+  setupMatrix();
+}
+
+
+CoeffsMatrix::CoeffsMatrix(
+  const std::string& label,
+  CoeffsVector* coeffsVec,
+  Communicator& cc,
+  const std::vector<unsigned int>& bandwidth):
+  CoeffsBase( *(static_cast<CoeffsBase*>(coeffsVec)) ),
+  data(0),
+  size_(0),
+  nrows_(0),
+  ncolumns_(0),
+  diagonal_(false),
+  bandwidth_(bandwidth),
+  row_offsets_(0),
+  column_indices_(0),
+  band_indices_(0),
+  diff_buffer_(0),
   averaging_counter(0),
   averaging_exp_decay_(0),
   mycomm(cc)
@@ -135,6 +207,11 @@ void CoeffsMatrix::setupMatrix() {
   if(diagonal_) {
     size_=nrows_;
   }
+  else if(isBanded()) {
+    setupBandedStructure();
+    size_=column_indices_.size();
+    diff_buffer_.assign(nrows_,0.0);
+  }
   else {
     size_=(nrows_*nrows_-nrows_)/2+nrows_;
   }
@@ -142,6 +219,42 @@ void CoeffsMatrix::setupMatrix() {
 }
 
 
+void CoeffsMatrix::setupBandedStructure() {
+  plumed_massert(bandwidth_.size()==numberOfDimensions(),"CoeffsMatrix: the bandwidth needs to be given for each dimension");
+  unsigned int ndim = numberOfDimensions();
+  std::vector<unsigned int> shape = shapeOfIndices();
+  row_offsets_.assign(nrows_+1,0);
+  column_indices_.clear();
+  band_indices_.resize(nrows_*ndim);
+  std::vector<unsigned int> lower(ndim);
+  std::vector<unsigned int> upper(ndim);
+  std::vector<unsigned int> indices_j(ndim);
+  for(size_t i=0; i<nrows_; i++) {
+    row_offsets_[i]=column_indices_.size();
+    std::vector<unsigned int> indices_i=getIndices(i);
+    std::copy(indices_i.begin(),indices_i.end(),band_indices_.begin()+i*ndim);
+    for(unsigned int k=0; k<ndim; k++) {
+      lower[k] = indices_i[k]>bandwidth_[k] ? indices_i[k]-bandwidth_[k] : 0;
+      upper[k] = std::min(indices_i[k]+bandwidth_[k],shape[k]-1);
+    }
+    // go through the box of coupled elements with the first dimension running
+    // fastest such that the column indices are increasing
+    indices_j=lower;
+    while(true) {
+      size_t j=getIndex(indices_j);
+      if(j>=i) {column_indices_.push_back(j);}
+      unsigned int k=0;
+      for(; k<ndim; k++) {
+        if(indices_j[k]<upper[k]) {indices_j[k]++; break;}
+        indices_j[k]=lower[k];
+      }
+      if(k==ndim) {break;}
+    }
+  }
+  row_offsets_[nrows_]=column_indices_.size();
+}
+
+
 size_t CoeffsMatrix::getSize() const {
   return size_;
 }
@@ -152,6 +265,61 @@ bool CoeffsMatrix::isDiagonal() const {
 }
 
 
+bool CoeffsMatrix::isStoredElement(const size_t index1, const size_t index2) const {
+  if(diagonal_) {
+    return index1==index2;
+  }
+  else if(isBanded()) {
+    unsigned int ndim = numberOfDimensions();
+    const unsigned int* indices1 = &band_indices_[index1*ndim];
+    const unsigned int* indices2 = &band_indices_[index2*ndim];
+    for(unsigned int k=0; k<ndim; k++) {
+      unsigned int diff = indices1[k]>indices2[k] ? indices1[k]-indices2[k] : indices2[k]-indices1[k];
+      if(diff>bandwidth_[k]) {return false;}
+    }
+  }
+  return true;
+}
+
+
+std::string CoeffsMatrix::getBandwidthString() const {
+  std::string str_bandwidth = "";
+  for(unsigned int k=0; k<bandwidth_.size(); k++) {
+    std::string str_k; Tools::convert(bandwidth_[k],str_k);
+    if(k>0) {str_bandwidth += ",";}
+    str_bandwidth += str_k;
+  }
+  return str_bandwidth;
+}
+
+
+size_t CoeffsMatrix::rowBegin(const size_t index) const {
+  if(isBanded()) {
+    return row_offsets_[index];
+  }
+  return getMatrixIndex(index,index);
+}
+
+
+size_t CoeffsMatrix::rowEnd(const size_t index) const {
+  if(diagonal_) {
+    return index+1;
+  }
+  else if(isBanded()) {
+    return row_offsets_[index+1];
+  }
+  return getMatrixIndex(index,index)+ncolumns_-index;
+}
+
+
+size_t CoeffsMatrix::getColumnIndex(const size_t index, const size_t matrix_idx) const {
+  if(isBanded()) {
+    return column_indices_[matrix_idx];
+  }
+  return index+(matrix_idx-rowBegin(index));
+}
+
+
 bool CoeffsMatrix::sameShape(CoeffsVector& coeffsvector_in) const {
   return CoeffsBase::sameShape( *(static_cast<CoeffsBase*>(&coeffsvector_in)) );
 }
@@ -205,6 +373,16 @@ size_t CoeffsMatrix::getMatrixIndex(const size_t index1, const size_t index2) co
     // plumed_massert(index1==index2,"CoeffsMatrix: you trying to access a off-diagonal element of a diagonal coeffs matrix");
     matrix_idx=index1;
   }
+  else if(isBanded()) {
+    size_t row = std::min(index1,index2);
+    size_t column = std::max(index1,index2);
+    matrix_idx=row_offsets_[row];
+    if(column!=row) {
+      std::vector<size_t>::const_iterator it = std::lower_bound(column_indices_.begin()+row_offsets_[row],column_indices_.begin()+row_offsets_[row+1],column);
+      plumed_massert(it!=column_indices_.begin()+row_offsets_[row+1] && *it==column,"CoeffsMatrix: you are trying to access an element outside the band of a banded coeffs matrix");
+      matrix_idx=it-column_indices_.begin();
+    }
+  }
   else if (index1<=index2) {
     matrix_idx=index2+index1*(nrows_-1)-index1*(index1-1)/2;
   }
@@ -231,6 +409,9 @@ void CoeffsMatrix::setAllValuesToZero() {
 
 
 double CoeffsMatrix::getValue(const size_t index1, const size_t index2) const {
+  if(isBanded() && !isStoredElement(index1,index2)) {
+    return 0.0;
+  }
   return data[getMatrixIndex(index1,index2)];
 }
 
@@ -280,6 +461,18 @@ CoeffsVector operator*(const CoeffsMatrix& coeffs_matrix, const CoeffsVector& co
       new_coeffs_vector(i) = coeffs_matrix(i,i)*coeffs_vector(i);
     }
   }
+  else if(coeffs_matrix.isBanded()) {
+    // each stored element of the upper triangle contributes to both rows
+    for(size_t i=0; i<numcoeffs; i++) {
+      size_t e=coeffs_matrix.rowBegin(i);
+      new_coeffs_vector(i) += coeffs_matrix.data[e]*coeffs_vector(i);
+      for(e++; e<coeffs_matrix.rowEnd(i); e++) {
+        size_t j=coeffs_matrix.column_indices_[e];
+        new_coeffs_vector(i) += coeffs_matrix.data[e]*coeffs_vector(j);
+        new_coeffs_vector(j) += coeffs_matrix.data[e]*coeffs_vector(i);
+      }
+    }
+  }
   else {
     for(size_t i=0; i<numcoeffs; i++) {
       for(size_t j=0; j<numcoeffs; j++) {
@@ -291,6 +484,48 @@ CoeffsVector operator*(const CoeffsMatrix& coeffs_matrix, const CoeffsVector& co
 }
 
 
+void CoeffsMatrix::addProductWithDifference(const CoeffsVector& coeffs_vector1, const CoeffsVector& coeffs_vector2, std::vector<double>& values) {
+  plumed_massert(coeffs_vector1.numberOfCoeffs()==numberOfCoeffs(),"CoeffsMatrix and CoeffsVector are of the wrong size");
+  plumed_massert(coeffs_vector2.numberOfCoeffs()==numberOfCoeffs(),"CoeffsMatrix and CoeffsVector are of the wrong size");
+  plumed_massert(values.size()==numberOfCoeffs(),"CoeffsMatrix and vector of values are of the wrong size");
+  size_t numcoeffs = numberOfCoeffs();
+  if(diagonal_) {
+    for(size_t i=0; i<numcoeffs; i++) {
+      values[i] += data[i]*(coeffs_vector1(i)-coeffs_vector2(i));
+    }
+  }
+  else if(isBanded()) {
+    std::vector<double>& diff = diff_buffer_;
+    for(size_t i=0; i<numcoeffs; i++) {
+      diff[i] = coeffs_vector1(i)-coeffs_vector2(i);
+    }
+    for(size_t i=0; i<numcoeffs; i++) {
+      size_t e=row_offsets_[i];
+      values[i] += data[e]*diff[i];
+      for(e++; e<row_offsets_[i+1]; e++) {
+        size_t j=column_indices_[e];
+        values[i] += data[e]*diff[j];
+        values[j] += data[e]*diff[i];
+      }
+    }
+  }
+  else {
+    for(size_t i=0; i<numcoeffs; i++) {
+      double sum = 0.0;
+      // lower triangle from the column i, then the contiguous upper triangle of row i
+      for(size_t j=0; j<i; j++) {
+        sum += data[getMatrixIndex(j,i)]*(coeffs_vector1(j)-coeffs_vector2(j));
+      }
+      const double* row = &data[getMatrixIndex(i,i)];
+      for(size_t j=i; j<numcoeffs; j++) {
+        sum += row[j-i]*(coeffs_vector1(j)-coeffs_vector2(j));
+      }
+      values[i] += sum;
+    }
+  }
+}
+
+
 void CoeffsMatrix::addToValue(const size_t index1, const size_t index2, const double value) {
   data[getMatrixIndex(index1,index2)]+=value;
 }
@@ -625,6 +860,10 @@ void CoeffsMatrix::writeToFile(const std::string& filepath, const bool append_fi
 void CoeffsMatrix::writeMatrixInfoToFile(OFile& ofile) {
   std::string field_diagonal = "diagonal_matrix";
   ofile.addConstantField(field_diagonal).printField(field_diagonal,isDiagonal());
+  if(isBanded()) {
+    std::string field_bandwidth = "matrix_bandwidth";
+    ofile.addConstantField(field_bandwidth).printField(field_bandwidth,getBandwidthString());
+  }
 }
 
 
@@ -642,6 +881,9 @@ void CoeffsMatrix::writeDataToFile(OFile& ofile) {
   if(diagonal_) {
     writeDataDiagonalToFile(ofile);
   }
+  else if(isBanded()) {
+    writeDataBandedToFile(ofile);
+  }
   else {
     writeDataFullToFile(ofile);
   }
@@ -713,5 +955,83 @@ void CoeffsMatrix::writeDataFullToFile(OFile& ofile) {
 }
 
 
+void CoeffsMatrix::writeDataBandedToFile(OFile& ofile) {
+  //
+  std::string field_index_row = "idx_row";
+  std::string field_index_column = "idx_column";
+  std::string field_coeffs = getDataLabel();
+  //
+  std::string int_fmt = "%8d";
+  std::string str_separate = "#!-------------------";
+  //
+  char* s1 = new char[20];
+  // only the stored elements of the upper triangle
+  for(size_t i=0; i<nrows_; i++) {
+    for(size_t e=row_offsets_[i]; e<row_offsets_[i+1]; e++) {
+      sprintf(s1,int_fmt.c_str(),i);
+      ofile.printField(field_index_row,s1);
+      sprintf(s1,int_fmt.c_str(),column_indices_[e]);
+      ofile.printField(field_index_column,s1);
+      ofile.fmtField(" "+getOutputFmt()).printField(field_coeffs,data[e]);
+      ofile.printField();
+    }
+  }
+  ofile.fmtField();
+  // blank line between iterations to allow proper plotting with gnuplot
+  ofile.printf("%s\n",str_separate.c_str());
+  ofile.printf("\n");
+  ofile.printf("\n");
+  delete [] s1;
+}
+
+
+void CoeffsMatrix::writeToBinaryFile(OFile& ofile) {
+  CoeffsBinaryFile::Header header;
+  header.push_back(std::make_pair("object","CoeffsMatrix"));
+  header.push_back(std::make_pair("label",getLabel()));
+  if(isIterationCounterActive()) {
+    writeIterationCounterAndTimeToBinaryHeader(header);
+  }
+  writeCoeffsInfoToBinaryHeader(header);
+  header.push_back(std::make_pair("data_labels",getDataLabel()));
+  header.push_back(std::make_pair("diagonal_matrix",diagonal_ ? "true" : "false"));
+  if(isBanded()) {
+    header.push_back(std::make_pair("bandwidth",getBandwidthString()));
+  }
+  // only the unique elements as stored internally, i.e. the upper triangle for a full symmetric matrix
+  // or the stored elements of the upper triangle row by row for a banded matrix
+  std::vector<const double*> values(1,data.data());
+  CoeffsBinaryFile::writeRecord(ofile,header,values,data.size());
+}
+
+
+void CoeffsMatrix::readFromBinaryFile(const std::string& filepath) {
+  CoeffsBinaryFile bfile(filepath);
+  if(bfile.numberOfRecords()==0) {
+    plumed_merror("no complete record found in binary file "+filepath);
+  }
+  readFromBinaryFile(bfile,bfile.numberOfRecords()-1);
+}
+
+
+void CoeffsMatrix::readFromBinaryFile(const CoeffsBinaryFile& bfile, const size_t irecord) {
+  if(isIterationCounterActive()) {
+    getIterationCounterAndTimeFromBinaryFile(bfile,irecord);
+  }
+  getCoeffsInfoFromBinaryFile(bfile,irecord);
+  if(bfile.getHeaderField(irecord,"diagonal_matrix")!=(diagonal_ ? "true" : "false")) {
+    plumed_merror("Problem with reading matrix from file " + bfile.getPath() + ": the matrix in the file is not of the same type (diagonal or full)");
+  }
+  std::string bandwidth_file = bfile.headerFieldExists(irecord,"bandwidth") ? bfile.getHeaderField(irecord,"bandwidth") : "";
+  if(bandwidth_file!=getBandwidthString()) {
+    plumed_merror("Problem with reading matrix from file " + bfile.getPath() + ": the matrix in the file does not have the same bandwidth");
+  }
+  if(bfile.numberOfValues(irecord)!=data.size()) {
+    plumed_merror("Problem with reading matrix from file " + bfile.getPath() + ": the number of values does not match the size of the matrix");
+  }
+  std::copy(bfile.getValues(irecord),bfile.getValues(irecord)+data.size(),data.begin());
+}
+
+
 }
 }
@@ -55,6 +55,16 @@ private:
   size_t ncolumns_;
   //
   bool diagonal_;
+  // banded storage, only elements within the bandwidth in each dimension
+  // are stored, row by row (compressed sparse rows) for the upper triangle
+  std::vector<unsigned int> bandwidth_;
+  std::vector<size_t> row_offsets_;
+  std::vector<size_t> column_indices_;
+  // indices of all the coefficients, coefficient i at [i*ndim,(i+1)*ndim),
+  // such that isStoredElement() does not need to call getIndices()
+  std::vector<unsigned int> band_indices_;
+  // scratch space for addProductWithDifference()
+  std::vector<double> diff_buffer_;
   //
   unsigned int averaging_counter;
   unsigned int averaging_exp_decay_;
@@ -62,6 +72,7 @@ private:
   Communicator& mycomm;
   //
   void setupMatrix();
+  void setupBandedStructure();
   //
   CoeffsMatrix& operator=(const CoeffsMatrix&);
 public:
@@ -73,6 +84,15 @@ public:
     const bool diagonal=true,
     const bool use_iteration_counter=false);
   //
+  // banded matrix, see isStoredElement()
+  explicit CoeffsMatrix(
+    const std::string&,
+    const std::vector<std::string>&,
+    const std::vector<unsigned int>&,
+    Communicator& cc,
+    const std::vector<unsigned int>& bandwidth,
+    const bool use_iteration_counter=false);
+  //
   explicit CoeffsMatrix(
     const std::string&,
     std::vector<Value*>&,
@@ -95,6 +115,12 @@ public:
     CoeffsVector*,
     Communicator& cc,
     const bool diagonal=true);
+  // banded matrix, see isStoredElement()
+  explicit CoeffsMatrix(
+    const std::string&,
+    CoeffsVector*,
+    Communicator& cc,
+    const std::vector<unsigned int>& bandwidth);
   //
   ~CoeffsMatrix();
   //
@@ -102,6 +128,17 @@ public:
   //
   bool isSymmetric() const;
   bool isDiagonal() const;
+  bool isBanded() const {return bandwidth_.size()>0;}
+  std::vector<unsigned int> getBandwidth() const {return bandwidth_;}
+  std::string getBandwidthString() const;
+  // only the elements that are stored can be accessed, for a banded matrix
+  // these are the ones within the bandwidth in each dimension, the others are zero
+  bool isStoredElement(const size_t, const size_t) const;
+  // the stored elements of row i of the upper triangle (j>=i) are
+  // data[rowBegin(i)] to data[rowEnd(i)-1], starting with the diagonal element
+  size_t rowBegin(const size_t) const;
+  size_t rowEnd(const size_t) const;
+  size_t getColumnIndex(const size_t, const size_t) const;
   //
   bool sameShape(CoeffsVector&) const;
   bool sameShape(CoeffsMatrix&) const;
@@ -133,6 +170,8 @@ public:
   const double& operator()(const std::vector<unsigned int>&, const std::vector<unsigned int>&) const;
   //
   friend CoeffsVector operator*(const CoeffsMatrix&, const CoeffsVector&);
+  // values += M*(coeffsvector1-coeffsvector2) without temporary vectors
+  void addProductWithDifference(const CoeffsVector&, const CoeffsVector&, std::vector<double>&);
   // add to value
   void addToValue(const size_t, const size_t, const double);
   void addToValue(const std::vector<unsigned int>&, const std::vector<unsigned int>&, const double);
@@ -200,7 +239,13 @@ private:
   void writeHeaderToFile(OFile&);
   void writeDataDiagonalToFile(OFile&);
   void writeDataFullToFile(OFile&);
+  void writeDataBandedToFile(OFile&);
 public:
+  // binary file input/output stuff, see CoeffsBinaryFile
+  void writeToBinaryFile(OFile&);
+  void readFromBinaryFile(const std::string&);
+  void readFromBinaryFile(const CoeffsBinaryFile&, const size_t);
+  //
   Communicator& getCommunicator() const {return mycomm;}
 
 };
@@ -37,6 +37,7 @@
 #include <sstream>
 #include <cstdio>
 #include <cfloat>
+#include <algorithm>
 
 
 namespace PLMD {
@@ -374,6 +375,31 @@ void CoeffsVector::subtractFromValues(const CoeffsVector& other_coeffsvector) {
 }
 
 
+void CoeffsVector::addScaledProductToValues(const double scalef, const CoeffsVector& coeffsvector1, const CoeffsVector& coeffsvector2) {
+  addScaledProductToValues(scalef,coeffsvector1,coeffsvector2.data);
+}
+
+
+void CoeffsVector::addScaledProductToValues(const double scalef, const CoeffsVector& coeffsvector1, const std::vector<double>& values2) {
+  // same as *this += (scalef*coeffsvector1) * values2
+  plumed_massert( data.size()==coeffsvector1.getSize(), "Incorrect size");
+  plumed_massert( data.size()==values2.size(), "Incorrect size");
+  for(size_t i=0; i<data.size(); i++) {
+    data[i]+=(scalef*coeffsvector1.data[i])*values2[i];
+  }
+}
+
+
+void CoeffsVector::addScaledDifferenceToValues(const double scalef, const CoeffsVector& coeffsvector1, const CoeffsVector& coeffsvector2) {
+  // same as *this += scalef * (coeffsvector1-coeffsvector2), also if *this is one of the two vectors
+  plumed_massert( data.size()==coeffsvector1.getSize(), "Incorrect size");
+  plumed_massert( data.size()==coeffsvector2.getSize(), "Incorrect size");
+  for(size_t i=0; i<data.size(); i++) {
+    data[i]+=scalef*(coeffsvector1.data[i]-coeffsvector2.data[i]);
+  }
+}
+
+
 CoeffsVector& CoeffsVector::operator+=(const double value) {
   addToValues(value);
   return *this;
@@ -868,5 +894,77 @@ size_t CoeffsVector::readDataFromFile(IFile& ifile, const bool ignore_missing_co
 }
 
 
+void CoeffsVector::writeToBinaryFile(OFile& ofile) {
+  std::vector<CoeffsVector*> CoeffsSetTmp;
+  CoeffsSetTmp.push_back(this);
+  writeToBinaryFile(ofile,CoeffsSetTmp);
+}
+
+
+void CoeffsVector::writeToBinaryFile(OFile& ofile, CoeffsVector* aux_coeffsvector) {
+  std::vector<CoeffsVector*> CoeffsSetTmp;
+  CoeffsSetTmp.push_back(this);
+  CoeffsSetTmp.push_back(aux_coeffsvector);
+  writeToBinaryFile(ofile,CoeffsSetTmp);
+}
+
+
+void CoeffsVector::writeToBinaryFile(OFile& ofile, const std::vector<CoeffsVector*>& coeffsvecSet) {
+  for(unsigned int k=1; k<coeffsvecSet.size(); k++) {
+    plumed_massert(coeffsvecSet[k]->sameShape(*coeffsvecSet[0]),"Error in writing a set of coeffs to file: The coeffs do not have the same shape and size");
+  }
+  CoeffsBinaryFile::Header header;
+  header.push_back(std::make_pair("object","CoeffsVector"));
+  header.push_back(std::make_pair("label",coeffsvecSet[0]->getLabel()));
+  if(coeffsvecSet[0]->isIterationCounterActive()) {
+    coeffsvecSet[0]->writeIterationCounterAndTimeToBinaryHeader(header);
+  }
+  coeffsvecSet[0]->writeCoeffsInfoToBinaryHeader(header);
+  std::string data_labels = "";
+  std::vector<const double*> values(coeffsvecSet.size());
+  for(unsigned int k=0; k<coeffsvecSet.size(); k++) {
+    if(k>0) {data_labels += " ";}
+    data_labels += coeffsvecSet[k]->getDataLabel();
+    values[k] = coeffsvecSet[k]->data.data();
+  }
+  header.push_back(std::make_pair("data_labels",data_labels));
+  CoeffsBinaryFile::writeRecord(ofile,header,values,coeffsvecSet[0]->getSize());
+}
+
+
+size_t CoeffsVector::readFromBinaryFile(const std::string& filepath, const bool ignore_header) {
+  CoeffsBinaryFile bfile(filepath);
+  if(bfile.numberOfRecords()==0) {
+    plumed_merror("no complete record found in binary coefficient file "+filepath);
+  }
+  // the last record is the most recent one
+  return readFromBinaryFile(bfile,bfile.numberOfRecords()-1,ignore_header);
+}
+
+
+size_t CoeffsVector::readFromBinaryFile(const CoeffsBinaryFile& bfile, const size_t irecord, const bool ignore_header) {
+  if(!ignore_header) {
+    if(isIterationCounterActive()) {
+      getIterationCounterAndTimeFromBinaryFile(bfile,irecord);
+    }
+    getCoeffsInfoFromBinaryFile(bfile,irecord);
+  }
+  std::vector<std::string> data_labels = Tools::getWords(bfile.getHeaderField(irecord,"data_labels"));
+  unsigned int column = data_labels.size();
+  for(unsigned int k=0; k<data_labels.size(); k++) {
+    if(data_labels[k]==getDataLabel()) {column=k; break;}
+  }
+  if(column==data_labels.size()) {
+    plumed_merror("Problem with reading coefficents from file " + bfile.getPath() + ": no data with label " + getDataLabel());
+  }
+  if(bfile.numberOfValues(irecord)!=data_labels.size()*numberOfCoeffs()) {
+    plumed_merror("Problem with reading coefficents from file " + bfile.getPath() + ": the number of values does not match the number of coefficients");
+  }
+  const double* values = bfile.getValues(irecord) + column*numberOfCoeffs();
+  std::copy(values,values+numberOfCoeffs(),data.begin());
+  return numberOfCoeffs();
+}
+
+
 }
 }
@@ -144,6 +144,10 @@ public:
   void subtractFromValues(const double);
   void subtractFromValues(const std::vector<double>&);
   void subtractFromValues(const CoeffsVector&);
+  // fused updates that do not create temporary vectors
+  void addScaledProductToValues(const double, const CoeffsVector&, const CoeffsVector&);
+  void addScaledProductToValues(const double, const CoeffsVector&, const std::vector<double>&);
+  void addScaledDifferenceToValues(const double, const CoeffsVector&, const CoeffsVector&);
   CoeffsVector& operator+=(const double);
   friend CoeffsVector operator+(const double, const CoeffsVector&);
   friend CoeffsVector operator+(const CoeffsVector&, const double);
@@ -211,6 +215,13 @@ private:
   void readHeaderFromFile(IFile&, const bool ignore_coeffs_info=false);
   size_t readDataFromFile(IFile&, const bool ignore_missing_coeffs=false);
 public:
+  // binary file input/output stuff, see CoeffsBinaryFile
+  void writeToBinaryFile(OFile&);
+  void writeToBinaryFile(OFile&, CoeffsVector*);
+  static void writeToBinaryFile(OFile&, const std::vector<CoeffsVector*>&);
+  size_t readFromBinaryFile(const std::string&, const bool ignore_header=false);
+  size_t readFromBinaryFile(const CoeffsBinaryFile&, const size_t, const bool ignore_header=false);
+  //
   Communicator& getCommunicator() const {return mycomm;}
 };
 
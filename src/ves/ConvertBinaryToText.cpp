@@ -0,0 +1,178 @@
+/* +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+   Copyright (c) 2016-2017 The VES code team
+   (see the PEOPLE-VES file at the root of this folder for a list of names)
+
+   See http://www.ves-code.org for more information.
+
+   This file is part of VES code module.
+
+   The VES code module is free software: you can redistribute it and/or modify
+   it under the terms of the GNU Lesser General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   The VES code module is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public License
+   along with the VES code module.  If not, see <http://www.gnu.org/licenses/>.
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+#include "CoeffsVector.h"
+#include "CoeffsMatrix.h"
+#include "CoeffsBinaryFile.h"
+
+#include "cltools/CLTool.h"
+#include "cltools/CLToolRegister.h"
+#include "tools/Communicator.h"
+#include "tools/Tools.h"
+#include "tools/File.h"
+
+#include <string>
+#include <cstdio>
+#include <vector>
+
+
+namespace PLMD {
+namespace ves {
+
+//+PLUMEDOC VES_TOOLS ves_binary_to_text
+/*
+Convert a binary coefficient, gradient or Hessian file to the text format.
+
+When the BINARY_OUTPUT flag is used in a VES optimizer the coefficient,
+gradient, Hessian and target distribution averages files are written
+in a binary format that is much smaller and faster to write and read
+than the text format. The optimizer can restart directly from a binary
+coefficient file.
+
+This tool converts such a binary file to the same text format that is
+written by the optimizer without the BINARY_OUTPUT flag, such that it
+can be analysed with the usual tools or used as an input for the
+COEFFS keyword of a VES bias. By default all records in the file,
+i.e., all iterations that were written out, are converted. With the
+--last flag only the last record is converted.
+
+\par Examples
+
+The following command converts all records in the binary coefficient file
+coeffs.data to the text file coeffs.txt.data
+\verbatim
+plumed ves_binary_to_text --input coeffs.data --output coeffs.txt.data
+\endverbatim
+
+The following command only converts the last record, i.e., the
+coefficients from the last iteration, using a reduced number of digits.
+\verbatim
+plumed ves_binary_to_text --input coeffs.data --output coeffs.last.data --last --fmt %12.6f
+\endverbatim
+
+*/
+//+ENDPLUMEDOC
+
+class ConvertBinaryToText : public PLMD::CLTool {
+public:
+  static void registerKeywords( Keywords& keys );
+  explicit ConvertBinaryToText( const CLToolOptions& co );
+  int main( FILE* in, FILE* out, PLMD::Communicator& pc);
+  std::string description() const {return "convert a binary VES coefficient file to the text format";}
+};
+
+PLUMED_REGISTER_CLTOOL(ConvertBinaryToText,"ves_binary_to_text")
+
+void ConvertBinaryToText::registerKeywords( Keywords& keys ) {
+  CLTool::registerKeywords( keys );
+  keys.add("compulsory","--input","the binary file that should be converted");
+  keys.add("compulsory","--output","the name of the text file that should be written");
+  keys.add("compulsory","--fmt","%30.16e","the format used for the values in the text file");
+  keys.addFlag("--last",false,"only convert the last record in the binary file");
+}
+
+
+ConvertBinaryToText::ConvertBinaryToText( const CLToolOptions& co ):
+  CLTool(co)
+{
+  inputdata=commandline;
+}
+
+
+int ConvertBinaryToText::main( FILE* /*in*/, FILE* /*out*/, PLMD::Communicator& pc) {
+  std::string input_fname;
+  parse("--input",input_fname);
+  std::string output_fname;
+  parse("--output",output_fname);
+  std::string output_fmt;
+  parse("--fmt",output_fmt);
+  bool last_only=false;
+  parseFlag("--last",last_only);
+  //
+  CoeffsBinaryFile bfile(input_fname);
+  if(bfile.numberOfRecords()==0) {
+    plumed_merror("no complete record found in binary file "+input_fname);
+  }
+  //
+  OFile ofile;
+  ofile.link(pc);
+  ofile.open(output_fname);
+  size_t first_record = 0;
+  if(last_only) {first_record = bfile.numberOfRecords()-1;}
+  for(size_t r=first_record; r<bfile.numberOfRecords(); r++) {
+    // reconstruct the objects from the header of the record
+    std::string object = bfile.getHeaderField(r,"object");
+    std::string label = bfile.getHeaderField(r,"label");
+    std::vector<std::string> data_labels = Tools::getWords(bfile.getHeaderField(r,"data_labels"));
+    std::vector<std::string> dimension_labels = Tools::getWords(bfile.getHeaderField(r,"dimension_labels"));
+    std::vector<unsigned int> indices_shape(dimension_labels.size());
+    for(unsigned int k=0; k<dimension_labels.size(); k++) {
+      Tools::convert(bfile.getHeaderField(r,"shape_"+dimension_labels[k]),indices_shape[k]);
+    }
+    std::string type = bfile.getHeaderField(r,"type");
+    bool use_iteration_counter = bfile.headerFieldExists(r,"iteration");
+    //
+    if(object=="CoeffsVector") {
+      std::vector<CoeffsVector*> coeffsvecSet(data_labels.size());
+      for(unsigned int k=0; k<data_labels.size(); k++) {
+        coeffsvecSet[k] = new CoeffsVector(label,dimension_labels,indices_shape,pc,use_iteration_counter);
+        if(k==0) {coeffsvecSet[k]->setLabels(label,data_labels[k]);}
+        else {coeffsvecSet[k]->setLabels(data_labels[k]);}
+        coeffsvecSet[k]->setType(type);
+        coeffsvecSet[k]->setOutputFmt(output_fmt);
+        coeffsvecSet[k]->readFromBinaryFile(bfile,r);
+      }
+      CoeffsVector::writeToFile(ofile,coeffsvecSet,false);
+      for(unsigned int k=0; k<coeffsvecSet.size(); k++) {delete coeffsvecSet[k];}
+    }
+    else if(object=="CoeffsMatrix") {
+      bool diagonal = bfile.getHeaderField(r,"diagonal_matrix")=="true";
+      CoeffsMatrix* coeffsmat_pntr = NULL;
+      if(bfile.headerFieldExists(r,"bandwidth")) {
+        std::vector<std::string> words = Tools::getWords(bfile.getHeaderField(r,"bandwidth"),"\t\n ,");
+        std::vector<unsigned int> bandwidth(words.size());
+        for(unsigned int k=0; k<words.size(); k++) {
+          Tools::convert(words[k],bandwidth[k]);
+        }
+        coeffsmat_pntr = new CoeffsMatrix(label,dimension_labels,indices_shape,pc,bandwidth,use_iteration_counter);
+      }
+      else {
+        coeffsmat_pntr = new CoeffsMatrix(label,dimension_labels,indices_shape,pc,diagonal,use_iteration_counter);
+      }
+      coeffsmat_pntr->setLabels(label,data_labels[0]);
+      coeffsmat_pntr->setType(type);
+      coeffsmat_pntr->setOutputFmt(output_fmt);
+      coeffsmat_pntr->readFromBinaryFile(bfile,r);
+      coeffsmat_pntr->writeToFile(ofile);
+      delete coeffsmat_pntr;
+    }
+    else {
+      plumed_merror("unknown type of data "+object+" in binary file "+input_fname);
+    }
+  }
+  ofile.close();
+  return 0;
+}
+
+
+}
+}
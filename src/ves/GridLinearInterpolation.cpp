@@ -110,5 +110,61 @@ double GridLinearInterpolation::getGridValueWithLinearInterpolation(Grid* grid_p
 
 
 
+double GridLinearInterpolation::getGridValueAndDerivativesWithLinearInterpolation(const Grid* grid_pntr, const std::vector<double>& arg, std::vector<double>& der) {
+  unsigned int dim = grid_pntr->getDimension();
+  plumed_massert(grid_pntr->hasDerivatives(),"The grid needs to have derivatives");
+  plumed_massert(arg.size()==dim,"input value is of the wrong size");
+  plumed_massert(der.size()==dim,"derivative vector is of the wrong size");
+
+  std::vector<double> grid_delta = grid_pntr->getDx();
+  std::vector<std::string> grid_min_str = grid_pntr->getMin();
+  std::vector<unsigned> grid_nbin = grid_pntr->getNbin();
+  std::vector<bool> grid_periodic = grid_pntr->getIsPeriodic();
+
+  // lower and upper grid point of the cell containing arg, and the position within the cell
+  std::vector<unsigned int> i0(dim);
+  std::vector<unsigned int> i1(dim);
+  std::vector<double> t(dim);
+  for(unsigned int k=0; k<dim; k++) {
+    double grid_min; Tools::convert(grid_min_str[k],grid_min);
+    double x = (arg[k]-grid_min)/grid_delta[k];
+    int n = static_cast<int>(grid_nbin[k]);
+    int i = static_cast<int>(std::floor(x));
+    if(grid_periodic[k]) {
+      t[k] = x-std::floor(x);
+      i = ((i%n)+n)%n;
+      i0[k] = unsigned(i);
+      i1[k] = unsigned((i+1)%n);
+    }
+    else {
+      // for non-periodic grids the last grid point is at the maximum of the interval
+      if(i<0) {i=0;}
+      if(i>n-2) {i=n-2;}
+      t[k] = x-static_cast<double>(i);
+      i0[k] = unsigned(i);
+      i1[k] = unsigned(i+1);
+    }
+    der[k] = 0.0;
+  }
+
+  // https://en.wikipedia.org/wiki/Multilinear_interpolation
+  double value = 0.0;
+  std::vector<unsigned int> corner(dim);
+  std::vector<double> corner_der(dim);
+  for(unsigned int c=0; c<(1u<<dim); c++) {
+    double w = 1.0;
+    for(unsigned int k=0; k<dim; k++) {
+      if((c>>k)&1u) {corner[k]=i1[k]; w*=t[k];}
+      else {corner[k]=i0[k]; w*=(1.0-t[k]);}
+    }
+    value += w*grid_pntr->getValueAndDerivatives(corner,corner_der);
+    for(unsigned int k=0; k<dim; k++) {
+      der[k] += w*corner_der[k];
+    }
+  }
+  return value;
+}
+
+
 }
 }
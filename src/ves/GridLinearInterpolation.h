@@ -40,6 +40,8 @@ private:
   static double linearInterpolation(const double x, const double x0, const double x1, const double y0, const double y1);
 public:
   static double getGridValueWithLinearInterpolation(Grid* grid_pntr, const std::vector<double>& arg);
+  // multilinear interpolation of both the values and the derivatives stored on the grid, for any dimension
+  static double getGridValueAndDerivativesWithLinearInterpolation(const Grid* grid_pntr, const std::vector<double>& arg, std::vector<double>& der);
 };
 
 
@@ -29,19 +29,20 @@ namespace PLMD {
 namespace ves {
 
 
-class MarginalWeight:public WeightBase {
+class MarginalWeight final:public WeightBase {
 public:
   explicit MarginalWeight() {}
   double projectInnerLoop(double &input, double &v) {return  input+v;}
   double projectOuterLoop(double &v) {return v;}
 };
 
-class FesWeight:public WeightBase {
+class FesWeight final:public WeightBase {
 public:
   double beta,invbeta;
   explicit FesWeight(double v) {beta=v; invbeta=1./beta;}
   double projectInnerLoop(double &input, double &v) {return  input+exp(-beta*v);}
   double projectOuterLoop(double &v) {return -invbeta*std::log(v);}
+  bool projectLogSumExp(double &exponent, double &prefactor) const {exponent=-beta; prefactor=-invbeta; return true;}
 };
 
 }
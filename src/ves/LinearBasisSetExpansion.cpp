@@ -29,11 +29,19 @@
 #include "TargetDistribution.h"
 
 
+#include "core/Value.h"
 #include "tools/Keywords.h"
 #include "tools/Grid.h"
 #include "tools/Communicator.h"
+#include "tools/OpenMP.h"
+
+#include "blas/blas.h"
 
 #include "GridProjWeights.h"
+#include "GridLinearInterpolation.h"
+
+#include <algorithm>
+#include <memory>
 
 namespace PLMD {
 namespace ves {
@@ -54,6 +62,8 @@ LinearBasisSetExpansion::LinearBasisSetExpansion(
   vesbias_pntr_(NULL),
   mycomm_(cc),
   serial_(false),
+  factorized_evaluation_(false),
+  compact_support_(false),
   beta_(beta_in),
   kbt_(1.0/beta_),
   args_pntrs_(args_pntrs_in),
@@ -75,10 +85,22 @@ LinearBasisSetExpansion::LinearBasisSetExpansion(
   fes_grid_pntr_(NULL),
   log_targetdist_grid_pntr_(NULL),
   targetdist_grid_pntr_(NULL),
-  targetdist_pntr_(NULL)
+  bias_interpolation_grid_pntr_(NULL),
+  bias_interpolation_linear_(false),
+  targetdist_pntr_(NULL),
+  batch_capacity_(0),
+  batch_bf_values_(0),
+  batch_bf_derivs_(0),
+  batch_args_(0),
+  batch_args_trsfrm_(0),
+  batch_inside_(NULL)
 {
   plumed_massert(args_pntrs_.size()==basisf_pntrs_.size(),"number of arguments and basis functions do not match");
   for(unsigned int k=0; k<nargs_; k++) {nbasisf_[k]=basisf_pntrs_[k]->getNumberOfBasisFunctions();}
+  compact_support_ = true;
+  for(unsigned int k=0; k<nargs_; k++) {
+    if(!basisf_pntrs_[k]->hasCompactSupport()) {compact_support_=false;}
+  }
   //
   if(bias_coeffs_pntr_==NULL) {
     bias_coeffs_pntr_ = new CoeffsVector(label_+".coeffs",args_pntrs_,basisf_pntrs_,mycomm_,true);
@@ -86,6 +108,7 @@ LinearBasisSetExpansion::LinearBasisSetExpansion(
   plumed_massert(bias_coeffs_pntr_->numberOfDimensions()==basisf_pntrs_.size(),"dimension of coeffs does not match with number of basis functions ");
   //
   ncoeffs_ = bias_coeffs_pntr_->numberOfCoeffs();
+  workspace_.setup(basisf_pntrs_,ncoeffs_);
   targetdist_averages_pntr_ = new CoeffsVector(*bias_coeffs_pntr_);
 
   std::string targetdist_averages_label = bias_coeffs_pntr_->getLabel();
@@ -116,6 +139,9 @@ LinearBasisSetExpansion::~LinearBasisSetExpansion() {
   if(fes_grid_pntr_!=NULL) {
     delete fes_grid_pntr_;
   }
+  if(bias_interpolation_grid_pntr_!=NULL) {
+    delete bias_interpolation_grid_pntr_;
+  }
 }
 
 
@@ -191,30 +217,106 @@ void LinearBasisSetExpansion::updateBiasGrid() {
   if(action_pntr_!=NULL &&  getStepOfLastBiasGridUpdate()==action_pntr_->getStep()) {
     return;
   }
-  for(Grid::index_t l=0; l<bias_grid_pntr_->getSize(); l++) {
-    std::vector<double> forces(nargs_);
-    std::vector<double> args = bias_grid_pntr_->getPoint(l);
-    bool all_inside=true;
-    double bias=getBiasAndForces(args,all_inside,forces);
-    //
-    if(biasCutoffActive()) {
+  calculateBiasOnGrid(bias_grid_pntr_,biasCutoffActive());
+  if(vesbias_pntr_!=NULL) {
+    vesbias_pntr_->setCurrentBiasMaxValue(bias_grid_pntr_->getMaxValue());
+  }
+  if(action_pntr_!=NULL) {
+    setStepOfLastBiasGridUpdate(action_pntr_->getStep());
+  }
+}
+
+
+void LinearBasisSetExpansion::calculateBiasOnGrid(Grid* grid_pntr, const bool apply_bias_cutoff) {
+  // The bias and its derivatives on the full grid are obtained by contracting
+  // the coefficients with the basis functions on the grid axes, one axis at a time.
+  plumed_massert(!apply_bias_cutoff || vesbias_pntr_!=NULL,"has to be linked to a VesBias to apply the bias cutoff");
+  setupBasisSetOnGrid(grid_pntr);
+  const Grid::index_t gridsize = grid_pntr->getSize();
+  const bool use_derivs = grid_pntr->hasDerivatives();
+  //
+  std::vector<double> bias_values(ncoeffs_);
+  for(size_t i=0; i<ncoeffs_; i++) {bias_values[i] = BiasCoeffs().getValue(i);}
+  std::vector<double> coeffs_values(bias_values);
+  contractCoeffsToGrid(bias_values,nargs_);
+  std::vector< std::vector<double> > bias_derivs(nargs_);
+  if(use_derivs) {
+    for(unsigned int k=0; k<nargs_; k++) {
+      bias_derivs[k] = coeffs_values;
+      contractCoeffsToGrid(bias_derivs[k],k);
+    }
+  }
+  //
+  std::vector<double> forces(nargs_);
+  for(Grid::index_t l=0; l<gridsize; l++) {
+    double bias = bias_values[l];
+    for(unsigned int k=0; k<nargs_; k++) {
+      forces[k] = bias_derivs[k].size()>0 ? -bias_derivs[k][l] : 0.0;
+    }
+    if(apply_bias_cutoff) {
       vesbias_pntr_->applyBiasCutoff(bias,forces);
     }
-    //
-    if(bias_grid_pntr_->hasDerivatives()) {
-      bias_grid_pntr_->setValueAndDerivatives(l,bias,forces);
+    if(use_derivs) {
+      grid_pntr->setValueAndDerivatives(l,bias,forces);
     }
     else {
-      bias_grid_pntr_->setValue(l,bias);
+      grid_pntr->setValue(l,bias);
     }
-    //
   }
-  if(vesbias_pntr_!=NULL) {
-    vesbias_pntr_->setCurrentBiasMaxValue(bias_grid_pntr_->getMaxValue());
+}
+
+
+void LinearBasisSetExpansion::setupBiasInterpolationGrid(const bool linear_interpolation) {
+  if(bias_interpolation_grid_pntr_!=NULL) {return;}
+  bias_interpolation_linear_ = linear_interpolation;
+  bool use_spline = !linear_interpolation;
+  bool usederiv = true;
+  bias_interpolation_grid_pntr_ = new Grid(label_+".bias_interpolation",args_pntrs_,grid_min_,grid_max_,grid_bins_,use_spline,usederiv);
+}
+
+
+void LinearBasisSetExpansion::updateBiasInterpolationGrid() {
+  plumed_massert(bias_interpolation_grid_pntr_!=NULL,"the bias interpolation grid is not defined");
+  // the bias cutoff is applied after the interpolation, as for the direct evaluation
+  calculateBiasOnGrid(bias_interpolation_grid_pntr_);
+  // calculateBiasOnGrid stores the forces, while the interpolation needs the derivatives
+  std::vector<double> der(nargs_);
+  for(Grid::index_t l=0; l<bias_interpolation_grid_pntr_->getSize(); l++) {
+    double value = bias_interpolation_grid_pntr_->getValueAndDerivatives(l,der);
+    for(unsigned int k=0; k<nargs_; k++) {der[k] = -der[k];}
+    bias_interpolation_grid_pntr_->setValueAndDerivatives(l,value,der);
   }
-  if(action_pntr_!=NULL) {
-    setStepOfLastBiasGridUpdate(action_pntr_->getStep());
+}
+
+
+double LinearBasisSetExpansion::getBiasAndForcesFromInterpolationGrid(const std::vector<double>& args_values, bool& all_inside, std::vector<double>& forces) {
+  plumed_dbg_assert(bias_interpolation_grid_pntr_!=NULL);
+  plumed_dbg_assert(forces.size()==nargs_);
+  all_inside = true;
+  // arguments outside the interval are put at the boundary and do not feel a force along that direction,
+  // as for the basis functions
+  std::vector<double>& args_inside = workspace_.args_values_trsfrm;
+  for(unsigned int k=0; k<nargs_; k++) {
+    bool curr_inside=true;
+    args_inside[k] = basisf_pntrs_[k]->checkIfArgumentInsideInterval(args_values[k],curr_inside);
+    if(!curr_inside) {all_inside=false;}
+    // the upper end of a periodic grid is the same point as the lower end
+    if(args_pntrs_[k]->isPeriodic() && args_inside[k]>=basisf_pntrs_[k]->intervalMax()) {
+      args_inside[k] = basisf_pntrs_[k]->intervalMin();
+    }
+  }
+  double bias = 0.0;
+  if(bias_interpolation_linear_) {
+    bias = GridLinearInterpolation::getGridValueAndDerivativesWithLinearInterpolation(bias_interpolation_grid_pntr_,args_inside,forces);
+  }
+  else {
+    bias = bias_interpolation_grid_pntr_->getValueAndDerivatives(args_inside,forces);
+  }
+  for(unsigned int k=0; k<nargs_; k++) {
+    if(args_values[k]<basisf_pntrs_[k]->intervalMin() || args_values[k]>basisf_pntrs_[k]->intervalMax()) {forces[k]=0.0;}
+    else {forces[k]=-forces[k];}
   }
+  return bias;
 }
 
 
@@ -226,18 +328,7 @@ void LinearBasisSetExpansion::updateBiasWithoutCutoffGrid() {
     return;
   }
   //
-  for(Grid::index_t l=0; l<bias_withoutcutoff_grid_pntr_->getSize(); l++) {
-    std::vector<double> forces(nargs_);
-    std::vector<double> args = bias_withoutcutoff_grid_pntr_->getPoint(l);
-    bool all_inside=true;
-    double bias=getBiasAndForces(args,all_inside,forces);
-    if(bias_withoutcutoff_grid_pntr_->hasDerivatives()) {
-      bias_withoutcutoff_grid_pntr_->setValueAndDerivatives(l,bias,forces);
-    }
-    else {
-      bias_withoutcutoff_grid_pntr_->setValue(l,bias);
-    }
-  }
+  calculateBiasOnGrid(bias_withoutcutoff_grid_pntr_);
   //
   double bias_max = bias_withoutcutoff_grid_pntr_->getMaxValue();
   double bias_min = bias_withoutcutoff_grid_pntr_->getMinValue();
@@ -258,9 +349,9 @@ void LinearBasisSetExpansion::updateBiasWithoutCutoffGrid() {
   if(bias_shifted) {
     // this should be done inside a grid function really,
     // need to define my grid class for that
+    std::vector<double> zeros(nargs_,0.0);
     for(Grid::index_t l=0; l<bias_withoutcutoff_grid_pntr_->getSize(); l++) {
       if(bias_withoutcutoff_grid_pntr_->hasDerivatives()) {
-        std::vector<double> zeros(nargs_,0.0);
         bias_withoutcutoff_grid_pntr_->addValueAndDerivatives(l,shift,zeros);
       }
       else {
@@ -285,6 +376,7 @@ void LinearBasisSetExpansion::updateFesGrid() {
   }
   //
   double bias2fes_scalingf = -1.0;
+  #pragma omp parallel for num_threads(OpenMP::getNumThreads())
   for(Grid::index_t l=0; l<fes_grid_pntr_->getSize(); l++) {
     double fes_value = bias2fes_scalingf*bias_grid_pntr_->getValue(l);
     if(log_targetdist_grid_pntr_!=NULL) {
@@ -323,7 +415,7 @@ void LinearBasisSetExpansion::writeFesGridToFile(OFile& ofile, const bool append
 void LinearBasisSetExpansion::writeFesProjGridToFile(const std::vector<std::string>& proj_arg, OFile& ofile, const bool append_file) const {
   plumed_massert(fes_grid_pntr_!=NULL,"the FES grid is not defined");
   FesWeight* Fw = new FesWeight(beta_);
-  Grid proj_grid = fes_grid_pntr_->project(proj_arg,Fw);
+  Grid proj_grid = fes_grid_pntr_->project(proj_arg,Fw,&mycomm_);
   proj_grid.setMinToZero();
   if(append_file) {ofile.enforceRestart();}
   proj_grid.writeToFile(ofile);
@@ -348,7 +440,7 @@ void LinearBasisSetExpansion::writeLogTargetDistGridToFile(OFile& ofile, const b
 void LinearBasisSetExpansion::writeTargetDistProjGridToFile(const std::vector<std::string>& proj_arg, OFile& ofile, const bool append_file) const {
   if(targetdist_grid_pntr_==NULL) {return;}
   if(append_file) {ofile.enforceRestart();}
-  Grid proj_grid = TargetDistribution::getMarginalDistributionGrid(targetdist_grid_pntr_,proj_arg);
+  Grid proj_grid = TargetDistribution::getMarginalDistributionGrid(targetdist_grid_pntr_,proj_arg,&mycomm_);
   proj_grid.writeToFile(ofile);
 }
 
@@ -367,26 +459,245 @@ void LinearBasisSetExpansion::writeTargetDistributionToFile(const std::string& f
 }
 
 
+void LinearBasisSetExpansion::Workspace::setup(const std::vector<BasisFunctions*>& basisf_pntrs_in, const size_t ncoeffs) {
+  unsigned int nargs = basisf_pntrs_in.size();
+  args_values_trsfrm.assign(nargs,0.0);
+  args_values.assign(nargs,0.0);
+  bf_values.resize(nargs);
+  bf_derivs.resize(nargs);
+  for(unsigned int k=0; k<nargs; k++) {
+    bf_values[k].assign(basisf_pntrs_in[k]->getNumberOfBasisFunctions(),0.0);
+    bf_derivs[k].assign(basisf_pntrs_in[k]->getNumberOfBasisFunctions(),0.0);
+  }
+  indices.assign(nargs,0);
+  // largest partially contracted slab needed by getBiasAndForcesFactorized
+  size_t work_size = 0;
+  if(nargs>1) {
+    size_t slab_size = ncoeffs/basisf_pntrs_in[nargs-1]->getNumberOfBasisFunctions();
+    work_size = nargs*(slab_size/basisf_pntrs_in[0]->getNumberOfBasisFunctions());
+  }
+  work_even.assign(work_size,0.0);
+  work_odd.assign(work_size,0.0);
+  forces_dummy.assign(nargs,0.0);
+  coeffsderivs_values_dummy.assign(ncoeffs,0.0);
+  //
+  active_indices.resize(nargs);
+  size_t nactive_max = 1;
+  for(unsigned int k=0; k<nargs; k++) {
+    active_indices[k].reserve(basisf_pntrs_in[k]->getNumberOfBasisFunctions());
+    if(basisf_pntrs_in[k]->hasCompactSupport()) {
+      std::vector<unsigned int> active_test;
+      basisf_pntrs_in[k]->getActiveIndices(basisf_pntrs_in[k]->intervalMean(),active_test);
+      // the active window has the same size everywhere except close to the boundaries
+      nactive_max *= active_test.size();
+    }
+    else {
+      nactive_max *= basisf_pntrs_in[k]->getNumberOfBasisFunctions();
+    }
+  }
+  active_position.assign(nargs,0);
+  active_coeffsderivs_values.reserve(nactive_max);
+  active_coeffs_indices.reserve(nactive_max);
+  //
+  fixed_nargs = (nargs>=1 && nargs<=3) ? nargs : 0;
+}
+
+
+template<unsigned int D>
+double LinearBasisSetExpansion::getBiasAndForcesKernel(const Workspace& ws, const CoeffsVector& coeffs, std::vector<double>& forces, std::vector<double>& coeffsderivs_values, const size_t rank, const size_t stride) {
+  const double* values[D];
+  const double* derivs[D];
+  size_t shape[D];
+  for(unsigned int k=0; k<D; k++) {
+    values[k] = ws.bf_values[k].data();
+    derivs[k] = ws.bf_derivs[k].data();
+    shape[k] = ws.bf_values[k].size();
+  }
+  // indices of the first coefficient of this rank, afterwards advanced by the
+  // stride with the first index running fastest
+  size_t indices[D];
+  size_t rest = rank;
+  for(unsigned int k=0; k<D; k++) {
+    indices[k] = rest%shape[k];
+    rest /= shape[k];
+  }
+  const size_t ncoeffs = coeffs.numberOfCoeffs();
+  double bias=0.0;
+  double force_sums[D];
+  for(unsigned int k=0; k<D; k++) {force_sums[k]=0.0;}
+  for(size_t i=rank; i<ncoeffs; i+=stride) {
+    double coeff = coeffs[i];
+    double bf_value[D];
+    double bf_curr=1.0;
+    for(unsigned int k=0; k<D; k++) {
+      bf_value[k] = values[k][indices[k]];
+      bf_curr*=bf_value[k];
+    }
+    bias+=coeff*bf_curr;
+    coeffsderivs_values[i] = bf_curr;
+    for(unsigned int k=0; k<D; k++) {
+      double der = 1.0;
+      for(unsigned int l=0; l<D; l++) {
+        if(l!=k) {der*=bf_value[l];}
+        else {der*=derivs[l][indices[l]];}
+      }
+      force_sums[k]-=coeff*der;
+    }
+    indices[0]+=stride;
+    for(unsigned int k=0; k+1<D; k++) {
+      while(indices[k]>=shape[k]) {indices[k]-=shape[k]; indices[k+1]++;}
+    }
+  }
+  for(unsigned int k=0; k<D; k++) {forces[k]=force_sums[k];}
+  return bias;
+}
+
+
+template<unsigned int D>
+double LinearBasisSetExpansion::getBiasAndForcesCompactKernel(const Workspace& ws, const CoeffsVector& coeffs, std::vector<double>& forces, std::vector<double>& active_coeffsderivs_values, std::vector<size_t>& active_coeffs_indices) {
+  const double* values[D];
+  const double* derivs[D];
+  const unsigned int* active[D];
+  size_t nactive[D];
+  size_t coeffs_stride[D];
+  size_t position[D];
+  size_t ntotal=1;
+  size_t block=1;
+  for(unsigned int k=0; k<D; k++) {
+    values[k] = ws.bf_values[k].data();
+    derivs[k] = ws.bf_derivs[k].data();
+    active[k] = ws.active_indices[k].data();
+    nactive[k] = ws.active_indices[k].size();
+    coeffs_stride[k] = block;
+    position[k] = 0;
+    ntotal *= nactive[k];
+    block *= ws.bf_values[k].size();
+  }
+  double bias=0.0;
+  double force_sums[D];
+  for(unsigned int k=0; k<D; k++) {force_sums[k]=0.0;}
+  for(size_t a=0; a<ntotal; a++) {
+    size_t i=0;
+    double bf_value[D];
+    double bf_deriv[D];
+    double bf_curr=1.0;
+    for(unsigned int k=0; k<D; k++) {
+      unsigned int n = active[k][position[k]];
+      i += n*coeffs_stride[k];
+      bf_value[k] = values[k][n];
+      bf_deriv[k] = derivs[k][n];
+      bf_curr*=bf_value[k];
+    }
+    double coeff = coeffs[i];
+    bias+=coeff*bf_curr;
+    active_coeffsderivs_values[a] = bf_curr;
+    active_coeffs_indices[a] = i;
+    for(unsigned int k=0; k<D; k++) {
+      double der = 1.0;
+      for(unsigned int l=0; l<D; l++) {
+        if(l!=k) {der*=bf_value[l];}
+        else {der*=bf_deriv[l];}
+      }
+      force_sums[k]-=coeff*der;
+    }
+    for(unsigned int k=0; k<D; k++) {
+      position[k]++;
+      if(position[k]<nactive[k]) {break;}
+      position[k]=0;
+    }
+  }
+  for(unsigned int k=0; k<D; k++) {forces[k]=force_sums[k];}
+  return bias;
+}
+
+
+template<unsigned int D>
+void LinearBasisSetExpansion::getBasisSetValuesKernel(const Workspace& ws, const CoeffsVector& coeffs, std::vector<double>& basisset_values, const size_t rank, const size_t stride) {
+  const double* values[D];
+  size_t shape[D];
+  for(unsigned int k=0; k<D; k++) {
+    values[k] = ws.bf_values[k].data();
+    shape[k] = ws.bf_values[k].size();
+  }
+  size_t indices[D];
+  size_t rest = rank;
+  for(unsigned int k=0; k<D; k++) {
+    indices[k] = rest%shape[k];
+    rest /= shape[k];
+  }
+  const size_t ncoeffs = coeffs.numberOfCoeffs();
+  for(size_t i=rank; i<ncoeffs; i+=stride) {
+    double bf_curr=1.0;
+    for(unsigned int k=0; k<D; k++) {
+      bf_curr*=values[k][indices[k]];
+    }
+    basisset_values[i] = bf_curr;
+    indices[0]+=stride;
+    for(unsigned int k=0; k+1<D; k++) {
+      while(indices[k]>=shape[k]) {indices[k]-=shape[k]; indices[k+1]++;}
+    }
+  }
+}
+
+
+template<unsigned int D>
+void LinearBasisSetExpansion::getBasisSetValuesBatchKernel(const std::vector< std::vector<double> >& bf_values, const std::vector<unsigned int>& nbasisf, const size_t ncoeffs, const size_t nsamples, std::vector<double>& basisset_values, const size_t rank, const size_t stride) {
+  size_t shape[D];
+  size_t indices[D];
+  for(unsigned int k=0; k<D; k++) {
+    shape[k] = nbasisf[k];
+    indices[k] = 0;
+  }
+  for(size_t i=0; i<ncoeffs; i++) {
+    if(i%stride==rank) {
+      const double* values[D];
+      for(unsigned int k=0; k<D; k++) {
+        values[k] = &bf_values[k][indices[k]*nsamples];
+      }
+      double* out = &basisset_values[i];
+      for(size_t s=0; s<nsamples; s++) {
+        double bf_curr=1.0;
+        for(unsigned int k=0; k<D; k++) {
+          bf_curr*=values[k][s];
+        }
+        out[ncoeffs*s] = bf_curr;
+      }
+    }
+    for(unsigned int k=0; k<D; k++) {
+      indices[k]++;
+      if(indices[k]<shape[k]) {break;}
+      indices[k]=0;
+    }
+  }
+}
+
+
 double LinearBasisSetExpansion::getBiasAndForces(const std::vector<double>& args_values, bool& all_inside, std::vector<double>& forces, std::vector<double>& coeffsderivs_values, std::vector<BasisFunctions*>& basisf_pntrs_in, CoeffsVector* coeffs_pntr_in, Communicator* comm_in) {
+  Workspace workspace;
+  workspace.setup(basisf_pntrs_in,coeffs_pntr_in->numberOfCoeffs());
+  return getBiasAndForces(args_values,all_inside,forces,coeffsderivs_values,basisf_pntrs_in,coeffs_pntr_in,comm_in,workspace);
+}
+
+
+double LinearBasisSetExpansion::getBiasAndForces(const std::vector<double>& args_values, bool& all_inside, std::vector<double>& forces, std::vector<double>& coeffsderivs_values, std::vector<BasisFunctions*>& basisf_pntrs_in, CoeffsVector* coeffs_pntr_in, Communicator* comm_in, Workspace& ws) {
   unsigned int nargs = args_values.size();
   plumed_assert(coeffs_pntr_in->numberOfDimensions()==nargs);
   plumed_assert(basisf_pntrs_in.size()==nargs);
   plumed_assert(forces.size()==nargs);
   plumed_assert(coeffsderivs_values.size()==coeffs_pntr_in->numberOfCoeffs());
+  plumed_dbg_assert(ws.bf_values.size()==nargs);
 
-  std::vector<double> args_values_trsfrm(nargs);
-  // std::vector<bool>   inside_interval(nargs,true);
   all_inside = true;
   //
-  std::vector< std::vector <double> > bf_values(nargs);
-  std::vector< std::vector <double> > bf_derivs(nargs);
+  std::vector< std::vector <double> >& bf_values = ws.bf_values;
+  std::vector< std::vector <double> >& bf_derivs = ws.bf_derivs;
+  std::vector<unsigned int>& indices = ws.indices;
   //
   for(unsigned int k=0; k<nargs; k++) {
-    bf_values[k].assign(basisf_pntrs_in[k]->getNumberOfBasisFunctions(),0.0);
-    bf_derivs[k].assign(basisf_pntrs_in[k]->getNumberOfBasisFunctions(),0.0);
+    std::fill(bf_values[k].begin(),bf_values[k].end(),0.0);
+    std::fill(bf_derivs[k].begin(),bf_derivs[k].end(),0.0);
     bool curr_inside=true;
-    basisf_pntrs_in[k]->getAllValues(args_values[k],args_values_trsfrm[k],curr_inside,bf_values[k],bf_derivs[k]);
-    // inside_interval[k]=curr_inside;
+    basisf_pntrs_in[k]->getAllValues(args_values[k],ws.args_values_trsfrm[k],curr_inside,bf_values[k],bf_derivs[k]);
     if(!curr_inside) {all_inside=false;}
     forces[k]=0.0;
   }
@@ -398,17 +709,94 @@ double LinearBasisSetExpansion::getBiasAndForces(const std::vector<double>& args
     stride=comm_in->Get_size();
     rank=comm_in->Get_rank();
   }
-  // loop over coeffs
   double bias=0.0;
-  for(size_t i=rank; i<coeffs_pntr_in->numberOfCoeffs(); i+=stride) {
-    std::vector<unsigned int> indices=coeffs_pntr_in->getIndices(i);
+  switch(ws.fixed_nargs) {
+  case 1: bias = getBiasAndForcesKernel<1>(ws,*coeffs_pntr_in,forces,coeffsderivs_values,rank,stride); break;
+  case 2: bias = getBiasAndForcesKernel<2>(ws,*coeffs_pntr_in,forces,coeffsderivs_values,rank,stride); break;
+  case 3: bias = getBiasAndForcesKernel<3>(ws,*coeffs_pntr_in,forces,coeffsderivs_values,rank,stride); break;
+  default:
+    // loop over coeffs
+    for(size_t i=rank; i<coeffs_pntr_in->numberOfCoeffs(); i+=stride) {
+      coeffs_pntr_in->getIndices(i,indices);
+      double coeff = coeffs_pntr_in->getValue(i);
+      double bf_curr=1.0;
+      for(unsigned int k=0; k<nargs; k++) {
+        bf_curr*=bf_values[k][indices[k]];
+      }
+      bias+=coeff*bf_curr;
+      coeffsderivs_values[i] = bf_curr;
+      for(unsigned int k=0; k<nargs; k++) {
+        double der = 1.0;
+        for(unsigned int l=0; l<nargs; l++) {
+          if(l!=k) {der*=bf_values[l][indices[l]];}
+          else {der*=bf_derivs[l][indices[l]];}
+        }
+        forces[k]-=coeff*der;
+        // maybe faster but dangerous
+        // forces[k]-=coeff*bf_curr*(bf_derivs[k][indices[k]]/bf_values[k][indices[k]]);
+      }
+    }
+    break;
+  }
+  //
+  if(comm_in!=NULL) {
+    comm_in->Sum(bias);
+    comm_in->Sum(forces);
+  }
+  return bias;
+}
+
+
+double LinearBasisSetExpansion::getBiasAndForcesCompact(const std::vector<double>& args_values, bool& all_inside, std::vector<double>& forces, std::vector<double>& active_coeffsderivs_values, std::vector<size_t>& active_coeffs_indices, std::vector<BasisFunctions*>& basisf_pntrs_in, CoeffsVector* coeffs_pntr_in, Workspace& ws) {
+  unsigned int nargs = args_values.size();
+  plumed_assert(coeffs_pntr_in->numberOfDimensions()==nargs);
+  plumed_assert(basisf_pntrs_in.size()==nargs);
+  plumed_assert(forces.size()==nargs);
+  plumed_dbg_assert(ws.bf_values.size()==nargs);
+
+  all_inside = true;
+  //
+  std::vector< std::vector <double> >& bf_values = ws.bf_values;
+  std::vector< std::vector <double> >& bf_derivs = ws.bf_derivs;
+  std::vector<unsigned int>& indices = ws.indices;
+  std::vector<unsigned int>& position = ws.active_position;
+  //
+  size_t nactive = 1;
+  for(unsigned int k=0; k<nargs; k++) {
+    bool curr_inside=true;
+    basisf_pntrs_in[k]->getAllValues(args_values[k],ws.args_values_trsfrm[k],curr_inside,bf_values[k],bf_derivs[k]);
+    basisf_pntrs_in[k]->getActiveIndices(ws.args_values_trsfrm[k],ws.active_indices[k]);
+    if(!curr_inside) {all_inside=false;}
+    nactive *= ws.active_indices[k].size();
+    position[k]=0;
+    forces[k]=0.0;
+  }
+  active_coeffsderivs_values.resize(nactive);
+  active_coeffs_indices.resize(nactive);
+  //
+  switch(ws.fixed_nargs) {
+  case 1: return getBiasAndForcesCompactKernel<1>(ws,*coeffs_pntr_in,forces,active_coeffsderivs_values,active_coeffs_indices);
+  case 2: return getBiasAndForcesCompactKernel<2>(ws,*coeffs_pntr_in,forces,active_coeffsderivs_values,active_coeffs_indices);
+  case 3: return getBiasAndForcesCompactKernel<3>(ws,*coeffs_pntr_in,forces,active_coeffsderivs_values,active_coeffs_indices);
+  default: break;
+  }
+  //
+  // loop over the tensor product of the active basis functions of each argument,
+  // with the first argument running fastest as for the coefficients
+  double bias=0.0;
+  for(size_t a=0; a<nactive; a++) {
+    for(unsigned int k=0; k<nargs; k++) {
+      indices[k] = ws.active_indices[k][position[k]];
+    }
+    size_t i = coeffs_pntr_in->getIndex(indices);
     double coeff = coeffs_pntr_in->getValue(i);
     double bf_curr=1.0;
     for(unsigned int k=0; k<nargs; k++) {
       bf_curr*=bf_values[k][indices[k]];
     }
     bias+=coeff*bf_curr;
-    coeffsderivs_values[i] = bf_curr;
+    active_coeffsderivs_values[a] = bf_curr;
+    active_coeffs_indices[a] = i;
     for(unsigned int k=0; k<nargs; k++) {
       double der = 1.0;
       for(unsigned int l=0; l<nargs; l++) {
@@ -416,33 +804,143 @@ double LinearBasisSetExpansion::getBiasAndForces(const std::vector<double>& args
         else {der*=bf_derivs[l][indices[l]];}
       }
       forces[k]-=coeff*der;
-      // maybe faster but dangerous
-      // forces[k]-=coeff*bf_curr*(bf_derivs[k][indices[k]]/bf_values[k][indices[k]]);
+    }
+    for(unsigned int k=0; k<nargs; k++) {
+      position[k]++;
+      if(position[k]<ws.active_indices[k].size()) {break;}
+      position[k]=0;
     }
   }
+  return bias;
+}
+
+
+double LinearBasisSetExpansion::getBiasAndForcesFactorized(const std::vector<double>& args_values, bool& all_inside, std::vector<double>& forces, std::vector<double>& coeffsderivs_values, std::vector<BasisFunctions*>& basisf_pntrs_in, CoeffsVector* coeffs_pntr_in, Communicator* comm_in) {
+  Workspace workspace;
+  workspace.setup(basisf_pntrs_in,coeffs_pntr_in->numberOfCoeffs());
+  return getBiasAndForcesFactorized(args_values,all_inside,forces,coeffsderivs_values,basisf_pntrs_in,coeffs_pntr_in,comm_in,workspace);
+}
+
+
+double LinearBasisSetExpansion::getBiasAndForcesFactorized(const std::vector<double>& args_values, bool& all_inside, std::vector<double>& forces, std::vector<double>& coeffsderivs_values, std::vector<BasisFunctions*>& basisf_pntrs_in, CoeffsVector* coeffs_pntr_in, Communicator* comm_in, Workspace& ws) {
+  unsigned int nargs = args_values.size();
+  plumed_assert(coeffs_pntr_in->numberOfDimensions()==nargs);
+  plumed_assert(basisf_pntrs_in.size()==nargs);
+  plumed_assert(forces.size()==nargs);
+  plumed_assert(coeffsderivs_values.size()==coeffs_pntr_in->numberOfCoeffs());
+  plumed_dbg_assert(ws.bf_values.size()==nargs);
+
+  all_inside = true;
+  //
+  std::vector< std::vector <double> >& bf_values = ws.bf_values;
+  std::vector< std::vector <double> >& bf_derivs = ws.bf_derivs;
+  //
+  for(unsigned int k=0; k<nargs; k++) {
+    std::fill(bf_values[k].begin(),bf_values[k].end(),0.0);
+    std::fill(bf_derivs[k].begin(),bf_derivs[k].end(),0.0);
+    bool curr_inside=true;
+    basisf_pntrs_in[k]->getAllValues(args_values[k],ws.args_values_trsfrm[k],curr_inside,bf_values[k],bf_derivs[k]);
+    if(!curr_inside) {all_inside=false;}
+    forces[k]=0.0;
+  }
+  //
+  // The coefficients are stored in column-major order (see CoeffsBase), i.e.
+  // the first dimension runs fastest. The coefficients are split into slabs
+  // along the last dimension and each slab is contracted with the basis
+  // functions one dimension at a time. Channel 0 of the work arrays holds the
+  // contraction with the values, channel k+1 the one where the derivatives
+  // are used along dimension k.
+  unsigned int last = nargs-1;
+  size_t nslabs = bf_values[last].size();
+  size_t slab_size = coeffs_pntr_in->numberOfCoeffs()/nslabs;
+  plumed_dbg_assert(ws.work_even.size()>=(nargs>1 ? nargs*(slab_size/bf_values[0].size()) : 0));
+  const double* coeffs = &(*coeffs_pntr_in)[0];
+  //
+  size_t stride=1;
+  size_t rank=0;
+  if(comm_in!=NULL)
+  {
+    stride=comm_in->Get_size();
+    rank=comm_in->Get_rank();
+  }
+  // loop over slabs
+  double bias=0.0;
+  for(size_t s=rank; s<nslabs; s+=stride) {
+    const double* src = coeffs + s*slab_size;
+    size_t m = slab_size;
+    unsigned int nchannels = 1;
+    for(unsigned int k=0; k<last; k++) {
+      const double* values = &bf_values[k][0];
+      const double* derivs = &bf_derivs[k][0];
+      size_t nk = bf_values[k].size();
+      size_t mout = m/nk;
+      double* dst = (k%2==0) ? &ws.work_even[0] : &ws.work_odd[0];
+      for(unsigned int c=0; c<nchannels; c++) {
+        const double* in = src + c*m;
+        double* out = dst + c*mout;
+        for(size_t j=0; j<mout; j++) {
+          double sum=0.0;
+          for(size_t i=0; i<nk; i++) {sum+=in[j*nk+i]*values[i];}
+          out[j]=sum;
+        }
+      }
+      // new channel with the derivatives along dimension k
+      double* out = dst + nchannels*mout;
+      for(size_t j=0; j<mout; j++) {
+        double sum=0.0;
+        for(size_t i=0; i<nk; i++) {sum+=src[j*nk+i]*derivs[i];}
+        out[j]=sum;
+      }
+      src = dst;
+      m = mout;
+      nchannels++;
+    }
+    bias += src[0]*bf_values[last][s];
+    for(unsigned int k=0; k<last; k++) {
+      forces[k] -= src[k+1]*bf_values[last][s];
+    }
+    forces[last] -= src[0]*bf_derivs[last][s];
+  }
   //
   if(comm_in!=NULL) {
     comm_in->Sum(bias);
     comm_in->Sum(forces);
   }
+  // the coefficient derivatives are the outer product of the basis function
+  // values, built in place one dimension at a time
+  std::copy(bf_values[0].begin(),bf_values[0].end(),coeffsderivs_values.begin());
+  size_t block = bf_values[0].size();
+  for(unsigned int k=1; k<nargs; k++) {
+    for(size_t i=bf_values[k].size(); i-- > 0;) {
+      double value = bf_values[k][i];
+      double* out = &coeffsderivs_values[i*block];
+      for(size_t j=0; j<block; j++) {out[j] = coeffsderivs_values[j]*value;}
+    }
+    block *= bf_values[k].size();
+  }
   return bias;
 }
 
 
 void LinearBasisSetExpansion::getBasisSetValues(const std::vector<double>& args_values, std::vector<double>& basisset_values, std::vector<BasisFunctions*>& basisf_pntrs_in, CoeffsVector* coeffs_pntr_in, Communicator* comm_in) {
+  Workspace workspace;
+  workspace.setup(basisf_pntrs_in,coeffs_pntr_in->numberOfCoeffs());
+  getBasisSetValues(args_values,basisset_values,basisf_pntrs_in,coeffs_pntr_in,comm_in,workspace);
+}
+
+
+void LinearBasisSetExpansion::getBasisSetValues(const std::vector<double>& args_values, std::vector<double>& basisset_values, std::vector<BasisFunctions*>& basisf_pntrs_in, CoeffsVector* coeffs_pntr_in, Communicator* comm_in, Workspace& ws) {
   unsigned int nargs = args_values.size();
   plumed_assert(coeffs_pntr_in->numberOfDimensions()==nargs);
   plumed_assert(basisf_pntrs_in.size()==nargs);
+  plumed_dbg_assert(ws.bf_values.size()==nargs);
 
-  std::vector<double> args_values_trsfrm(nargs);
-  std::vector< std::vector <double> > bf_values;
+  std::vector< std::vector <double> >& bf_values = ws.bf_values;
+  std::vector<unsigned int>& indices = ws.indices;
   //
   for(unsigned int k=0; k<nargs; k++) {
-    std::vector<double> tmp_val(basisf_pntrs_in[k]->getNumberOfBasisFunctions());
-    std::vector<double> tmp_der(tmp_val.size());
     bool inside=true;
-    basisf_pntrs_in[k]->getAllValues(args_values[k],args_values_trsfrm[k],inside,tmp_val,tmp_der);
-    bf_values.push_back(tmp_val);
+    basisf_pntrs_in[k]->getAllValues(args_values[k],ws.args_values_trsfrm[k],inside,bf_values[k],ws.bf_derivs[k]);
   }
   //
   size_t stride=1;
@@ -452,14 +950,21 @@ void LinearBasisSetExpansion::getBasisSetValues(const std::vector<double>& args_
     stride=comm_in->Get_size();
     rank=comm_in->Get_rank();
   }
-  // loop over basis set
-  for(size_t i=rank; i<coeffs_pntr_in->numberOfCoeffs(); i+=stride) {
-    std::vector<unsigned int> indices=coeffs_pntr_in->getIndices(i);
-    double bf_curr=1.0;
-    for(unsigned int k=0; k<nargs; k++) {
-      bf_curr*=bf_values[k][indices[k]];
+  switch(ws.fixed_nargs) {
+  case 1: getBasisSetValuesKernel<1>(ws,*coeffs_pntr_in,basisset_values,rank,stride); break;
+  case 2: getBasisSetValuesKernel<2>(ws,*coeffs_pntr_in,basisset_values,rank,stride); break;
+  case 3: getBasisSetValuesKernel<3>(ws,*coeffs_pntr_in,basisset_values,rank,stride); break;
+  default:
+    // loop over basis set
+    for(size_t i=rank; i<coeffs_pntr_in->numberOfCoeffs(); i+=stride) {
+      coeffs_pntr_in->getIndices(i,indices);
+      double bf_curr=1.0;
+      for(unsigned int k=0; k<nargs; k++) {
+        bf_curr*=bf_values[k][indices[k]];
+      }
+      basisset_values[i] = bf_curr;
     }
-    basisset_values[i] = bf_curr;
+    break;
   }
   //
   if(comm_in!=NULL) {
@@ -468,6 +973,105 @@ void LinearBasisSetExpansion::getBasisSetValues(const std::vector<double>& args_
 }
 
 
+void LinearBasisSetExpansion::getBasisSetValuesBatch(const size_t nsamples, const std::vector<double>& args_values, std::vector<double>& basisset_values, const bool all_values) {
+  plumed_assert(args_values.size()>=nargs_*nsamples);
+  plumed_assert(basisset_values.size()>=ncoeffs_*nsamples);
+  if(nsamples==0) {return;}
+  if(nsamples>batch_capacity_) {
+    batch_capacity_ = nsamples;
+    batch_bf_values_.resize(nargs_);
+    size_t nbasisf_max = 0;
+    for(unsigned int k=0; k<nargs_; k++) {
+      batch_bf_values_[k].resize(nbasisf_[k]*batch_capacity_);
+      nbasisf_max = std::max(nbasisf_max,static_cast<size_t>(nbasisf_[k]));
+    }
+    batch_bf_derivs_.resize(nbasisf_max*batch_capacity_);
+    batch_args_.resize(batch_capacity_);
+    batch_args_trsfrm_.resize(batch_capacity_);
+    batch_inside_.reset(new bool[batch_capacity_]);
+  }
+  // the one-dimensional basis functions are evaluated for all the samples at once,
+  // stored as bf_values[k][n*nsamples+s] for basis function n of argument k
+  const std::vector< std::vector<double> >& bf_values = batch_bf_values_;
+  for(unsigned int k=0; k<nargs_; k++) {
+    for(size_t s=0; s<nsamples; s++) {batch_args_[s] = args_values[k+nargs_*s];}
+    basisf_pntrs_[k]->getAllValuesBatch(nsamples,&batch_args_[0],&batch_args_trsfrm_[0],batch_inside_.get(),&batch_bf_values_[k][0],&batch_bf_derivs_[0]);
+  }
+  //
+  size_t stride=1;
+  size_t rank=0;
+  if(!serial_) {
+    stride=mycomm_.Get_size();
+    rank=mycomm_.Get_rank();
+  }
+  if(stride>1 && all_values) {
+    std::fill(basisset_values.begin(),basisset_values.begin()+ncoeffs_*nsamples,0.0);
+  }
+  switch(workspace_.fixed_nargs) {
+  case 1: getBasisSetValuesBatchKernel<1>(bf_values,nbasisf_,ncoeffs_,nsamples,basisset_values,rank,stride); break;
+  case 2: getBasisSetValuesBatchKernel<2>(bf_values,nbasisf_,ncoeffs_,nsamples,basisset_values,rank,stride); break;
+  case 3: getBasisSetValuesBatchKernel<3>(bf_values,nbasisf_,ncoeffs_,nsamples,basisset_values,rank,stride); break;
+  default:
+    std::vector<unsigned int>& indices = workspace_.indices;
+    for(size_t i=rank; i<ncoeffs_; i+=stride) {
+      bias_coeffs_pntr_->getIndices(i,indices);
+      for(size_t s=0; s<nsamples; s++) {
+        double bf_curr=1.0;
+        for(unsigned int k=0; k<nargs_; k++) {
+          bf_curr*=bf_values[k][indices[k]*nsamples+s];
+        }
+        basisset_values[i+ncoeffs_*s] = bf_curr;
+      }
+    }
+    break;
+  }
+  //
+  if(stride>1 && all_values) {
+    mycomm_.Sum(&basisset_values[0],ncoeffs_*nsamples);
+  }
+}
+
+
+void LinearBasisSetExpansion::getBiasAndForcesBatch(const size_t nsamples, const std::vector<double>& args_values, std::vector<double>& bias_values, std::vector<double>& forces) {
+  plumed_assert(args_values.size()>=nargs_*nsamples);
+  plumed_assert(bias_values.size()>=nsamples);
+  plumed_assert(forces.size()>=nargs_*nsamples);
+  // each thread uses its own workspace, the coefficients are not split
+  // between the MPI processes as the samples already split the work.
+  // The number of threads can change between calls, so the workspaces
+  // are added when more threads are used than before
+  const unsigned int nthreads = OpenMP::getNumThreads();
+  if(thread_workspaces_.size()<nthreads) {
+    size_t nsetup = thread_workspaces_.size();
+    thread_workspaces_.resize(nthreads);
+    for(size_t t=nsetup; t<nthreads; t++) {
+      thread_workspaces_[t].setup(basisf_pntrs_,ncoeffs_);
+    }
+  }
+  #pragma omp parallel num_threads(nthreads)
+  {
+    Workspace& ws = thread_workspaces_[OpenMP::getThreadNum()];
+    std::vector<double>& args = ws.args_values;
+    std::vector<double>& forces_tmp = ws.forces_dummy;
+    #pragma omp for
+    for(size_t s=0; s<nsamples; s++) {
+      for(unsigned int k=0; k<nargs_; k++) {args[k] = args_values[k+nargs_*s];}
+      bool all_inside=true;
+      if(compact_support_) {
+        bias_values[s] = getBiasAndForcesCompact(args,all_inside,forces_tmp,ws.active_coeffsderivs_values,ws.active_coeffs_indices,basisf_pntrs_,bias_coeffs_pntr_,ws);
+      }
+      else if(factorized_evaluation_) {
+        bias_values[s] = getBiasAndForcesFactorized(args,all_inside,forces_tmp,ws.coeffsderivs_values_dummy,basisf_pntrs_,bias_coeffs_pntr_,NULL,ws);
+      }
+      else {
+        bias_values[s] = getBiasAndForces(args,all_inside,forces_tmp,ws.coeffsderivs_values_dummy,basisf_pntrs_,bias_coeffs_pntr_,NULL,ws);
+      }
+      for(unsigned int k=0; k<nargs_; k++) {forces[k+nargs_*s] = forces_tmp[k];}
+    }
+  }
+}
+
+
 void LinearBasisSetExpansion::setupUniformTargetDistribution() {
   std::vector< std::vector <double> > bf_integrals(0);
   std::vector<double> targetdist_averages(ncoeffs_,0.0);
@@ -543,27 +1147,140 @@ void LinearBasisSetExpansion::restartTargetDistribution() {
 
 
 void LinearBasisSetExpansion::calculateTargetDistAveragesFromGrid(const Grid* targetdist_grid_pntr) {
+  // the averages are given by contracting the target distribution, times the
+  // integration weights, with the basis functions on the grid axes
   plumed_assert(targetdist_grid_pntr!=NULL);
-  std::vector<double> targetdist_averages(ncoeffs_,0.0);
-  std::vector<double> integration_weights = GridIntegrationWeights::getIntegrationWeights(targetdist_grid_pntr);
-  Grid::index_t stride=mycomm_.Get_size();
-  Grid::index_t rank=mycomm_.Get_rank();
-  for(Grid::index_t l=rank; l<targetdist_grid_pntr->getSize(); l+=stride) {
-    std::vector<double> args_values = targetdist_grid_pntr->getPoint(l);
-    std::vector<double> basisset_values(ncoeffs_);
-    getBasisSetValues(args_values,basisset_values,false);
-    double weight = integration_weights[l]*targetdist_grid_pntr->getValue(l);
-    for(unsigned int i=0; i<ncoeffs_; i++) {
-      targetdist_averages[i] += weight*basisset_values[i];
-    }
-  }
-  mycomm_.Sum(targetdist_averages);
+  setupBasisSetOnGrid(targetdist_grid_pntr);
+  std::vector<double> integration_weights;
+  if(targetdist_grid_pntr==targetdist_grid_pntr_) {
+    integration_weights = targetdist_pntr_->getTargetDistGridIntegrationWeights();
+  }
+  else {
+    integration_weights = GridIntegrationWeights::getIntegrationWeights(targetdist_grid_pntr);
+  }
+  std::vector<double> targetdist_averages(targetdist_grid_pntr->getSize());
+  for(Grid::index_t l=0; l<targetdist_grid_pntr->getSize(); l++) {
+    targetdist_averages[l] = integration_weights[l]*targetdist_grid_pntr->getValue(l);
+  }
+  contractGridToCoeffs(targetdist_averages);
   // the overall constant;
   targetdist_averages[0] = 1.0;
   TargetDistAverages() = targetdist_averages;
 }
 
 
+void LinearBasisSetExpansion::setupBasisSetOnGrid(const Grid* grid_pntr) {
+  BasisSetOnGrid& bsog = basisset_on_grid_;
+  plumed_massert(grid_pntr->getDimension()==nargs_,"the dimension of the grid does not match the number of arguments");
+  // all the grids of the expansion are the same so the values are usually reused
+  if(bsog.npoints==grid_pntr->getNbin() && bsog.grid_min==grid_pntr->getMin() && bsog.grid_max==grid_pntr->getMax()) {
+    return;
+  }
+  bsog.npoints = grid_pntr->getNbin();
+  bsog.grid_min = grid_pntr->getMin();
+  bsog.grid_max = grid_pntr->getMax();
+  bsog.values.assign(nargs_,std::vector<double>(0));
+  bsog.derivs.assign(nargs_,std::vector<double>(0));
+  //
+  std::vector<unsigned int> indices(nargs_,0);
+  std::vector<double> point(nargs_);
+  for(unsigned int k=0; k<nargs_; k++) {
+    unsigned int nbf = nbasisf_[k];
+    bsog.values[k].assign(nbf*bsog.npoints[k],0.0);
+    bsog.derivs[k].assign(nbf*bsog.npoints[k],0.0);
+    std::vector<double> bf_values(nbf);
+    std::vector<double> bf_derivs(nbf);
+    for(unsigned int p=0; p<bsog.npoints[k]; p++) {
+      indices.assign(nargs_,0);
+      indices[k] = p;
+      grid_pntr->getPoint(indices,point);
+      double argT;
+      bool inside=true;
+      basisf_pntrs_[k]->getAllValues(point[k],argT,inside,bf_values,bf_derivs);
+      std::copy(bf_values.begin(),bf_values.end(),bsog.values[k].begin()+nbf*p);
+      std::copy(bf_derivs.begin(),bf_derivs.end(),bsog.derivs[k].begin()+nbf*p);
+    }
+  }
+}
+
+
+void LinearBasisSetExpansion::contractGridAxis(const std::vector<double>& input, std::vector<double>& output, const size_t nbefore, const size_t ninput, const size_t noutput, const size_t nafter, const std::vector<double>& matrix, const bool to_grid) {
+  // Contracts the middle index of the input tensor of shape (nbefore,ninput,nafter),
+  // the first index running fastest, with the matrix of basis function values.
+  // From coefficients to grid points (to_grid) the matrix is used as it is
+  // stored, that is of shape (ninput,noutput), otherwise it is transposed.
+  // The slices along nafter, and if there are too few of them also blocks of
+  // rows along nbefore, are split over the MPI ranks and the OpenMP threads.
+  unsigned int stride = 1;
+  unsigned int rank = 0;
+  if(!serial_) {
+    stride = mycomm_.Get_size();
+    rank = mycomm_.Get_rank();
+  }
+  if(stride>1) {output.assign(nbefore*noutput*nafter,0.0);}
+  else {output.resize(nbefore*noutput*nafter);}
+  const size_t nworkers = stride*OpenMP::getNumThreads();
+  size_t nrowblocks = 1;
+  if(nafter<nworkers) {nrowblocks = std::min(nbefore,(nworkers+nafter-1)/nafter);}
+  const size_t rowblock_size = (nbefore+nrowblocks-1)/nrowblocks;
+  nrowblocks = (nbefore+rowblock_size-1)/rowblock_size;
+  const size_t ntasks = nafter*nrowblocks;
+  const int nlocal = ntasks>rank ? static_cast<int>((ntasks-rank+stride-1)/stride) : 0;
+  //
+  int lda = static_cast<int>(nbefore);
+  int n = static_cast<int>(noutput);
+  int k = static_cast<int>(ninput);
+  int ldb = to_grid ? k : n;
+  double alpha = 1.0;
+  double beta = 0.0;
+  const char* transb = to_grid ? "N" : "T";
+  double* matrix_pntr = const_cast<double*>(matrix.data());
+  #pragma omp parallel for num_threads(OpenMP::getNumThreads())
+  for(int t=0; t<nlocal; t++) {
+    size_t task = rank+static_cast<size_t>(t)*stride;
+    size_t j = task/nrowblocks;
+    size_t row = (task%nrowblocks)*rowblock_size;
+    int m = static_cast<int>(std::min(rowblock_size,nbefore-row));
+    double* input_pntr = const_cast<double*>(input.data())+nbefore*ninput*j+row;
+    double* output_pntr = output.data()+nbefore*noutput*j+row;
+    plumed_blas_dgemm("N",transb,&m,&n,&k,&alpha,input_pntr,&lda,matrix_pntr,&ldb,&beta,output_pntr,&lda);
+  }
+  if(stride>1) {mycomm_.Sum(output);}
+}
+
+
+void LinearBasisSetExpansion::contractCoeffsToGrid(std::vector<double>& values, const unsigned int deriv_dim) {
+  // on input the coefficients, on output the values on the grid, using the
+  // derivatives of the basis functions for the axis deriv_dim
+  BasisSetOnGrid& bsog = basisset_on_grid_;
+  plumed_assert(values.size()==ncoeffs_);
+  size_t nbefore = 1;
+  size_t nafter = ncoeffs_;
+  for(unsigned int k=0; k<nargs_; k++) {
+    nafter /= nbasisf_[k];
+    const std::vector<double>& matrix = (k==deriv_dim) ? bsog.derivs[k] : bsog.values[k];
+    contractGridAxis(values,bsog.work,nbefore,nbasisf_[k],bsog.npoints[k],nafter,matrix,true);
+    values.swap(bsog.work);
+    nbefore *= bsog.npoints[k];
+  }
+}
+
+
+void LinearBasisSetExpansion::contractGridToCoeffs(std::vector<double>& values) {
+  // on input values on the grid, on output their projection on each basis function
+  BasisSetOnGrid& bsog = basisset_on_grid_;
+  size_t nbefore = 1;
+  size_t nafter = values.size();
+  for(unsigned int k=0; k<nargs_; k++) {
+    nafter /= bsog.npoints[k];
+    contractGridAxis(values,bsog.work,nbefore,bsog.npoints[k],nbasisf_[k],nafter,bsog.values[k],false);
+    values.swap(bsog.work);
+    nbefore *= nbasisf_[k];
+  }
+  plumed_assert(values.size()==ncoeffs_);
+}
+
+
 void LinearBasisSetExpansion::setBiasMinimumToZero() {
   plumed_massert(bias_grid_pntr_!=NULL,"setBiasMinimumToZero can only be used if the bias grid is defined");
   updateBiasGrid();
@@ -588,7 +1305,7 @@ double LinearBasisSetExpansion::calculateReweightFactor() const {
   plumed_massert(targetdist_grid_pntr_!=NULL,"calculateReweightFactor only be used if the target distribution grid is defined");
   plumed_massert(bias_grid_pntr_!=NULL,"calculateReweightFactor only be used if the bias grid is defined");
   double sum = 0.0;
-  std::vector<double> integration_weights = GridIntegrationWeights::getIntegrationWeights(targetdist_grid_pntr_);
+  const std::vector<double>& integration_weights = targetdist_pntr_->getTargetDistGridIntegrationWeights();
   //
   for(Grid::index_t l=0; l<targetdist_grid_pntr_->getSize(); l++) {
     sum += integration_weights[l] * targetdist_grid_pntr_->getValue(l) * exp(+beta_*bias_grid_pntr_->getValue(l));
@@ -24,6 +24,8 @@
 
 #include <vector>
 #include <string>
+#include <algorithm>
+#include <memory>
 
 
 namespace PLMD {
@@ -45,6 +47,43 @@ class VesBias;
 
 
 class LinearBasisSetExpansion {
+public:
+  // scratch arrays used when evaluating the expansion, kept between calls
+  // such that no memory is allocated when the bias is evaluated in the MD loop
+  struct Workspace {
+    std::vector<double> args_values_trsfrm;
+    // arguments of a single sample in getBiasAndForcesBatch()
+    std::vector<double> args_values;
+    std::vector< std::vector<double> > bf_values;
+    std::vector< std::vector<double> > bf_derivs;
+    std::vector<unsigned int> indices;
+    std::vector<double> work_even;
+    std::vector<double> work_odd;
+    std::vector<double> forces_dummy;
+    std::vector<double> coeffsderivs_values_dummy;
+    // active basis functions of each argument and the resulting active coefficients,
+    // used for basis functions with compact support
+    std::vector< std::vector<unsigned int> > active_indices;
+    std::vector<unsigned int> active_position;
+    std::vector<double> active_coeffsderivs_values;
+    std::vector<size_t> active_coeffs_indices;
+    // number of arguments of the specialized kernels used for the loops over
+    // the coefficients (1, 2 or 3), zero if the generic loops are used
+    unsigned int fixed_nargs;
+    void setup(const std::vector<BasisFunctions*>&, const size_t);
+  };
+  // values and derivatives of the basis functions on the points of each axis
+  // of a grid, stored as values[k][n+nbasisf[k]*p] for basis function n and
+  // grid point p along axis k, such that quantities on the full grid can be
+  // obtained through one tensor contraction per axis
+  struct BasisSetOnGrid {
+    std::vector<std::string> grid_min;
+    std::vector<std::string> grid_max;
+    std::vector<unsigned int> npoints;
+    std::vector< std::vector<double> > values;
+    std::vector< std::vector<double> > derivs;
+    std::vector<double> work;
+  };
 private:
   std::string label_;
   //
@@ -52,6 +91,8 @@ private:
   VesBias* vesbias_pntr_;
   Communicator& mycomm_;
   bool serial_;
+  bool factorized_evaluation_;
+  bool compact_support_;
   //
   double beta_;
   double kbt_;
@@ -81,8 +122,24 @@ private:
   Grid* fes_grid_pntr_;
   Grid* log_targetdist_grid_pntr_;
   Grid* targetdist_grid_pntr_;
+  // grid from which the bias and forces are interpolated, stores the derivatives of the bias
+  Grid* bias_interpolation_grid_pntr_;
+  bool bias_interpolation_linear_;
   //
   TargetDistribution* targetdist_pntr_;
+  //
+  BasisSetOnGrid basisset_on_grid_;
+  //
+  Workspace workspace_;
+  // one workspace for each OpenMP thread, set up by getBiasAndForcesBatch()
+  std::vector<Workspace> thread_workspaces_;
+  // buffers of getBasisSetValuesBatch(), grown to the largest batch
+  size_t batch_capacity_;
+  std::vector< std::vector<double> > batch_bf_values_;
+  std::vector<double> batch_bf_derivs_;
+  std::vector<double> batch_args_;
+  std::vector<double> batch_args_trsfrm_;
+  std::unique_ptr<bool[]> batch_inside_;
 public:
   static void registerKeywords( Keywords& keys );
   // Constructor
@@ -115,16 +172,45 @@ public:
   void setSerial() {serial_=true;}
   void setParallel() {serial_=false;}
   //
+  void enableFactorizedEvaluation() {factorized_evaluation_=true;}
+  void disableFactorizedEvaluation() {factorized_evaluation_=false;}
+  bool factorizedEvaluation() const {return factorized_evaluation_;}
+  // if all the basis functions have compact support only a small block of the coefficients
+  // is active at any argument, see getBiasAndForcesCompact()
+  bool compactSupport() const {return compact_support_;}
+  //
   void linkVesBias(VesBias*);
   void linkAction(Action*);
   // calculate bias and derivatives
   static double getBiasAndForces(const std::vector<double>&, bool&, std::vector<double>&, std::vector<double>&, std::vector<BasisFunctions*>&, CoeffsVector*, Communicator* comm_in=NULL);
+  static double getBiasAndForces(const std::vector<double>&, bool&, std::vector<double>&, std::vector<double>&, std::vector<BasisFunctions*>&, CoeffsVector*, Communicator*, Workspace&);
+  // same as above but contracts the coefficients one dimension at a time, O(ncoeffs) work in total
+  static double getBiasAndForcesFactorized(const std::vector<double>&, bool&, std::vector<double>&, std::vector<double>&, std::vector<BasisFunctions*>&, CoeffsVector*, Communicator* comm_in=NULL);
+  static double getBiasAndForcesFactorized(const std::vector<double>&, bool&, std::vector<double>&, std::vector<double>&, std::vector<BasisFunctions*>&, CoeffsVector*, Communicator*, Workspace&);
+  // only loops over the coefficients that are active for basis functions with compact support, the derivatives
+  // with respect to the active coefficients and their indices are returned, all the others are zero
+  static double getBiasAndForcesCompact(const std::vector<double>&, bool&, std::vector<double>&, std::vector<double>&, std::vector<size_t>&, std::vector<BasisFunctions*>&, CoeffsVector*, Workspace&);
+  double getBiasAndForcesCompact(const std::vector<double>&, bool&, std::vector<double>&, std::vector<double>&, std::vector<size_t>&);
   double getBiasAndForces(const std::vector<double>&, bool&, std::vector<double>&, std::vector<double>&);
   double getBiasAndForces(const std::vector<double>&, bool&, std::vector<double>&);
   double getBias(const std::vector<double>&, bool&, const bool parallel=true);
+  // bias and forces for several arguments at once, the arguments of sample s are given as args[k+nargs*s]
+  // and the forces stored as forces[k+nargs*s], the samples are split between the OpenMP threads
+  void getBiasAndForcesBatch(const size_t, const std::vector<double>&, std::vector<double>&, std::vector<double>&);
   //
   static void getBasisSetValues(const std::vector<double>&, std::vector<double>&, std::vector<BasisFunctions*>&, CoeffsVector*, Communicator* comm_in=NULL);
+  static void getBasisSetValues(const std::vector<double>&, std::vector<double>&, std::vector<BasisFunctions*>&, CoeffsVector*, Communicator*, Workspace&);
   void getBasisSetValues(const std::vector<double>&, std::vector<double>&, const bool parallel=true);
+  // basis set values for several arguments at once, the arguments of sample s are given as args[k+nargs*s]
+  // and the values are stored as values[i+ncoeffs*s]. The coefficients are split between the MPI
+  // processes as for a single sample, if all_values is false the values of the coefficients of the
+  // other processes are not summed and should not be used
+  void getBasisSetValuesBatch(const size_t, const std::vector<double>&, std::vector<double>&, const bool all_values=true);
+  // bias and forces interpolated from a grid (spline or linear) that needs to be updated when the coefficients change
+  void setupBiasInterpolationGrid(const bool linear_interpolation=false);
+  void updateBiasInterpolationGrid();
+  bool biasInterpolationActive() const {return bias_interpolation_grid_pntr_!=NULL;}
+  double getBiasAndForcesFromInterpolationGrid(const std::vector<double>&, bool&, std::vector<double>&);
   // Bias grid and output stuff
   void setupBiasGrid(const bool usederiv=false);
   void updateBiasGrid();
@@ -180,50 +266,85 @@ public:
 private:
   //
   Grid* setupGeneralGrid(const std::string&, const bool usederiv=false);
+  void calculateBiasOnGrid(Grid*, const bool apply_bias_cutoff=false);
   //
   void calculateTargetDistAveragesFromGrid(const Grid*);
   //
+  void setupBasisSetOnGrid(const Grid*);
+  void contractGridAxis(const std::vector<double>&, std::vector<double>&, const size_t, const size_t, const size_t, const size_t, const std::vector<double>&, const bool);
+  void contractCoeffsToGrid(std::vector<double>&, const unsigned int deriv_dim);
+  void contractGridToCoeffs(std::vector<double>&);
+  // loops over the coefficients for a fixed number of arguments D, with the
+  // indices kept in fixed-size arrays instead of using getIndices()
+  template<unsigned int D>
+  static double getBiasAndForcesKernel(const Workspace&, const CoeffsVector&, std::vector<double>&, std::vector<double>&, const size_t, const size_t);
+  template<unsigned int D>
+  static double getBiasAndForcesCompactKernel(const Workspace&, const CoeffsVector&, std::vector<double>&, std::vector<double>&, std::vector<size_t>&);
+  template<unsigned int D>
+  static void getBasisSetValuesKernel(const Workspace&, const CoeffsVector&, std::vector<double>&, const size_t, const size_t);
+  template<unsigned int D>
+  static void getBasisSetValuesBatchKernel(const std::vector< std::vector<double> >&, const std::vector<unsigned int>&, const size_t, const size_t, std::vector<double>&, const size_t, const size_t);
+  //
   bool isStaticTargetDistFileOutputActive() const;
 };
 
 
+inline
+double LinearBasisSetExpansion::getBiasAndForcesCompact(const std::vector<double>& args_values, bool& all_inside, std::vector<double>& forces, std::vector<double>& active_coeffsderivs_values, std::vector<size_t>& active_coeffs_indices) {
+  return getBiasAndForcesCompact(args_values,all_inside,forces,active_coeffsderivs_values,active_coeffs_indices,basisf_pntrs_,bias_coeffs_pntr_,workspace_);
+}
+
+
 inline
 double LinearBasisSetExpansion::getBiasAndForces(const std::vector<double>& args_values, bool& all_inside, std::vector<double>& forces, std::vector<double>& coeffsderivs_values) {
-  return getBiasAndForces(args_values,all_inside,forces,coeffsderivs_values,basisf_pntrs_, bias_coeffs_pntr_, &mycomm_);
+  if(compact_support_) {
+    double bias = getBiasAndForcesCompact(args_values,all_inside,forces,workspace_.active_coeffsderivs_values,workspace_.active_coeffs_indices);
+    std::fill(coeffsderivs_values.begin(),coeffsderivs_values.end(),0.0);
+    for(size_t a=0; a<workspace_.active_coeffs_indices.size(); a++) {
+      coeffsderivs_values[workspace_.active_coeffs_indices[a]] = workspace_.active_coeffsderivs_values[a];
+    }
+    return bias;
+  }
+  if(factorized_evaluation_) {
+    return getBiasAndForcesFactorized(args_values,all_inside,forces,coeffsderivs_values,basisf_pntrs_, bias_coeffs_pntr_, &mycomm_, workspace_);
+  }
+  return getBiasAndForces(args_values,all_inside,forces,coeffsderivs_values,basisf_pntrs_, bias_coeffs_pntr_, &mycomm_, workspace_);
 }
 
 
 inline
 double LinearBasisSetExpansion::getBiasAndForces(const std::vector<double>& args_values, bool& all_inside, std::vector<double>& forces) {
-  std::vector<double> coeffsderivs_values_dummy(ncoeffs_);
-  return getBiasAndForces(args_values,all_inside,forces,coeffsderivs_values_dummy,basisf_pntrs_, bias_coeffs_pntr_, &mycomm_);
+  if(compact_support_) {
+    return getBiasAndForcesCompact(args_values,all_inside,forces,workspace_.active_coeffsderivs_values,workspace_.active_coeffs_indices);
+  }
+  return getBiasAndForces(args_values,all_inside,forces,workspace_.coeffsderivs_values_dummy);
 }
 
 
 inline
 double LinearBasisSetExpansion::getBias(const std::vector<double>& args_values, bool& all_inside, const bool parallel) {
-  std::vector<double> forces_dummy(nargs_);
-  std::vector<double> coeffsderivs_values_dummy(ncoeffs_);
-  if(parallel) {
-    return getBiasAndForces(args_values,all_inside,forces_dummy,coeffsderivs_values_dummy,basisf_pntrs_, bias_coeffs_pntr_, &mycomm_);
+  Communicator* comm_pntr = NULL;
+  if(parallel) {comm_pntr = &mycomm_;}
+  if(compact_support_) {
+    return getBiasAndForcesCompact(args_values,all_inside,workspace_.forces_dummy,workspace_.active_coeffsderivs_values,workspace_.active_coeffs_indices);
   }
-  else {
-    return getBiasAndForces(args_values,all_inside,forces_dummy,coeffsderivs_values_dummy,basisf_pntrs_, bias_coeffs_pntr_, NULL);
+  if(factorized_evaluation_) {
+    return getBiasAndForcesFactorized(args_values,all_inside,workspace_.forces_dummy,workspace_.coeffsderivs_values_dummy,basisf_pntrs_, bias_coeffs_pntr_, comm_pntr, workspace_);
   }
+  return getBiasAndForces(args_values,all_inside,workspace_.forces_dummy,workspace_.coeffsderivs_values_dummy,basisf_pntrs_, bias_coeffs_pntr_, comm_pntr, workspace_);
 }
 
 
 inline
 void LinearBasisSetExpansion::getBasisSetValues(const std::vector<double>& args_values, std::vector<double>& basisset_values, const bool parallel) {
   if(parallel) {
-    getBasisSetValues(args_values,basisset_values,basisf_pntrs_, bias_coeffs_pntr_, &mycomm_);
+    getBasisSetValues(args_values,basisset_values,basisf_pntrs_, bias_coeffs_pntr_, &mycomm_, workspace_);
   }
   else {
-    getBasisSetValues(args_values,basisset_values,basisf_pntrs_, bias_coeffs_pntr_, NULL);
+    getBasisSetValues(args_values,basisset_values,basisf_pntrs_, bias_coeffs_pntr_, NULL, workspace_);
   }
 }
 
-
 }
 
 }
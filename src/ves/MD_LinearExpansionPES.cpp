@@ -32,6 +32,7 @@
 #include "tools/Grid.h"
 #include "tools/Communicator.h"
 #include "tools/FileBase.h"
+#include "tools/OpenMP.h"
 #include "core/PlumedMain.h"
 #include "core/ActionRegister.h"
 #include "core/ActionSet.h"
@@ -60,6 +61,19 @@ dimensions.
 
 It is possible to run more than one replica of the system in parallel.
 
+For generating large amounts of data it is possible to propagate several
+independent particles on the same potential energy surface in lockstep by
+using the particles keyword. All the particles start from the initial position
+and each one has its own stream of random numbers, such that the trajectories
+do not depend on the number of OpenMP threads used to split the particles
+(particle i uses the random seed of its replica minus i times the number of replicas).
+The particles are passed to PLUMED as separate atoms, such that the position
+of the first particle is given by ATOM=1 and so on. The histogram
+of the positions visited by all the particles during the dynamics can be
+written out by using the output_sampled_histogram keyword, it is given on the same grid and
+with the same normalization as the histogram in the output_histogram file that is
+obtained from the Boltzmann distribution of the potential.
+
 \par Examples
 
 In the following example we perform dynamics on the
@@ -132,13 +146,18 @@ PRINT ARG=p.x,p.y,ene FILE=colvar.data FMT=%8.4f
 
 class MD_LinearExpansionPES : public PLMD::CLTool {
 public:
-  std::string description() const {return "MD of a one particle on a linear expansion PES";}
+  std::string description() const {return "MD of one or more particles on a linear expansion PES";}
   static void registerKeywords( Keywords& keys );
   explicit MD_LinearExpansionPES( const CLToolOptions& co );
   int main( FILE* in, FILE* out, PLMD::Communicator& pc);
 private:
   unsigned int dim;
   LinearBasisSetExpansion* potential_expansion_pntr;
+  // positions, potential energies and forces of all the particles, used
+  // to evaluate the potential for all the particles at once
+  std::vector<double> positions_batch;
+  std::vector<double> potentials_batch;
+  std::vector<double> forces_batch;
   //
   double calc_energy( const std::vector<Vector>&, std::vector<Vector>& );
   double calc_temp( const std::vector<Vector>& );
@@ -157,6 +176,7 @@ void MD_LinearExpansionPES::registerKeywords( Keywords& keys ) {
   keys.add("compulsory","dimension","1","Number of dimensions, supports 1 to 3.");
   keys.add("compulsory","initial_position","Initial position of the particle. For multiple replica you can give a seperate value for each replica.");
   keys.add("compulsory","replicas","1","Number of replicas.");
+  keys.add("compulsory","particles","1","Number of independent particles that are propagated in lockstep for each replica.");
   keys.add("compulsory","basis_functions_1","Basis functions for dimension 1.");
   keys.add("optional","basis_functions_2","Basis functions for dimension 2 if needed.");
   keys.add("optional","basis_functions_3","Basis functions for dimension 3 if needed.");
@@ -168,28 +188,36 @@ void MD_LinearExpansionPES::registerKeywords( Keywords& keys ) {
   keys.add("compulsory","output_potential_grid","100","The number of grid points used for the potential and histogram output files.");
   keys.add("compulsory","output_potential","potential.data","Filename of the potential output file.");
   keys.add("compulsory","output_histogram","histogram.data","Filename of the histogram output file.");
+  keys.add("optional","output_sampled_histogram","Filename of the output file for the histogram of the positions visited by the particles during the dynamics.");
 }
 
 
 MD_LinearExpansionPES::MD_LinearExpansionPES( const CLToolOptions& co ):
   CLTool(co),
   dim(0),
-  potential_expansion_pntr(NULL)
+  potential_expansion_pntr(NULL),
+  positions_batch(0),
+  potentials_batch(0),
+  forces_batch(0)
 {
   inputdata=ifile; //commandline;
 }
 
 inline
 double MD_LinearExpansionPES::calc_energy( const std::vector<Vector>& pos, std::vector<Vector>& forces) {
-  std::vector<double> pos_tmp(dim);
-  std::vector<double> forces_tmp(dim,0.0);
-  for(unsigned int j=0; j<dim; ++j) {
-    pos_tmp[j]=pos[0][j];
+  unsigned int nparticles = pos.size();
+  for(unsigned int i=0; i<nparticles; ++i) {
+    for(unsigned int j=0; j<dim; ++j) {
+      positions_batch[j+dim*i]=pos[i][j];
+    }
   }
-  bool all_inside = true;
-  double potential = potential_expansion_pntr->getBiasAndForces(pos_tmp,all_inside,forces_tmp);
-  for(unsigned int j=0; j<dim; ++j) {
-    forces[0][j] = forces_tmp[j];
+  potential_expansion_pntr->getBiasAndForcesBatch(nparticles,positions_batch,potentials_batch,forces_batch);
+  double potential=0.0;
+  for(unsigned int i=0; i<nparticles; ++i) {
+    potential+=potentials_batch[i];
+    for(unsigned int j=0; j<dim; ++j) {
+      forces[i][j] = forces_batch[j+dim*i];
+    }
   }
   return potential;
 }
@@ -199,15 +227,16 @@ inline
 double MD_LinearExpansionPES::calc_temp( const std::vector<Vector>& vel) {
   double total_KE=0.0;
   //! Double the total kinetic energy of the system
-  for(unsigned int j=0; j<dim; ++j) {
-    total_KE+=vel[0][j]*vel[0][j];
+  for(unsigned int i=0; i<vel.size(); ++i) {
+    for(unsigned int j=0; j<dim; ++j) {
+      total_KE+=vel[i][j]*vel[i][j];
+    }
   }
-  return total_KE / (double) dim; // total_KE is actually 2*KE
+  return total_KE / (double) (dim*vel.size()); // total_KE is actually 2*KE
 }
 
 int MD_LinearExpansionPES::main( FILE* in, FILE* out, PLMD::Communicator& pc) {
   int plumedWantsToStop;
-  Random random;
   unsigned int stepWrite=1000;
 
   PLMD::PlumedMain* plumed=NULL;
@@ -286,6 +315,12 @@ int MD_LinearExpansionPES::main( FILE* in, FILE* out, PLMD::Communicator& pc) {
 
   //
   parse("dimension",dim);
+  //
+  unsigned int nparticles;
+  parse("particles",nparticles);
+  if(nparticles==0) {
+    error("the number of particles should be larger than zero.");
+  }
 
   std::vector<std::string> plumed_inputfiles;
   parseVector("plumed_input",plumed_inputfiles);
@@ -520,7 +555,7 @@ int MD_LinearExpansionPES::main( FILE* in, FILE* out, PLMD::Communicator& pc) {
 
   if(plumed) {
     plumed->cmd("setNoVirial");
-    int natoms=1;
+    int natoms=nparticles;
     plumed->cmd("setNatoms",&natoms);
     plumed->cmd("setMDEngine","mdrunner_linearexpansion");
     plumed->cmd("setTimestep",&tstep);
@@ -532,11 +567,22 @@ int MD_LinearExpansionPES::main( FILE* in, FILE* out, PLMD::Communicator& pc) {
     plumed->cmd("init");
   }
 
-  // Setup random number generator
-  random.setSeed(seed);
+  // Setup random number generators, one for each particle
+  std::vector<Random> randoms(nparticles);
+  for(unsigned int i=0; i<nparticles; i++) {
+    randoms[i].setSeed(seed-static_cast<int>(i*replicas));
+  }
+  // threads used to split the particles
+  unsigned int nthreads = OpenMP::getNumThreads();
+
+  positions_batch.assign(dim*nparticles,0.0);
+  potentials_batch.assign(nparticles,0.0);
+  forces_batch.assign(dim*nparticles,0.0);
 
-  double potential, therm_eng=0; std::vector<double> masses(1,1);
-  std::vector<Vector> positions(1), velocities(1), forces(1);
+  double potential;
+  std::vector<double> masses(nparticles,1);
+  std::vector<double> therm_engs(nparticles,0.0);
+  std::vector<Vector> positions(nparticles), velocities(nparticles), forces(nparticles);
   for(unsigned int k=0; k<dim; k++) {
     positions[0][k] = initPos[inter.Get_rank()][k];
     if(periodic[k]) {
@@ -547,16 +593,35 @@ int MD_LinearExpansionPES::main( FILE* in, FILE* out, PLMD::Communicator& pc) {
       if(positions[0][k]<interval_min[k]) {positions[0][k]=interval_min[k];}
     }
   }
+  for(unsigned int i=1; i<nparticles; i++) {positions[i]=positions[0];}
 
 
-  for(unsigned k=0; k<dim; ++k) {
-    velocities[0][k]=random.Gaussian() * sqrt( temp );
+  for(unsigned int i=0; i<nparticles; i++) {
+    for(unsigned k=0; k<dim; ++k) {
+      velocities[i][k]=randoms[i].Gaussian() * sqrt( temp );
+    }
+  }
+
+  // histogram of the visited positions on the grid points of the potential grid,
+  // accumulated separately by each thread and merged at the end
+  std::string output_sampled_histogram_fname="";
+  parse("output_sampled_histogram",output_sampled_histogram_fname);
+  bool sampled_histogram = output_sampled_histogram_fname.size()>0;
+  std::vector<unsigned int> histo_nbins = histo_grid.getNbin();
+  std::vector<double> histo_dx = histo_grid.getDx();
+  std::vector< std::vector<unsigned long int> > histo_counts(0);
+  if(sampled_histogram) {
+    histo_counts.assign(nthreads,std::vector<unsigned long int>(histo_grid.getSize(),0));
   }
+  unsigned long int histo_nsamples=0;
 
   potential=calc_energy(positions,forces); double ttt=calc_temp(velocities);
 
   FILE* fp=fopen(stats_filename.c_str(),"w+");
-  double conserved = potential+1.5*ttt+therm_eng;
+  double therm_eng=0.0;
+  // the potential and the thermostat energy are summed over all the particles,
+  // so the kinetic energy is the total as well, i.e. dim*nparticles*ttt/2
+  double conserved = potential+0.5*dim*nparticles*ttt+therm_eng;
   //fprintf(fp,"%d %f %f %f %f %f %f %f %f \n", 0, 0., positions[0][0], positions[0][1], positions[0][2], conserved, ttt, potential, therm_eng );
   if( intra.Get_rank()==0 ) {
     fprintf(fp,"%d %f %f %f %f %f %f %f %f \n", 0, 0., positions[0][0], positions[0][1], positions[0][2], conserved, ttt, potential, therm_eng );
@@ -575,31 +640,35 @@ int MD_LinearExpansionPES::main( FILE* in, FILE* out, PLMD::Communicator& pc) {
   for(unsigned int istep=0; istep<nsteps; ++istep) {
     //if( istep%20==0 && pc.Get_rank()==0 ) printf("Doing step %d\n",istep);
 
-    // Langevin thermostat
     double lscale=exp(-0.5*tstep*friction); //exp(-0.5*tstep/friction);
     double lrand=sqrt((1.-lscale*lscale)*temp);
-    for(unsigned k=0; k<dim; ++k) {
-      therm_eng=therm_eng+0.5*velocities[0][k]*velocities[0][k];
-      velocities[0][k]=lscale*velocities[0][k]+lrand*random.Gaussian();
-      therm_eng=therm_eng-0.5*velocities[0][k]*velocities[0][k];
-    }
-
-    // First step of velocity verlet
-    for(unsigned k=0; k<dim; ++k) {
-      velocities[0][k] = velocities[0][k] + 0.5*tstep*forces[0][k];
-      positions[0][k] = positions[0][k] + tstep*velocities[0][k];
 
-      if(periodic[k]) {
-        positions[0][k] = positions[0][k] - floor(positions[0][k]/interval_range[k]+0.5)*interval_range[k];
+    #pragma omp parallel for num_threads(nthreads)
+    for(unsigned int i=0; i<nparticles; ++i) {
+      // Langevin thermostat
+      for(unsigned k=0; k<dim; ++k) {
+        therm_engs[i]=therm_engs[i]+0.5*velocities[i][k]*velocities[i][k];
+        velocities[i][k]=lscale*velocities[i][k]+lrand*randoms[i].Gaussian();
+        therm_engs[i]=therm_engs[i]-0.5*velocities[i][k]*velocities[i][k];
       }
-      else {
-        if(positions[0][k]>interval_max[k]) {
-          positions[0][k]=interval_max[k];
-          velocities[0][k]=-std::abs(velocities[0][k]);
+
+      // First step of velocity verlet
+      for(unsigned k=0; k<dim; ++k) {
+        velocities[i][k] = velocities[i][k] + 0.5*tstep*forces[i][k];
+        positions[i][k] = positions[i][k] + tstep*velocities[i][k];
+
+        if(periodic[k]) {
+          positions[i][k] = positions[i][k] - floor(positions[i][k]/interval_range[k]+0.5)*interval_range[k];
         }
-        if(positions[0][k]<interval_min[k]) {
-          positions[0][k]=interval_min[k];
-          velocities[0][k]=-std::abs(velocities[0][k]);
+        else {
+          if(positions[i][k]>interval_max[k]) {
+            positions[i][k]=interval_max[k];
+            velocities[i][k]=-std::abs(velocities[i][k]);
+          }
+          if(positions[i][k]<interval_min[k]) {
+            positions[i][k]=interval_min[k];
+            velocities[i][k]=-std::abs(velocities[i][k]);
+          }
         }
       }
     }
@@ -620,28 +689,65 @@ int MD_LinearExpansionPES::main( FILE* in, FILE* out, PLMD::Communicator& pc) {
       if(plumedWantsToStop) nsteps=istep;
     }
 
-    // Second step of velocity verlet
-    for(unsigned k=0; k<dim; ++k) {
-      velocities[0][k] = velocities[0][k] + 0.5*tstep*forces[0][k];
-    }
+    #pragma omp parallel for num_threads(nthreads)
+    for(unsigned int i=0; i<nparticles; ++i) {
+      // Second step of velocity verlet
+      for(unsigned k=0; k<dim; ++k) {
+        velocities[i][k] = velocities[i][k] + 0.5*tstep*forces[i][k];
+      }
 
-    // Langevin thermostat
-    lscale=exp(-0.5*tstep*friction); //exp(-0.5*tstep/friction);
-    lrand=sqrt((1.-lscale*lscale)*temp);
-    for(unsigned k=0; k<dim; ++k) {
-      therm_eng=therm_eng+0.5*velocities[0][k]*velocities[0][k];
-      velocities[0][k]=lscale*velocities[0][k]+lrand*random.Gaussian();
-      therm_eng=therm_eng-0.5*velocities[0][k]*velocities[0][k];
+      // Langevin thermostat
+      for(unsigned k=0; k<dim; ++k) {
+        therm_engs[i]=therm_engs[i]+0.5*velocities[i][k]*velocities[i][k];
+        velocities[i][k]=lscale*velocities[i][k]+lrand*randoms[i].Gaussian();
+        therm_engs[i]=therm_engs[i]-0.5*velocities[i][k]*velocities[i][k];
+      }
+
+      // Nearest grid point for the histogram
+      if(sampled_histogram) {
+        Grid::index_t index=0;
+        for(unsigned int k=dim; k-- > 0;) {
+          long int ik = static_cast<long int>(floor((positions[i][k]-interval_min[k])/histo_dx[k]+0.5));
+          long int nk = static_cast<long int>(histo_nbins[k]);
+          if(periodic[k]) {ik = ((ik%nk)+nk)%nk;}
+          else if(ik<0) {ik=0;}
+          else if(ik>=nk) {ik=nk-1;}
+          index = index*histo_nbins[k]+ik;
+        }
+        histo_counts[OpenMP::getThreadNum()][index]++;
+      }
     }
+    histo_nsamples+=nparticles;
 
     // Print everything
     ttt = calc_temp( velocities );
-    conserved = potential+1.5*ttt+therm_eng;
+    therm_eng=0.0;
+    for(unsigned int i=0; i<nparticles; i++) {therm_eng+=therm_engs[i];}
+    conserved = potential+0.5*dim*nparticles*ttt+therm_eng;
     if( (intra.Get_rank()==0) && ((istep % stepWrite)==0) ) {
       fprintf(fp,"%u %f %f %f %f %f %f %f %f \n", istep, istep*tstep, positions[0][0], positions[0][1], positions[0][2], conserved, ttt, potential, therm_eng );
     }
   }
 
+  if(sampled_histogram) {
+    for(Grid::index_t l=0; l<histo_grid.getSize(); l++) {
+      unsigned long int counts=0;
+      for(unsigned int t=0; t<nthreads; t++) {counts+=histo_counts[t][l];}
+      histo_grid.setValue(l,static_cast<double>(counts)/static_cast<double>(histo_nsamples));
+    }
+    OFile ofile_sampled_histogram;
+    ofile_sampled_histogram.link(pc);
+    if(inter.Get_size()>1) {
+      ofile_sampled_histogram.link(intra);
+      std::string suffix;
+      Tools::convert(inter.Get_rank(),suffix);
+      output_sampled_histogram_fname = FileBase::appendSuffix(output_sampled_histogram_fname,"."+suffix);
+    }
+    ofile_sampled_histogram.open(output_sampled_histogram_fname);
+    histo_grid.writeToFile(ofile_sampled_histogram);
+    ofile_sampled_histogram.close();
+  }
+
   if(plumed) {delete plumed;}
   if(plumed_bf) {delete plumed_bf;}
   if(potential_expansion_pntr) {delete potential_expansion_pntr;}
@@ -53,7 +53,7 @@ where \f$\mu\f$ is a fixed step size and the gradient \f$ \nabla\Omega(\bar{\bol
 \f]
 This means that the bias acting on the system depends on the averaged coefficients \f$\bar{\boldsymbol{\alpha}}^{(n)}\f$ which leads to a smooth convergence of the bias and the estimated free energy surface. Furthermore, this allows for a rather short sampling time for each iteration, for classical MD simulations typical sampling times are on the order of few ps (around 1000-4000 MD steps).
 
-Currently it is only supported to employ the diagonal part of the Hessian which is generally sufficient. Support for employing the full Hessian will be added later on.
+By default only the diagonal part of the Hessian is employed which is generally sufficient. For expansions in several dimensions the coupling between neighboring coefficients can also be included by using a banded Hessian matrix, where the bandwidth in each dimension is given with the HESSIAN_BANDWIDTH keyword. The full Hessian cannot be selected directly for this optimizer, but it is obtained with a bandwidth that is at least the number of basis functions in each dimension, which is only practical for a small number of coefficients.
 
 The VES bias that is to be optimized should be specified using the
 BIAS keyword.
@@ -184,6 +184,7 @@ private:
   std::vector<CoeffsVector*> combinedgradient_pntrs_;
   unsigned int combinedgradient_wstride_;
   std::vector<OFile*> combinedgradientOFiles_;
+  std::vector<std::vector<double> > combinedgradient_values_;
   double decaying_aver_tau_;
 private:
   CoeffsVector& CombinedGradient(const unsigned int c_id) const {return *combinedgradient_pntrs_[c_id];}
@@ -216,6 +217,8 @@ void Opt_BachAveragedSGD::registerKeywords(Keywords& keys) {
 
 
 Opt_BachAveragedSGD::~Opt_BachAveragedSGD() {
+  // pending writes of the combined gradient are finished before the files are closed
+  waitForOutputFiles();
   for(unsigned int i=0; i<combinedgradient_pntrs_.size(); i++) {
     delete combinedgradient_pntrs_[i];
   }
@@ -231,6 +234,7 @@ Opt_BachAveragedSGD::Opt_BachAveragedSGD(const ActionOptions&ao):
   combinedgradient_pntrs_(0),
   combinedgradient_wstride_(100),
   combinedgradientOFiles_(0),
+  combinedgradient_values_(0),
   decaying_aver_tau_(0.0)
 {
   log.printf("  Averaged stochastic gradient decent, see and cite ");
@@ -279,6 +283,9 @@ Opt_BachAveragedSGD::Opt_BachAveragedSGD(const ActionOptions&ao):
     }
   }
   //
+  for(unsigned int i=0; i<numberOfCoeffsSets(); i++) {
+    combinedgradient_values_.push_back(std::vector<double>(getGradientPntrs()[i]->numberOfCoeffs(),0.0));
+  }
 
   turnOnHessian();
   checkRead();
@@ -286,17 +293,24 @@ Opt_BachAveragedSGD::Opt_BachAveragedSGD(const ActionOptions&ao):
 
 
 void Opt_BachAveragedSGD::coeffsUpdate(const unsigned int c_id) {
+  // combined gradient: Gradient + Hessian*(AuxCoeffs-Coeffs)
+  std::vector<double>& combinedgradient = combinedgradient_values_[c_id];
+  for(size_t i=0; i<combinedgradient.size(); i++) {
+    combinedgradient[i] = Gradient(c_id)[i];
+  }
+  Hessian(c_id).addProductWithDifference(AuxCoeffs(c_id),Coeffs(c_id),combinedgradient);
   //
   if(combinedgradientOFiles_.size()>0 && (getIterationCounter()+1)%combinedgradient_wstride_==0) {
-    CombinedGradient(c_id).setValues( ( Gradient(c_id) + Hessian(c_id)*(AuxCoeffs(c_id)-Coeffs(c_id)) ) );
+    CombinedGradient(c_id).setValues(combinedgradient);
     combinedgradient_pntrs_[c_id]->setIterationCounterAndTime(getIterationCounter()+1,getTime());
-    combinedgradient_pntrs_[c_id]->writeToFile(*combinedgradientOFiles_[c_id]);
+    writeToOFile(*combinedgradientOFiles_[c_id],{combinedgradient_pntrs_[c_id]});
   }
   //
   double aver_decay = getAverDecay();
-  AuxCoeffs(c_id) += - StepSize(c_id)*CoeffsMask(c_id) * ( Gradient(c_id) + Hessian(c_id)*(AuxCoeffs(c_id)-Coeffs(c_id)) );
-  //AuxCoeffs() = AuxCoeffs() - StepSize() * ( Gradient() + Hessian()*(AuxCoeffs()-Coeffs()) );
-  Coeffs(c_id) += aver_decay * ( AuxCoeffs(c_id)-Coeffs(c_id) );
+  // AuxCoeffs += - StepSize*CoeffsMask * ( Gradient + Hessian*(AuxCoeffs-Coeffs) )
+  AuxCoeffs(c_id).addScaledProductToValues(-StepSize(c_id),CoeffsMask(c_id),combinedgradient);
+  // Coeffs += aver_decay * ( AuxCoeffs-Coeffs )
+  Coeffs(c_id).addScaledDifferenceToValues(aver_decay,AuxCoeffs(c_id),Coeffs(c_id));
 }
 
 
@@ -35,7 +35,9 @@ Dummy optimizer for debugging.
 
 This is dummy optimizer that can be used for debugging. It will not update the
 coefficients but can be used to monitor the gradient and Hessian for a given
-VES bias.
+VES bias. By using the FULL_HESSIAN flag together with MONITOR_HESSIAN
+the full Hessian is monitored rather than only its diagonal part, while
+HESSIAN_BANDWIDTH monitors only the elements of a banded Hessian.
 
 \par Examples
 
@@ -90,6 +92,7 @@ void Opt_Dummy::registerKeywords(Keywords& keys) {
   //
   Optimizer::useMultipleWalkersKeywords(keys);
   Optimizer::useHessianKeywords(keys);
+  keys.use("FULL_HESSIAN");
   keys.addFlag("MONITOR_HESSIAN",false,"also monitor the Hessian");
 }
 
@@ -104,6 +107,12 @@ Opt_Dummy::Opt_Dummy(const ActionOptions&ao):
   if(monitor_hessian) {
     turnOnHessian();
     log.printf("  the Hessian will also be monitored\n");
+    if(!diagonalHessian() && getHessianPntrs()[0]->isBanded()) {
+      log.printf("  the banded Hessian will be monitored, not only its diagonal part\n");
+    }
+    else if(!diagonalHessian()) {
+      log.printf("  the full Hessian will be monitored, not only its diagonal part\n");
+    }
   }
   else {
     turnOffHessian();
@@ -66,10 +66,12 @@ Opt_SteepestDecent::Opt_SteepestDecent(const ActionOptions&ao):
 
 
 void Opt_SteepestDecent::coeffsUpdate(const unsigned int c_id) {
-  Coeffs(c_id) += - StepSize(c_id) * CoeffsMask(c_id) * Gradient(c_id);
+  // Coeffs += - stepsize * CoeffsMask * Gradient
+  Coeffs(c_id).addScaledProductToValues(-StepSize(c_id),CoeffsMask(c_id),Gradient(c_id));
   //
   double aver_decay = 1.0 / ( getIterationCounterDbl() + 1.0 );
-  AuxCoeffs(c_id) += aver_decay * ( Coeffs(c_id)-AuxCoeffs(c_id) );
+  // AuxCoeffs += aver_decay * ( Coeffs-AuxCoeffs )
+  AuxCoeffs(c_id).addScaledDifferenceToValues(aver_decay,Coeffs(c_id),AuxCoeffs(c_id));
 
 }
 
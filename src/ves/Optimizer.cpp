@@ -23,6 +23,7 @@
 #include "Optimizer.h"
 #include "CoeffsVector.h"
 #include "CoeffsMatrix.h"
+#include "OutputThread.h"
 #include "VesBias.h"
 #include "VesTools.h"
 
@@ -33,6 +34,9 @@
 #include "tools/File.h"
 #include "tools/FileBase.h"
 
+#include <memory>
+#include <fstream>
+
 namespace PLMD {
 namespace ves {
 
@@ -48,12 +52,17 @@ Optimizer::Optimizer(const ActionOptions&ao):
   iter_counter(0),
   use_hessian_(false),
   diagonal_hessian_(true),
+  hessian_bandwidth_(0),
   use_mwalkers_mpi_(false),
   mwalkers_mpi_single_files_(true),
+  mwalkers_nonblocking_(false),
   dynamic_targetdists_(0),
   ustride_targetdist_(0),
   ustride_reweightfactor_(0),
   coeffssetid_prefix_(""),
+  binary_output_(false),
+  async_output_(false),
+  output_thread_(NULL),
   coeffs_wstride_(100),
   coeffsOFiles_(0),
   coeffs_output_fmt_(""),
@@ -193,11 +202,20 @@ Optimizer::Optimizer(const ActionOptions&ao):
   }
 
   //
+  bool full_hessian=false;
   if(keywords.exists("FULL_HESSIAN")) {
-    bool full_hessian=false;
     parseFlag("FULL_HESSIAN",full_hessian);
     diagonal_hessian_ = !full_hessian;
   }
+  if(keywords.exists("HESSIAN_BANDWIDTH")) {
+    parseVector("HESSIAN_BANDWIDTH",hessian_bandwidth_);
+    if(hessian_bandwidth_.size()>0) {
+      if(full_hessian) {
+        plumed_merror("FULL_HESSIAN and HESSIAN_BANDWIDTH cannot be used at the same time");
+      }
+      diagonal_hessian_ = false;
+    }
+  }
   //
   bool mw_single_files = false;
   if(keywords.exists("MULTIPLE_WALKERS")) {
@@ -206,6 +224,12 @@ Optimizer::Optimizer(const ActionOptions&ao):
       mw_single_files=true;
     }
   }
+  if(keywords.exists("MWALKERS_NONBLOCKING")) {
+    parseFlag("MWALKERS_NONBLOCKING",mwalkers_nonblocking_);
+    if(mwalkers_nonblocking_ && !use_mwalkers_mpi_) {
+      plumed_merror("the MWALKERS_NONBLOCKING keyword can only be used together with the MULTIPLE_WALKERS keyword");
+    }
+  }
 
   int numwalkers=1;
   int walker_rank=0;
@@ -225,6 +249,9 @@ Optimizer::Optimizer(const ActionOptions&ao):
     log.printf("   please see and cite ");
     log << plumed.cite("Raiteri, Laio, Gervasio, Micheletti, and Parrinello, J. Phys. Chem. B 110, 3533 (2006)");
     log.printf("\n");
+    if(mwalkers_nonblocking_) {
+      log.printf("   the averages are summed over the walkers with a non-blocking reduction, the coefficients are thus updated with the gradient from the previous iteration\n");
+    }
   }
 
   dynamic_targetdists_.resize(nbiases_,false);
@@ -332,6 +359,24 @@ Optimizer::Optimizer(const ActionOptions&ao):
   }
   //
 
+  parseFlag("BINARY_OUTPUT",binary_output_);
+  if(binary_output_) {
+    log.printf("  Coefficient, gradient, Hessian and target distribution averages files will be written in binary format\n");
+  }
+  parseFlag("ASYNC_OUTPUT",async_output_);
+  if(async_output_) {
+    unsigned int output_queue_size=4;
+    parse("ASYNC_OUTPUT_QUEUE",output_queue_size);
+    if(output_queue_size==0) {
+      plumed_merror("ASYNC_OUTPUT_QUEUE should be larger than zero");
+    }
+    // only the master process writes out files
+    if(comm.Get_rank()==0) {
+      output_thread_ = new OutputThread(output_queue_size);
+    }
+    log.printf("  Coefficient, gradient, Hessian and target distribution averages files will be written by a separate output thread, at most %u pending writes are queued\n",output_queue_size);
+  }
+
   std::vector<std::string> coeffs_fnames;
   if(keywords.exists("COEFFS_FILE")) {
     parseFilenames("COEFFS_FILE",coeffs_fnames,"coeffs.data");
@@ -393,7 +438,7 @@ Optimizer::Optimizer(const ActionOptions&ao):
     }
     if(!getRestart()) {
       for(unsigned int i=0; i<coeffsOFiles_.size(); i++) {
-        coeffs_pntrs_[i]->writeToFile(*coeffsOFiles_[i],aux_coeffs_pntrs_[i],false);
+        writeToOFile(*coeffsOFiles_[i],{coeffs_pntrs_[i],aux_coeffs_pntrs_[i]});
       }
     }
     if(coeffs_fnames.size()>0) {
@@ -574,10 +619,11 @@ Optimizer::Optimizer(const ActionOptions&ao):
     }
 
     for(unsigned int i=0; i<targetdist_averagesOFiles_.size(); i++) {
-      targetdist_averages_pntrs_[i]->writeToFile(*targetdist_averagesOFiles_[i]);
+      writeToOFile(*targetdist_averagesOFiles_[i],{targetdist_averages_pntrs_[i]});
     }
 
     if(targetdist_averages_wstride_==0) {
+      waitForOutputFiles();
       for(unsigned int i=0; i<targetdist_averagesOFiles_.size(); i++) {
         targetdist_averagesOFiles_[i]->close();
         delete targetdist_averagesOFiles_[i];
@@ -779,6 +825,12 @@ Optimizer::~Optimizer() {
   }
   coeffs_mask_pntrs_.clear();
   //
+  // pending writes are finished before the output files are closed
+  if(output_thread_!=NULL) {
+    output_thread_->wait();
+    delete output_thread_;
+  }
+  //
   for(unsigned int i=0; i<coeffsOFiles_.size(); i++) {
     coeffsOFiles_[i]->close();
     delete coeffsOFiles_[i];
@@ -814,6 +866,9 @@ void Optimizer::registerKeywords( Keywords& keys ) {
   keys.add("compulsory","COEFFS_FILE","coeffs.data","the name of output file for the coefficients");
   keys.add("compulsory","COEFFS_OUTPUT","100","how often the coefficients should be written to file. This parameter is given as the number of iterations.");
   keys.add("optional","COEFFS_FMT","specify format for coefficient file(s) (useful for decrease the number of digits in regtests)");
+  keys.addFlag("BINARY_OUTPUT",false,"write the coefficient, gradient, Hessian and target distribution averages files in a binary format instead of text. The binary files are much smaller and faster to write and read, they can be used for restarting and converted to the text format with \\ref ves_binary_to_text.");
+  keys.addFlag("ASYNC_OUTPUT",false,"write the coefficient, gradient, Hessian and target distribution averages files from a separate output thread such that the simulation does not have to wait for the formatting and writing of the files. The files are written out from a snapshot of the data taken at the time of output.");
+  keys.add("optional","ASYNC_OUTPUT_QUEUE","the maximum number of pending writes when using ASYNC_OUTPUT, if the output thread falls behind the simulation waits until it has caught up. The default value is 4.");
   keys.add("optional","COEFFS_SET_ID_PREFIX","suffix to add to the filename given in FILE to identfy the bias, should only be given if a single filename is given in FILE when optimizing multiple biases.");
   //
   keys.add("optional","INITIAL_COEFFS","the name(s) of file(s) with the initial coefficents");
@@ -826,11 +881,13 @@ void Optimizer::registerKeywords( Keywords& keys ) {
   keys.reserve("compulsory","INITIAL_STEPSIZE","the initial step size used for the optimization");
   // Keywords related to the Hessian, actived with the useHessianKeywords function
   keys.reserveFlag("FULL_HESSIAN",false,"if the full Hessian matrix should be used for the optimization, otherwise only the diagonal part of the Hessian is used");
+  keys.reserve("optional","HESSIAN_BANDWIDTH","only use the elements of the Hessian matrix that couple coefficients whose indices differ by at most the value given here in each dimension, i.e. a banded Hessian matrix. Give either one value for all dimensions or one value for each dimension, a value of 0 for a dimension leads to a block-diagonal Hessian. This saves memory and computational time compared to the full Hessian matrix for expansions in several dimensions");
   keys.reserve("hidden","HESSIAN_FILE","the name of output file for the Hessian");
   keys.reserve("hidden","HESSIAN_OUTPUT","how often the Hessian should be written to file. This parameter is given as the number of bias iterations. It is by default 100 if HESSIAN_FILE is specficed");
   keys.reserve("hidden","HESSIAN_FMT","specify format for hessian file(s) (useful for decrease the number of digits in regtests)");
   // Keywords related to the multiple walkers, actived with the useMultipleWalkersKeywords function
   keys.reserveFlag("MULTIPLE_WALKERS",false,"if optimization is to be performed using multiple walkers connected via MPI");
+  keys.reserveFlag("MWALKERS_NONBLOCKING",false,"if the averages of the multiple walkers should be summed with a non-blocking MPI reduction that overlaps with the MD. The coefficients are then updated with the gradient obtained in the previous iteration, i.e., one STRIDE later.");
   // Keywords related to the mask file, actived with the useMaskKeywords function
   keys.reserve("optional","MASK_FILE","read in a mask file which allows one to employ different step sizes for different coefficents and/or deactive the optimization of certain coefficients (by putting values of 0.0). One can write out the resulting mask by using the OUTPUT_MASK_FILE keyword.");
   keys.reserve("optional","OUTPUT_MASK_FILE","Name of the file to write out the mask resulting from using the MASK_FILE keyword. Can also be used to generate a template mask file.");
@@ -869,6 +926,7 @@ void Optimizer::registerKeywords( Keywords& keys ) {
 
 void Optimizer::useHessianKeywords(Keywords& keys) {
   // keys.use("FULL_HESSIAN");
+  keys.use("HESSIAN_BANDWIDTH");
   keys.use("HESSIAN_FILE");
   keys.use("HESSIAN_OUTPUT");
   keys.use("HESSIAN_FMT");
@@ -877,6 +935,7 @@ void Optimizer::useHessianKeywords(Keywords& keys) {
 
 void Optimizer::useMultipleWalkersKeywords(Keywords& keys) {
   keys.use("MULTIPLE_WALKERS");
+  keys.use("MWALKERS_NONBLOCKING");
 }
 
 
@@ -936,6 +995,13 @@ void Optimizer::turnOnHessian() {
   if(diagonal_hessian_) {
     log.printf("  Optimization performed using diagonal Hessian matrix\n");
   }
+  else if(hessian_bandwidth_.size()>0) {
+    log.printf("  Optimization performed using banded Hessian matrix with a bandwidth of %s\n",hessian_pntrs_[0]->getBandwidthString().c_str());
+    for(unsigned int i=0; i<ncoeffssets_; i++) {
+      size_t ncoeffs = hessian_pntrs_[i]->numberOfCoeffs();
+      log.printf("   %s: %zu stored elements out of %zu in the upper triangle\n",hessian_pntrs_[i]->getLabel().c_str(),hessian_pntrs_[i]->getSize(),(ncoeffs*ncoeffs+ncoeffs)/2);
+    }
+  }
   else {
     log.printf("  Optimization performed using full Hessian matrix\n");
   }
@@ -955,6 +1021,7 @@ void Optimizer::turnOffHessian() {
     bias_pntrs_[i]->disableHessian();
   }
   hessian_pntrs_.clear();
+  waitForOutputFiles();
   for(unsigned int i=0; i<hessianOFiles_.size(); i++) {
     hessianOFiles_[i]->close();
     delete hessianOFiles_[i];
@@ -965,7 +1032,7 @@ void Optimizer::turnOffHessian() {
 
 std::vector<CoeffsMatrix*> Optimizer::enableHessian(VesBias* bias_pntr_in, const bool diagonal_hessian) {
   plumed_massert(use_hessian_,"the Hessian should not be used");
-  bias_pntr_in->enableHessian(diagonal_hessian);
+  bias_pntr_in->enableHessian(diagonal_hessian,hessian_bandwidth_);
   std::vector<CoeffsMatrix*> hessian_pntrs_out = bias_pntr_in->getHessianPntrs();
   for(unsigned int k=0; k<hessian_pntrs_out.size(); k++) {
     plumed_massert(hessian_pntrs_out[k] != NULL,"Hessian is needed but not linked correctly");
@@ -1000,9 +1067,14 @@ std::vector<CoeffsMatrix*> Optimizer::enableHessian(VesBias* bias_pntr_in, const
 
 void Optimizer::update() {
   if(onStep() && !isFirstStep) {
+    bool gradients_available = true;
     for(unsigned int i=0; i<nbiases_; i++) {
-      bias_pntrs_[i]->updateGradientAndHessian(use_mwalkers_mpi_);
+      if(!bias_pntrs_[i]->updateGradientAndHessian(use_mwalkers_mpi_,mwalkers_nonblocking_)) {
+        gradients_available = false;
+      }
     }
+    // with a non-blocking reduction over the walkers the first gradient is only available one stride later
+    if(!gradients_available) {return;}
     for(unsigned int i=0; i<ncoeffssets_; i++) {
       if(gradient_pntrs_[i]->isActive()) {coeffsUpdate(i);}
       else {
@@ -1027,6 +1099,9 @@ void Optimizer::update() {
         aver_gradient_pntrs_[i]->addToAverage(*gradient_pntrs_[i]);
       }
     }
+    for(unsigned int i=0; i<nbiases_; i++) {
+      bias_pntrs_[i]->coeffsUpdated();
+    }
     increaseIterationCounter();
     updateOutputComponents();
     for(unsigned int i=0; i<ncoeffssets_; i++) {
@@ -1101,6 +1176,7 @@ void Optimizer::updateOutputComponents() {
 
 
 void Optimizer::turnOffCoeffsOutputFiles() {
+  waitForOutputFiles();
   for(unsigned int i=0; i<coeffsOFiles_.size(); i++) {
     coeffsOFiles_[i]->close();
     delete coeffsOFiles_[i];
@@ -1111,21 +1187,76 @@ void Optimizer::turnOffCoeffsOutputFiles() {
 
 void Optimizer::writeOutputFiles(const unsigned int coeffs_id) {
   if(coeffsOFiles_.size()>0 && iter_counter%coeffs_wstride_==0) {
-    coeffs_pntrs_[coeffs_id]->writeToFile(*coeffsOFiles_[coeffs_id],aux_coeffs_pntrs_[coeffs_id],false);
+    writeToOFile(*coeffsOFiles_[coeffs_id],{coeffs_pntrs_[coeffs_id],aux_coeffs_pntrs_[coeffs_id]});
   }
   if(gradientOFiles_.size()>0 && iter_counter%gradient_wstride_==0) {
     if(aver_gradient_pntrs_.size()==0) {
-      gradient_pntrs_[coeffs_id]->writeToFile(*gradientOFiles_[coeffs_id],false);
+      writeToOFile(*gradientOFiles_[coeffs_id],{gradient_pntrs_[coeffs_id]});
     }
     else {
-      gradient_pntrs_[coeffs_id]->writeToFile(*gradientOFiles_[coeffs_id],aver_gradient_pntrs_[coeffs_id],false);
+      writeToOFile(*gradientOFiles_[coeffs_id],{gradient_pntrs_[coeffs_id],aver_gradient_pntrs_[coeffs_id]});
     }
   }
   if(hessianOFiles_.size()>0 && iter_counter%hessian_wstride_==0) {
-    hessian_pntrs_[coeffs_id]->writeToFile(*hessianOFiles_[coeffs_id]);
+    writeToOFile(*hessianOFiles_[coeffs_id],*hessian_pntrs_[coeffs_id]);
   }
   if(targetdist_averagesOFiles_.size()>0 && iter_counter%targetdist_averages_wstride_==0) {
-    targetdist_averages_pntrs_[coeffs_id]->writeToFile(*targetdist_averagesOFiles_[coeffs_id]);
+    writeToOFile(*targetdist_averagesOFiles_[coeffs_id],{targetdist_averages_pntrs_[coeffs_id]});
+  }
+}
+
+
+void Optimizer::writeCoeffsSetToOFile(OFile& ofile, const std::vector<CoeffsVector*>& coeffs_set, const bool binary_output) {
+  if(binary_output) {CoeffsVector::writeToBinaryFile(ofile,coeffs_set);}
+  else {CoeffsVector::writeToFile(ofile,coeffs_set,false);}
+}
+
+
+void Optimizer::writeToOFile(OFile& ofile, const std::vector<CoeffsVector*>& coeffs_set) {
+  if(!async_output_) {
+    writeCoeffsSetToOFile(ofile,coeffs_set,binary_output_);
+    return;
+  }
+  if(output_thread_==NULL) {return;}
+  // the output thread writes a snapshot, such that the optimization can continue meanwhile
+  std::vector<std::shared_ptr<CoeffsVector> > snapshot(coeffs_set.size());
+  for(unsigned int k=0; k<coeffs_set.size(); k++) {
+    snapshot[k] = std::make_shared<CoeffsVector>(*coeffs_set[k]);
+  }
+  OFile* ofile_pntr = &ofile;
+  const bool binary_output = binary_output_;
+  output_thread_->queue([snapshot,ofile_pntr,binary_output]() {
+    std::vector<CoeffsVector*> coeffs_set(snapshot.size());
+    for(unsigned int k=0; k<snapshot.size(); k++) {
+      coeffs_set[k] = snapshot[k].get();
+    }
+    writeCoeffsSetToOFile(*ofile_pntr,coeffs_set,binary_output);
+    ofile_pntr->flush();
+  });
+}
+
+
+void Optimizer::writeToOFile(OFile& ofile, CoeffsMatrix& coeffs_matrix) {
+  if(!async_output_) {
+    if(binary_output_) {coeffs_matrix.writeToBinaryFile(ofile);}
+    else {coeffs_matrix.writeToFile(ofile);}
+    return;
+  }
+  if(output_thread_==NULL) {return;}
+  std::shared_ptr<CoeffsMatrix> snapshot = std::make_shared<CoeffsMatrix>(coeffs_matrix);
+  OFile* ofile_pntr = &ofile;
+  const bool binary_output = binary_output_;
+  output_thread_->queue([snapshot,ofile_pntr,binary_output]() {
+    if(binary_output) {snapshot->writeToBinaryFile(*ofile_pntr);}
+    else {snapshot->writeToFile(*ofile_pntr);}
+    ofile_pntr->flush();
+  });
+}
+
+
+void Optimizer::waitForOutputFiles() {
+  if(output_thread_!=NULL) {
+    output_thread_->wait();
   }
 }
 
@@ -1135,7 +1266,17 @@ void Optimizer::setupOFiles(std::vector<std::string>& fnames, std::vector<OFile*
   OFiles.resize(fnames.size(),NULL);
   for(unsigned int i=0; i<fnames.size(); i++) {
     OFiles[i] = new OFile();
-    OFiles[i]->link(*this);
+    if(async_output_) {
+      // the files are written by the output thread of the master process and
+      // therefore cannot be linked to the communicator (i.e. to collective writes)
+      if(getRestart()) {OFiles[i]->enforceRestart();}
+      else {OFiles[i]->enforceBackup();}
+      OFiles[i]->enforceSuffix(plumed.getSuffix());
+      if(comm.Get_rank()>0) {fnames[i]="/dev/null";}
+    }
+    else {
+      OFiles[i]->link(*this);
+    }
     if(multi_sim_single_files) {
       unsigned int r=0;
       if(comm.Get_rank()==0) {r=multi_sim_comm.Get_rank();}
@@ -1143,8 +1284,25 @@ void Optimizer::setupOFiles(std::vector<std::string>& fnames, std::vector<OFile*
       if(r>0) {fnames[i]="/dev/null";}
       OFiles[i]->enforceSuffix("");
     }
+    if(binary_output_ && Tools::extension(fnames[i])=="gz") {
+      plumed_merror("binary output files cannot be compressed, please remove the .gz extension from "+fnames[i]);
+    }
     OFiles[i]->open(fnames[i]);
     OFiles[i]->setHeavyFlush();
+    // when restarting the output is appended to the existing files, so the format cannot change
+    if(getRestart() && fnames[i]!="/dev/null") {
+      const std::string path = OFiles[i]->getPath();
+      std::ifstream ifs(path.c_str(),std::ios::binary|std::ios::ate);
+      if(ifs && ifs.tellg()>0) {
+        bool binary_file = CoeffsBinaryFile::isBinaryFile(path);
+        if(binary_output_ && !binary_file) {
+          plumed_merror("cannot append binary output to the text file "+path+" when restarting, remove BINARY_OUTPUT or start from a new file");
+        }
+        if(!binary_output_ && binary_file) {
+          plumed_merror("cannot append text output to the binary file "+path+" when restarting, use BINARY_OUTPUT or start from a new file");
+        }
+      }
+    }
   }
 }
 
@@ -1164,6 +1322,25 @@ void Optimizer::readCoeffsFromFiles(const std::vector<std::string>& fnames, cons
     if(use_mwalkers_mpi_ && mwalkers_mpi_single_files_) {
       ifile.enforceSuffix("");
     }
+    if(ifile.FileExist(fnames[i]) && CoeffsBinaryFile::isBinaryFile(ifile.getPath())) {
+      // binary files are memory-mapped and the last record is used
+      CoeffsBinaryFile bfile(ifile.getPath());
+      plumed_massert(bfile.numberOfRecords()>0,"no complete record found in binary coefficient file "+bfile.getPath());
+      size_t ncoeffs_read = coeffs_pntrs_[i]->readFromBinaryFile(bfile,bfile.numberOfRecords()-1);
+      if(ncoeffssets_==1) {
+        log.printf("%s (binary, read %zu of %zu values)\n", bfile.getPath().c_str(),ncoeffs_read,coeffs_pntrs_[i]->numberOfCoeffs());
+      }
+      else {
+        log.printf("   coefficent set %u: %s (binary, read %zu of %zu values)\n",i,bfile.getPath().c_str(),ncoeffs_read,coeffs_pntrs_[i]->numberOfCoeffs());
+      }
+      if(read_aux_coeffs) {
+        aux_coeffs_pntrs_[i]->readFromBinaryFile(bfile,bfile.numberOfRecords()-1);
+      }
+      else {
+        AuxCoeffs(i).setValues( Coeffs(i) );
+      }
+      continue;
+    }
     ifile.open(fnames[i]);
     if(!ifile.FieldExist(coeffs_pntrs_[i]->getDataLabel())) {
       std::string error_msg = "Problem with reading coefficents from file " + ifile.getPath() + ": no field with name " + coeffs_pntrs_[i]->getDataLabel() + "\n";
@@ -46,6 +46,7 @@ class OFile;
 namespace ves {
 
 class CoeffsVector;
+class OutputThread;
 class VesBias;
 
 
@@ -65,10 +66,12 @@ private:
   //
   bool use_hessian_;
   bool diagonal_hessian_;
+  std::vector<unsigned int> hessian_bandwidth_;
   bool hessian_covariance_from_averages_;
   //
   bool use_mwalkers_mpi_;
   bool mwalkers_mpi_single_files_;
+  bool mwalkers_nonblocking_;
   //
   std::vector<bool> dynamic_targetdists_;
   unsigned int ustride_targetdist_;
@@ -77,6 +80,10 @@ private:
   //
   std::string coeffssetid_prefix_;
   //
+  bool binary_output_;
+  bool async_output_;
+  OutputThread* output_thread_;
+  //
   unsigned int coeffs_wstride_;
   std::vector<OFile*> coeffsOFiles_;
   std::string coeffs_output_fmt_;
@@ -123,6 +130,7 @@ private:
 private:
   void updateOutputComponents();
   void writeOutputFiles(const unsigned int coeffs_id = 0);
+  static void writeCoeffsSetToOFile(OFile&, const std::vector<CoeffsVector*>&, const bool);
   void readCoeffsFromFiles(const std::vector<std::string>&, const bool);
   void setAllCoeffsSetIterationCounters();
 protected:
@@ -144,6 +152,11 @@ protected:
   void setCurrentStepSizes(const std::vector<double>&);
   //
   void turnOffCoeffsOutputFiles();
+  // write to an output file, either directly or through the output thread
+  void writeToOFile(OFile&, const std::vector<CoeffsVector*>&);
+  void writeToOFile(OFile&, CoeffsMatrix&);
+  // wait until all pending writes of the output thread are finished
+  void waitForOutputFiles();
   //
   template<class T>
   bool parseMultipleValues(const std::string&, std::vector<T>&);
@@ -198,6 +211,7 @@ public:
   bool diagonalHessian() const {return diagonal_hessian_;}
   //
   bool useMultipleWalkers() const {return use_mwalkers_mpi_;}
+  bool useBinaryOutput() const {return binary_output_;}
   //
   std::vector<VesBias*> getBiasPntrs() const {return bias_pntrs_;}
   std::vector<CoeffsVector*> getCoeffsPntrs() const {return coeffs_pntrs_;}
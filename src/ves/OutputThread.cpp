@@ -0,0 +1,111 @@
+/* +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+   Copyright (c) 2016-2017 The VES code team
+   (see the PEOPLE-VES file at the root of this folder for a list of names)
+
+   See http://www.ves-code.org for more information.
+
+   This file is part of VES code module.
+
+   The VES code module is free software: you can redistribute it and/or modify
+   it under the terms of the GNU Lesser General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   The VES code module is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public License
+   along with the VES code module.  If not, see <http://www.gnu.org/licenses/>.
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+
+#include "OutputThread.h"
+
+#include "tools/Exception.h"
+
+
+namespace PLMD {
+namespace ves {
+
+
+OutputThread::OutputThread(const size_t max_queued_jobs):
+  max_queued_jobs_(max_queued_jobs),
+  jobs_(),
+  busy_(false),
+  stop_(false),
+  error_(),
+  mutex_(),
+  job_available_(),
+  queue_changed_(),
+  thread_()
+{
+  plumed_massert(max_queued_jobs_>0,"the output queue should allow at least one job");
+  thread_ = std::thread(&OutputThread::run,this);
+}
+
+
+OutputThread::~OutputThread() {
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    stop_=true;
+  }
+  job_available_.notify_one();
+  // the remaining jobs are run before the thread returns
+  thread_.join();
+}
+
+
+void OutputThread::queue(const std::function<void()>& job) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  queue_changed_.wait(lock,[this] {return jobs_.size()<max_queued_jobs_;});
+  rethrowError();
+  jobs_.push_back(job);
+  lock.unlock();
+  job_available_.notify_one();
+}
+
+
+void OutputThread::wait() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  queue_changed_.wait(lock,[this] {return jobs_.empty() && !busy_;});
+  rethrowError();
+}
+
+
+void OutputThread::rethrowError() {
+  if(error_) {
+    std::exception_ptr error = error_;
+    error_ = std::exception_ptr();
+    std::rethrow_exception(error);
+  }
+}
+
+
+void OutputThread::run() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while(true) {
+    job_available_.wait(lock,[this] {return !jobs_.empty() || stop_;});
+    if(jobs_.empty()) {break;}
+    std::function<void()> job = jobs_.front();
+    jobs_.pop_front();
+    busy_=true;
+    lock.unlock();
+    queue_changed_.notify_all();
+    try {
+      job();
+    }
+    catch(...) {
+      lock.lock();
+      if(!error_) {error_ = std::current_exception();}
+      lock.unlock();
+    }
+    lock.lock();
+    busy_=false;
+    queue_changed_.notify_all();
+  }
+}
+
+
+}
+}
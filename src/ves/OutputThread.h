@@ -0,0 +1,80 @@
+/* +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+   Copyright (c) 2016-2017 The VES code team
+   (see the PEOPLE-VES file at the root of this folder for a list of names)
+
+   See http://www.ves-code.org for more information.
+
+   This file is part of VES code module.
+
+   The VES code module is free software: you can redistribute it and/or modify
+   it under the terms of the GNU Lesser General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   The VES code module is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public License
+   along with the VES code module.  If not, see <http://www.gnu.org/licenses/>.
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
+#ifndef __PLUMED_ves_OutputThread_h
+#define __PLUMED_ves_OutputThread_h
+
+#include <deque>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <cstddef>
+
+
+namespace PLMD {
+namespace ves {
+
+/*
+Thread that runs output jobs, e.g. formatting and writing out coefficient
+files, in the background such that the MD step does not have to wait for
+them. The jobs are run one at a time in the order they are queued. The queue
+is bounded, if it is full queue() blocks until the thread has caught up, such
+that a slow file system cannot lead to an unbounded memory usage.
+
+The jobs should only use data that is owned by them (i.e. snapshots) and
+output files that are not used by anyone else while the jobs are pending.
+An error thrown by a job is rethrown by the next call to queue() or wait().
+*/
+
+class OutputThread {
+private:
+  size_t max_queued_jobs_;
+  std::deque<std::function<void()> > jobs_;
+  bool busy_;
+  bool stop_;
+  std::exception_ptr error_;
+  std::mutex mutex_;
+  std::condition_variable job_available_;
+  std::condition_variable queue_changed_;
+  std::thread thread_;
+  //
+  void run();
+  void rethrowError();
+  OutputThread(const OutputThread&);
+  OutputThread& operator=(const OutputThread&);
+public:
+  explicit OutputThread(const size_t max_queued_jobs=4);
+  // waits for all pending jobs to be finished
+  ~OutputThread();
+  // queue a job, blocks while the queue is full
+  void queue(const std::function<void()>&);
+  // block until all queued jobs have been finished
+  void wait();
+  size_t maxQueuedJobs() const {return max_queued_jobs_;}
+};
+
+
+}
+}
+
+#endif
@@ -21,7 +21,6 @@
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 
 #include "TargetDistribution.h"
-#include "GridIntegrationWeights.h"
 
 #include "core/ActionRegister.h"
 #include "tools/Grid.h"
@@ -253,22 +252,33 @@ void TD_Custom::updateGrid() {
     } catch(PLMD::lepton::Exception& exc) {}
   }
   //
-  std::vector<double> integration_weights = GridIntegrationWeights::getIntegrationWeights(getTargetDistGridPntr());
+  const std::vector<double>& integration_weights = getTargetDistGridIntegrationWeights();
   double norm = 0.0;
   //
-  for(Grid::index_t l=0; l<targetDistGrid().getSize(); l++) {
+  // gather the values of the variables at all grid points and evaluate the expression in one go
+  const Grid::index_t npoints = targetDistGrid().getSize();
+  std::vector<std::string> var_str(cv_var_str_);
+  std::vector<std::vector<double> > var_values(cv_var_str_.size(),std::vector<double>(npoints));
+  for(Grid::index_t l=0; l<npoints; l++) {
     std::vector<double> point = targetDistGrid().getPoint(l);
     for(unsigned int k=0; k<cv_var_str_.size() ; k++) {
-      try {
-        expression.getVariableReference(cv_var_str_[k]) = point[cv_var_idx_[k]];
-      } catch(PLMD::lepton::Exception& exc) {}
+      var_values[k][l] = point[cv_var_idx_[k]];
     }
-    if(use_fes_) {
-      try {
-        expression.getVariableReference(fes_var_str_) = getFesGridPntr()->getValue(l);
-      } catch(PLMD::lepton::Exception& exc) {}
+  }
+  if(use_fes_) {
+    var_str.push_back(fes_var_str_);
+    var_values.push_back(std::vector<double>(npoints));
+    for(Grid::index_t l=0; l<npoints; l++) {
+      var_values.back()[l] = getFesGridPntr()->getValue(l);
     }
-    double value = expression.evaluate();
+  }
+  std::vector<const double*> var_pntrs(var_values.size());
+  for(unsigned int k=0; k<var_values.size(); k++) {var_pntrs[k]=var_values[k].data();}
+  std::vector<double> values(npoints);
+  expression.evaluateBatch(var_str,npoints,var_pntrs,values.data());
+  //
+  for(Grid::index_t l=0; l<npoints; l++) {
+    double value = values[l];
 
     if(value<0.0 && !isTargetDistGridShiftedToZero()) {plumed_merror(getName()+": The target distribution function gives negative values. You should change the definition of the function used for the target distribution to avoid this. You can also use the SHIFT_TO_ZERO keyword to avoid this problem.");}
     targetDistGrid().setValue(l,value);
@@ -21,7 +21,6 @@
 +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++ */
 
 #include "TargetDistribution.h"
-#include "GridIntegrationWeights.h"
 
 #include "core/ActionRegister.h"
 #include "tools/Grid.h"
@@ -95,12 +94,12 @@ void TD_MarginalWellTempered::updateGrid() {
   plumed_massert(getFesGridPntr()!=NULL,"the FES grid has to be linked to use TD_MarginalWellTempered!");
   //
   FesWeight* Fw = new FesWeight(getBeta());
-  Grid fes_proj = getFesGridPntr()->project(proj_args,Fw);
+  Grid fes_proj = getFesGridPntr()->project(proj_args,Fw,&comm);
   delete Fw;
   plumed_massert(fes_proj.getSize()==targetDistGrid().getSize(),"problem with FES projection - inconsistent grids");
   plumed_massert(fes_proj.getDimension()==1,"problem with FES projection - projected grid is not one-dimensional");
   //
-  std::vector<double> integration_weights = GridIntegrationWeights::getIntegrationWeights(getTargetDistGridPntr());
+  const std::vector<double>& integration_weights = getTargetDistGridIntegrationWeights();
   double norm = 0.0;
   for(Grid::index_t l=0; l<targetDistGrid().getSize(); l++) {
     double value = beta_prime * fes_proj.getValue(l);
@@ -57,6 +57,7 @@ TargetDistribution::TargetDistribution(const ActionOptions&ao):
   grid_args_(0),
   targetdist_grid_pntr_(NULL),
   log_targetdist_grid_pntr_(NULL),
+  targetdist_grid_integration_weights_(0),
   targetdist_modifer_pntrs_(0),
   action_pntr_(NULL),
   vesbias_pntr_(NULL),
@@ -184,6 +185,7 @@ void TargetDistribution::setupGrids(const std::vector<Value*>& arguments, const
   grid_args_=arguments;
   targetdist_grid_pntr_ =     new Grid("targetdist",arguments,min,max,nbins,false,false);
   log_targetdist_grid_pntr_ = new Grid("log_targetdist",arguments,min,max,nbins,false,false);
+  targetdist_grid_integration_weights_ = GridIntegrationWeights::getIntegrationWeights(targetdist_grid_pntr_);
   setupAdditionalGrids(arguments,min,max,nbins);
 }
 
@@ -215,6 +217,23 @@ double TargetDistribution::integrateGrid(const Grid* grid_pntr) {
 }
 
 
+double TargetDistribution::integrateTargetDistGrid() const {
+  plumed_massert(targetdist_grid_pntr_!=NULL,"the grids have not been setup using setupGrids");
+  double sum = 0.0;
+  for(Grid::index_t l=0; l<targetdist_grid_pntr_->getSize(); l++) {
+    sum += targetdist_grid_integration_weights_[l]*targetdist_grid_pntr_->getValue(l);
+  }
+  return sum;
+}
+
+
+void TargetDistribution::normalizeTargetDistGrid() {
+  double normalization = integrateTargetDistGrid();
+  targetdist_grid_pntr_->scaleAllValuesAndDerivatives(1.0/normalization);
+  if(normalization<0.0) {plumed_merror(getName()+": something went wrong trying to normalize the target distribution, integrating over it gives a negative value.");}
+}
+
+
 double TargetDistribution::normalizeGrid(Grid* grid_pntr) {
   double normalization = TargetDistribution::integrateGrid(grid_pntr);
   grid_pntr->scaleAllValuesAndDerivatives(1.0/normalization);
@@ -222,7 +241,7 @@ double TargetDistribution::normalizeGrid(Grid* grid_pntr) {
 }
 
 
-Grid TargetDistribution::getMarginalDistributionGrid(Grid* grid_pntr, const std::vector<std::string>& args) {
+Grid TargetDistribution::getMarginalDistributionGrid(Grid* grid_pntr, const std::vector<std::string>& args, Communicator* comm_in) {
   plumed_massert(grid_pntr->getDimension()>1,"doesn't make sense calculating the marginal distribution for a one-dimensional distribution");
   plumed_massert(args.size()<grid_pntr->getDimension(),"the number of arguments for the marginal distribution should be less than the dimension of the full distribution");
   //
@@ -236,7 +255,7 @@ Grid TargetDistribution::getMarginalDistributionGrid(Grid* grid_pntr, const std:
   plumed_massert(args.size()==args_index.size(),"getMarginalDistributionGrid: problem with the arguments of the marginal");
   //
   MarginalWeight* Pw = new MarginalWeight();
-  Grid proj_grid = grid_pntr->project(args,Pw);
+  Grid proj_grid = grid_pntr->project(args,Pw,comm_in);
   delete Pw;
   //
   // scale with the bin volume used for the integral such that the
@@ -252,7 +271,7 @@ Grid TargetDistribution::getMarginalDistributionGrid(Grid* grid_pntr, const std:
 
 
 Grid TargetDistribution::getMarginal(const std::vector<std::string>& args) {
-  return TargetDistribution::getMarginalDistributionGrid(targetdist_grid_pntr_,args);
+  return TargetDistribution::getMarginalDistributionGrid(targetdist_grid_pntr_,args,&comm);
 }
 
 
@@ -271,7 +290,7 @@ void TargetDistribution::updateTargetDist() {
   //
   // if(check_normalization_ && !force_normalization_ && !shift_targetdist_to_zero_){
   if(check_normalization_ && !(bias_cutoff_active_)) {
-    double normalization = integrateGrid(targetdist_grid_pntr_);
+    double normalization = integrateTargetDistGrid();
     const double normalization_thrshold = 0.1;
     if(normalization < 1.0-normalization_thrshold || normalization > 1.0+normalization_thrshold) {
       std::string norm_str; Tools::convert(normalization,norm_str);
@@ -302,7 +321,7 @@ void TargetDistribution::updateBiasCutoffForTargetDistGrid() {
   // plumed_massert(log_targetdist_grid_pntr_!=NULL,"the grids have not been setup using setupGrids");
   plumed_massert(getBiasWithoutCutoffGridPntr()!=NULL,"the bias without cutoff grid has to be linked");
   //
-  std::vector<double> integration_weights = GridIntegrationWeights::getIntegrationWeights(targetdist_grid_pntr_);
+  const std::vector<double>& integration_weights = targetdist_grid_integration_weights_;
   double norm = 0.0;
   for(Grid::index_t l=0; l<targetdist_grid_pntr_->getSize(); l++)
   {
@@ -327,7 +346,7 @@ void TargetDistribution::applyTargetDistModiferToGrid(TargetDistModifer* modifer
   // plumed_massert(targetdist_grid_pntr_!=NULL,"the grids have not been setup using setupGrids");
   // plumed_massert(log_targetdist_grid_pntr_!=NULL,"the grids have not been setup using setupGrids");
   //
-  std::vector<double> integration_weights = GridIntegrationWeights::getIntegrationWeights(targetdist_grid_pntr_);
+  const std::vector<double>& integration_weights = targetdist_grid_integration_weights_;
   double norm = 0.0;
   for(Grid::index_t l=0; l<targetdist_grid_pntr_->getSize(); l++)
   {
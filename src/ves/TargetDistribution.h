@@ -68,6 +68,8 @@ private:
   //
   Grid* targetdist_grid_pntr_;
   Grid* log_targetdist_grid_pntr_;
+  // integration weights of the target distribution grid, only depend on the grid
+  std::vector<double> targetdist_grid_integration_weights_;
   //
   std::vector<TargetDistModifer*> targetdist_modifer_pntrs_;
   //
@@ -157,6 +159,8 @@ public:
   //
   Grid* getTargetDistGridPntr() const {return targetdist_grid_pntr_;}
   Grid* getLogTargetDistGridPntr() const {return log_targetdist_grid_pntr_;}
+  const std::vector<double>& getTargetDistGridIntegrationWeights() const {return targetdist_grid_integration_weights_;}
+  double integrateTargetDistGrid() const;
   //
   void clearLogTargetDistGrid();
   // calculate the target distribution itself
@@ -172,7 +176,7 @@ public:
   //
   static double integrateGrid(const Grid*);
   static double normalizeGrid(Grid*);
-  static Grid getMarginalDistributionGrid(Grid*, const std::vector<std::string>&);
+  static Grid getMarginalDistributionGrid(Grid*, const std::vector<std::string>&, Communicator* comm_in=NULL);
   // empty standard action stuff
   void update() {};
   void apply() {};
@@ -194,15 +198,6 @@ Action* TargetDistribution::getPntrToAction() const {
 }
 
 
-inline
-void TargetDistribution::normalizeTargetDistGrid() {
-  double normalization = normalizeGrid(targetdist_grid_pntr_);
-  if(normalization<0.0) {plumed_merror(getName()+": something went wrong trying to normalize the target distribution, integrating over it gives a negative value.");}
-}
-
-
-
-
 }
 }
 #endif
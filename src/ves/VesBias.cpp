@@ -35,6 +35,10 @@
 #include "core/Atoms.h"
 #include "tools/File.h"
 
+#include "blas/blas.h"
+
+#include <algorithm>
+
 
 namespace PLMD {
 namespace ves {
@@ -56,7 +60,16 @@ VesBias::VesBias(const ActionOptions&ao):
   optimize_coeffs_(false),
   compute_hessian_(false),
   diagonal_hessian_(true),
+  hessian_bandwidth_(0),
   aver_counters(0),
+  sampled_averages_as_sums_(0),
+  hessian_block_size_(16),
+  hessian_sample_buffers_(0),
+  hessian_buffer_counters_(0),
+  mwalkers_reduction_buffers_(0),
+  mwalkers_packing_buffers_(0),
+  mwalkers_reduction_requests_(0),
+  mwalkers_reduction_pending_(0),
   kbt_(0.0),
   targetdist_pntrs_(0),
   dynamic_targetdist_(false),
@@ -230,6 +243,10 @@ VesBias::VesBias(const ActionOptions&ao):
 
 
 VesBias::~VesBias() {
+  // the result of a reduction still in flight is discarded, but it needs to be completed
+  for(unsigned int k=0; k<mwalkers_reduction_pending_.size(); k++) {
+    if(mwalkers_reduction_pending_[k] && comm.Get_rank()==0) {mwalkers_reduction_requests_[k].wait();}
+  }
   for(unsigned int i=0; i<coeffs_pntrs_.size(); i++) {
     delete coeffs_pntrs_[i];
   }
@@ -379,6 +396,12 @@ void VesBias::initializeCoeffs(CoeffsVector* coeffs_pntr_in) {
   sampled_cross_averages.push_back(cross_aver_sampled_tmp);
   //
   aver_counters.push_back(0);
+  sampled_averages_as_sums_.push_back(false);
+  hessian_sample_buffers_.push_back(std::vector<double>(0));
+  hessian_buffer_counters_.push_back(0);
+  if(!diagonal_hessian_) {
+    hessian_sample_buffers_.back().assign(hessian_block_size_*coeffs_pntr_in->numberOfCoeffs(),0.0);
+  }
   //
   ncoeffssets_++;
 }
@@ -399,6 +422,17 @@ bool VesBias::readCoeffsFromFiles() {
     for(unsigned int i=0; i<ncoeffssets_; i++) {
       IFile ifile;
       ifile.link(*this);
+      if(ifile.FileExist(coeffs_fnames[i]) && CoeffsBinaryFile::isBinaryFile(ifile.getPath())) {
+        size_t ncoeffs_read = coeffs_pntrs_[i]->readFromBinaryFile(ifile.getPath());
+        coeffs_pntrs_[i]->setIterationCounterAndTime(0,getTime());
+        if(ncoeffssets_==1) {
+          log.printf("%s (binary, read %zu of %zu values)\n", ifile.getPath().c_str(),ncoeffs_read,coeffs_pntrs_[i]->numberOfCoeffs());
+        }
+        else {
+          log.printf("   coefficent %u: %s (binary, read %zu of %zu values)\n",i,ifile.getPath().c_str(),ncoeffs_read,coeffs_pntrs_[i]->numberOfCoeffs());
+        }
+        continue;
+      }
       ifile.open(coeffs_fnames[i]);
       if(!ifile.FieldExist(coeffs_pntrs_[i]->getDataLabel())) {
         std::string error_msg = "Problem with reading coefficents from file " + ifile.getPath() + ": no field with name " + coeffs_pntrs_[i]->getDataLabel() + "\n";
@@ -420,15 +454,32 @@ bool VesBias::readCoeffsFromFiles() {
 }
 
 
-void VesBias::updateGradientAndHessian(const bool use_mwalkers_mpi) {
+bool VesBias::updateGradientAndHessian(const bool use_mwalkers_mpi, const bool nonblocking_mwalkers) {
+  addBufferedSamplesToAverages();
+  bool gradient_available = true;
   for(unsigned int k=0; k<ncoeffssets_; k++) {
     //
+    flushHessianSampleBuffer(k);
+    if(sampled_averages_as_sums_[k]) {convertSampledSumsToAverages(k);}
     comm.Sum(sampled_averages[k]);
     comm.Sum(sampled_cross_averages[k]);
+    unsigned int total_samples = aver_counters[k];
     if(use_mwalkers_mpi) {
       double walker_weight=1.0;
       if(aver_counters[k]==0) {walker_weight=0.0;}
-      multiSimSumAverages(k,walker_weight);
+      if(nonblocking_mwalkers) {
+        // the averages of the previous stride are used, on the first stride there are none
+        if(!multiSimSumAveragesNonBlocking(k,total_samples,walker_weight)) {
+          gradient_available = false;
+          total_samples = 0;
+        }
+      }
+      else {
+        multiSimSumAverages(k,walker_weight);
+        // Check the total number of samples (from all walkers)
+        if(comm.Get_rank()==0) {multi_sim_comm.Sum(total_samples);}
+        comm.Bcast(total_samples,0);
+      }
     }
     // NOTE: this assumes that all walkers have the same TargetDist, might change later on!!
     Gradient(k).setValues( TargetDistAverages(k) - sampled_averages[k] );
@@ -438,13 +489,7 @@ void VesBias::updateGradientAndHessian(const bool use_mwalkers_mpi) {
     Gradient(k).activate();
     Hessian(k).activate();
     //
-    // Check the total number of samples (from all walkers) and deactivate the Gradient and Hessian if it
-    // is zero
-    unsigned int total_samples = aver_counters[k];
-    if(use_mwalkers_mpi) {
-      if(comm.Get_rank()==0) {multi_sim_comm.Sum(total_samples);}
-      comm.Bcast(total_samples,0);
-    }
+    // Deactivate the Gradient and Hessian if the total number of samples is zero
     if(total_samples==0) {
       Gradient(k).deactivate();
       Gradient(k).clear();
@@ -456,6 +501,7 @@ void VesBias::updateGradientAndHessian(const bool use_mwalkers_mpi) {
     std::fill(sampled_cross_averages[k].begin(), sampled_cross_averages[k].end(), 0.0);
     aver_counters[k]=0;
   }
+  return gradient_available;
 }
 
 
@@ -488,7 +534,64 @@ void VesBias::multiSimSumAverages(const unsigned int c_id, const double walker_w
 }
 
 
+bool VesBias::multiSimSumAveragesNonBlocking(const unsigned int c_id, unsigned int& total_samples, const double walker_weight) {
+  plumed_massert(walker_weight>=0.0,"the weight of the walker cannot be negative!");
+  /*
+  The averages of this walker are packed together with the weight and the number of
+  samples and summed over the walkers with a non-blocking reduction. The reduction
+  started on the previous call is completed here, so the averages of the previous
+  stride replace the current ones and the MD can continue while the new sum is in flight.
+  */
+  if(mwalkers_reduction_pending_.size()!=ncoeffssets_) {
+    mwalkers_reduction_buffers_.resize(ncoeffssets_);
+    mwalkers_packing_buffers_.resize(ncoeffssets_);
+    mwalkers_reduction_requests_.resize(ncoeffssets_);
+    mwalkers_reduction_pending_.assign(ncoeffssets_,false);
+  }
+  size_t naverages = sampled_averages[c_id].size();
+  size_t ncross = sampled_cross_averages[c_id].size();
+  std::vector<double>& packing = mwalkers_packing_buffers_[c_id];
+  packing.resize(naverages+ncross+2);
+  for(size_t i=0; i<naverages; i++) {
+    packing[i] = walker_weight*sampled_averages[c_id][i];
+  }
+  for(size_t i=0; i<ncross; i++) {
+    packing[naverages+i] = walker_weight*sampled_cross_averages[c_id][i];
+  }
+  packing[naverages+ncross] = walker_weight;
+  packing[naverages+ncross+1] = static_cast<double>(aver_counters[c_id]);
+  //
+  bool reduced = mwalkers_reduction_pending_[c_id];
+  if(reduced) {
+    if(comm.Get_rank()==0) {
+      mwalkers_reduction_requests_[c_id].wait();
+      const std::vector<double>& reduction = mwalkers_reduction_buffers_[c_id];
+      double norm_weights = reduction[naverages+ncross];
+      if(norm_weights>0.0) {norm_weights=1.0/norm_weights;}
+      for(size_t i=0; i<naverages; i++) {
+        sampled_averages[c_id][i] = norm_weights*reduction[i];
+      }
+      for(size_t i=0; i<ncross; i++) {
+        sampled_cross_averages[c_id][i] = norm_weights*reduction[naverages+i];
+      }
+      total_samples = static_cast<unsigned int>(reduction[naverages+ncross+1]+0.5);
+    }
+    comm.Bcast(sampled_averages[c_id],0);
+    comm.Bcast(sampled_cross_averages[c_id],0);
+    comm.Bcast(total_samples,0);
+  }
+  //
+  mwalkers_packing_buffers_[c_id].swap(mwalkers_reduction_buffers_[c_id]);
+  if(comm.Get_rank()==0) {
+    mwalkers_reduction_requests_[c_id] = multi_sim_comm.Isum(mwalkers_reduction_buffers_[c_id]);
+  }
+  mwalkers_reduction_pending_[c_id] = true;
+  return reduced;
+}
+
+
 void VesBias::addToSampledAverages(const std::vector<double>& values, const unsigned int c_id) {
+  if(sampled_averages_as_sums_[c_id]) {convertSampledSumsToAverages(c_id);}
   /*
   use the following online equation to calculate the average and covariance
   (see https://en.wikipedia.org/wiki/Algorithms_for_calculating_variance#Covariance)
@@ -496,23 +599,51 @@ void VesBias::addToSampledAverages(const std::vector<double>& values, const unsi
   */
   double counter_dbl = static_cast<double>(aver_counters[c_id]);
   size_t ncoeffs = numberOfCoeffs(c_id);
-  std::vector<double> deltas(ncoeffs,0.0);
   size_t stride = comm.Get_size();
   size_t rank = comm.Get_rank();
   // update average and diagonal part of Hessian
   for(size_t i=rank; i<ncoeffs; i+=stride) {
     size_t midx = getHessianIndex(i,i,c_id);
-    deltas[i] = (values[i]-sampled_averages[c_id][i])/(counter_dbl+1); // (x[n+1]-xm[n])/(n+1)
-    sampled_averages[c_id][i] += deltas[i];
+    double delta = (values[i]-sampled_averages[c_id][i])/(counter_dbl+1); // (x[n+1]-xm[n])/(n+1)
+    sampled_averages[c_id][i] += delta;
     sampled_cross_averages[c_id][midx] += (values[i]*values[i]-sampled_cross_averages[c_id][midx])/(counter_dbl+1);
   }
-  comm.Sum(deltas);
-  // update off-diagonal part of the Hessian
+  // the off-diagonal part of the Hessian is updated in blocks of samples,
+  // see flushHessianSampleBuffer()
   if(!diagonal_hessian_) {
-    for(size_t i=rank; i<ncoeffs; i+=stride) {
-      for(size_t j=(i+1); j<ncoeffs; j++) {
-        size_t midx = getHessianIndex(i,j,c_id);
-        sampled_cross_averages[c_id][midx] += (values[i]*values[j]-sampled_cross_averages[c_id][midx])/(counter_dbl+1);
+    std::copy(values.begin(),values.begin()+ncoeffs,hessian_sample_buffers_[c_id].begin()+hessian_buffer_counters_[c_id]*ncoeffs);
+    hessian_buffer_counters_[c_id] += 1;
+  }
+  // NOTE: the MPI sum for sampled_averages and sampled_cross_averages is done later
+  aver_counters[c_id] += 1;
+  if(!diagonal_hessian_ && hessian_buffer_counters_[c_id]==hessian_block_size_) {
+    flushHessianSampleBuffer(c_id);
+  }
+}
+
+
+void VesBias::addToSampledAverages(const std::vector<double>& values, const std::vector<size_t>& indices, const unsigned int c_id) {
+  /*
+  the running average would touch all the coefficients for each sample, so the sums
+      xs[n+1] = xs[n] + x[n+1]
+  are accumulated instead for the few coefficients that are non-zero, and only divided
+  by the number of samples when the averages are needed
+  */
+  plumed_dbg_assert(values.size()==indices.size());
+  if(!sampled_averages_as_sums_[c_id]) {convertSampledAveragesToSums(c_id);}
+  size_t stride = comm.Get_size();
+  size_t rank = comm.Get_rank();
+  for(size_t a=0; a<indices.size(); a++) {
+    size_t i = indices[a];
+    if(i%stride!=rank) {continue;}
+    sampled_averages[c_id][i] += values[a];
+    if(diagonal_hessian_) {
+      sampled_cross_averages[c_id][getHessianIndex(i,i,c_id)] += values[a]*values[a];
+    }
+    else {
+      for(size_t b=0; b<indices.size(); b++) {
+        if(indices[b]<i || !hessian_pntrs_[c_id]->isStoredElement(i,indices[b])) {continue;}
+        sampled_cross_averages[c_id][getHessianIndex(i,indices[b],c_id)] += values[a]*values[b];
       }
     }
   }
@@ -521,6 +652,119 @@ void VesBias::addToSampledAverages(const std::vector<double>& values, const unsi
 }
 
 
+void VesBias::convertSampledAveragesToSums(const unsigned int c_id) {
+  flushHessianSampleBuffer(c_id);
+  double counter_dbl = static_cast<double>(aver_counters[c_id]);
+  for(size_t i=0; i<sampled_averages[c_id].size(); i++) {sampled_averages[c_id][i] *= counter_dbl;}
+  for(size_t i=0; i<sampled_cross_averages[c_id].size(); i++) {sampled_cross_averages[c_id][i] *= counter_dbl;}
+  sampled_averages_as_sums_[c_id] = true;
+}
+
+
+void VesBias::convertSampledSumsToAverages(const unsigned int c_id) {
+  double inv_counter = 0.0;
+  if(aver_counters[c_id]>0) {inv_counter = 1.0/static_cast<double>(aver_counters[c_id]);}
+  for(size_t i=0; i<sampled_averages[c_id].size(); i++) {sampled_averages[c_id][i] *= inv_counter;}
+  for(size_t i=0; i<sampled_cross_averages[c_id].size(); i++) {sampled_cross_averages[c_id][i] *= inv_counter;}
+  sampled_averages_as_sums_[c_id] = false;
+}
+
+
+void VesBias::addToSampledAveragesBatch(const size_t nsamples, const std::vector<double>& values, const unsigned int c_id) {
+  if(nsamples==0) {return;}
+  if(sampled_averages_as_sums_[c_id]) {convertSampledSumsToAverages(c_id);}
+  /*
+  the K samples x[n+1],...,x[n+K] are added to the averages in one go
+      xm[n+K] = n/(n+K)*xm[n] + 1/(n+K)*sum_k x[n+k]
+  The sums over the samples are done for blocks of coefficients that fit
+  in the cache, such that the averages are only read and written once.
+  */
+  size_t ncoeffs = numberOfCoeffs(c_id);
+  plumed_dbg_assert(values.size()>=ncoeffs*nsamples);
+  double counter_dbl = static_cast<double>(aver_counters[c_id]);
+  double alpha = 1.0/(counter_dbl+nsamples);
+  double beta = counter_dbl*alpha;
+  size_t stride = comm.Get_size();
+  size_t rank = comm.Get_rank();
+  const size_t block_size = 256;
+  double sums[block_size];
+  double sums2[block_size];
+  for(size_t ib=0; ib<ncoeffs; ib+=block_size) {
+    size_t ie = std::min(ib+block_size,ncoeffs);
+    // first coefficient of this MPI process in the block
+    size_t ifirst = ib + (rank+stride-ib%stride)%stride;
+    for(size_t i=ifirst; i<ie; i+=stride) {sums[i-ib]=0.0; sums2[i-ib]=0.0;}
+    for(size_t k=0; k<nsamples; k++) {
+      const double* x = &values[k*ncoeffs];
+      for(size_t i=ifirst; i<ie; i+=stride) {
+        sums[i-ib] += x[i];
+        sums2[i-ib] += x[i]*x[i];
+      }
+    }
+    for(size_t i=ifirst; i<ie; i+=stride) {
+      size_t midx = getHessianIndex(i,i,c_id);
+      sampled_averages[c_id][i] = beta*sampled_averages[c_id][i] + alpha*sums[i-ib];
+      sampled_cross_averages[c_id][midx] = beta*sampled_cross_averages[c_id][midx] + alpha*sums2[i-ib];
+    }
+  }
+  // the off-diagonal part of the Hessian is updated directly from the samples,
+  // after the samples that are already buffered
+  if(!diagonal_hessian_) {
+    flushHessianSampleBuffer(c_id);
+    addSampleBlockToHessian(values.data(),nsamples,aver_counters[c_id],c_id);
+  }
+  // NOTE: the MPI sum for sampled_averages and sampled_cross_averages is done later
+  aver_counters[c_id] += nsamples;
+}
+
+
+void VesBias::flushHessianSampleBuffer(const unsigned int c_id) {
+  if(diagonal_hessian_ || hessian_buffer_counters_[c_id]==0) {return;}
+  size_t nsamples = hessian_buffer_counters_[c_id];
+  addSampleBlockToHessian(hessian_sample_buffers_[c_id].data(),nsamples,aver_counters[c_id]-nsamples,c_id);
+  hessian_buffer_counters_[c_id] = 0;
+}
+
+
+void VesBias::addSampleBlockToHessian(const double* samples_in, const size_t nsamples_in, const size_t nprevious, const unsigned int c_id) {
+  /*
+  the K samples x[n+1],...,x[n+K] are added to the average in one go
+      xm[n+K] = n/(n+K)*xm[n] + 1/(n+K)*sum_k x[n+k] x[n+k]^T
+  The off-diagonal part of each row of the Hessian is stored contiguously,
+  so each row is updated with a single matrix-vector product over the block.
+  */
+  int nsamples = static_cast<int>(nsamples_in);
+  int ncoeffs = static_cast<int>(numberOfCoeffs(c_id));
+  double counter_dbl = static_cast<double>(nprevious);
+  double alpha = 1.0/(counter_dbl+nsamples);
+  double beta = counter_dbl*alpha;
+  int one = 1;
+  double* samples = const_cast<double*>(samples_in);
+  size_t stride = comm.Get_size();
+  size_t rank = comm.Get_rank();
+  if(hessian_pntrs_[c_id]->isBanded()) {
+    // only the few stored elements of each row, no need for BLAS
+    const CoeffsMatrix& hessian = *hessian_pntrs_[c_id];
+    for(size_t i=rank; i<numberOfCoeffs(c_id); i+=stride) {
+      for(size_t e=hessian.rowBegin(i)+1; e<hessian.rowEnd(i); e++) {
+        size_t j = hessian.getColumnIndex(i,e);
+        double sum = 0.0;
+        for(int k=0; k<nsamples; k++) {
+          sum += samples[k*ncoeffs+i]*samples[k*ncoeffs+j];
+        }
+        sampled_cross_averages[c_id][e] = beta*sampled_cross_averages[c_id][e] + alpha*sum;
+      }
+    }
+    return;
+  }
+  for(size_t i=rank; i+1<numberOfCoeffs(c_id); i+=stride) {
+    int nrows = ncoeffs-static_cast<int>(i)-1;
+    double* row = &sampled_cross_averages[c_id][getHessianIndex(i,i+1,c_id)];
+    plumed_blas_dgemv("N",&nrows,&nsamples,&alpha,samples+i+1,&ncoeffs,samples+i,&ncoeffs,&beta,row,&one);
+  }
+}
+
+
 void VesBias::setTargetDistAverages(const std::vector<double>& coeffderivs_aver_ps, const unsigned int coeffs_id) {
   TargetDistAverages(coeffs_id) = coeffderivs_aver_ps;
   TargetDistAverages(coeffs_id).setIterationCounterAndTime(this->getIterationCounter(),this->getTime());
@@ -574,25 +818,40 @@ void VesBias::linkOptimizer(Optimizer* optimizer_pntr_in) {
 }
 
 
-void VesBias::enableHessian(const bool diagonal_hessian) {
+void VesBias::enableHessian(const bool diagonal_hessian, const std::vector<unsigned int>& bandwidth) {
   compute_hessian_=true;
   diagonal_hessian_=diagonal_hessian;
+  hessian_bandwidth_=bandwidth;
+  plumed_massert(!diagonal_hessian_ || hessian_bandwidth_.size()==0,"a banded Hessian cannot be diagonal");
   sampled_cross_averages.clear();
   for (unsigned int i=0; i<ncoeffssets_; i++) {
     delete hessian_pntrs_[i];
     std::string label = getCoeffsSetLabelString("hessian",i);
-    hessian_pntrs_[i] = new CoeffsMatrix(label,coeffs_pntrs_[i],comm,diagonal_hessian_);
+    if(hessian_bandwidth_.size()>0) {
+      // one common value or one value for each dimension of the coefficient set
+      std::vector<unsigned int> bandwidth = hessian_bandwidth_;
+      if(bandwidth.size()==1) {bandwidth.assign(coeffs_pntrs_[i]->numberOfDimensions(),hessian_bandwidth_[0]);}
+      if(bandwidth.size()!=coeffs_pntrs_[i]->numberOfDimensions()) {
+        plumed_merror("VES bias " + getLabel() + ": the bandwidth of the Hessian should be given either as one value or as one value for each dimension");
+      }
+      hessian_pntrs_[i] = new CoeffsMatrix(label,coeffs_pntrs_[i],comm,bandwidth);
+    }
+    else {
+      hessian_pntrs_[i] = new CoeffsMatrix(label,coeffs_pntrs_[i],comm,diagonal_hessian_);
+    }
     //
     std::vector<double> cross_aver_sampled_tmp;
     cross_aver_sampled_tmp.assign(hessian_pntrs_[i]->getSize(),0.0);
     sampled_cross_averages.push_back(cross_aver_sampled_tmp);
   }
+  setupHessianSampleBuffers();
 }
 
 
 void VesBias::disableHessian() {
   compute_hessian_=false;
   diagonal_hessian_=true;
+  hessian_bandwidth_.clear();
   sampled_cross_averages.clear();
   for (unsigned int i=0; i<ncoeffssets_; i++) {
     delete hessian_pntrs_[i];
@@ -603,6 +862,18 @@ void VesBias::disableHessian() {
     cross_aver_sampled_tmp.assign(hessian_pntrs_[i]->getSize(),0.0);
     sampled_cross_averages.push_back(cross_aver_sampled_tmp);
   }
+  setupHessianSampleBuffers();
+}
+
+
+void VesBias::setupHessianSampleBuffers() {
+  hessian_sample_buffers_.assign(ncoeffssets_,std::vector<double>(0));
+  hessian_buffer_counters_.assign(ncoeffssets_,0);
+  if(!diagonal_hessian_) {
+    for(unsigned int i=0; i<ncoeffssets_; i++) {
+      hessian_sample_buffers_[i].assign(hessian_block_size_*numberOfCoeffs(i),0.0);
+    }
+  }
 }
 
 
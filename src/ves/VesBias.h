@@ -29,6 +29,7 @@
 #include "core/ActionWithValue.h"
 #include "core/ActionWithArguments.h"
 #include "bias/Bias.h"
+#include "tools/Communicator.h"
 
 #include <vector>
 #include <string>
@@ -78,8 +79,23 @@ private:
   //
   bool compute_hessian_;
   bool diagonal_hessian_;
+  // bandwidth in each dimension for a banded Hessian, empty otherwise
+  std::vector<unsigned int> hessian_bandwidth_;
   //
   std::vector<unsigned int> aver_counters;
+  // samples added for only a few active coefficients are accumulated as sums,
+  // which are converted to averages when needed, see addToSampledAverages()
+  std::vector<bool> sampled_averages_as_sums_;
+  // samples buffered for the block update of the off-diagonal part of the Hessian
+  unsigned int hessian_block_size_;
+  std::vector<std::vector<double> > hessian_sample_buffers_;
+  std::vector<unsigned int> hessian_buffer_counters_;
+  // averages of this walker that are being summed over the walkers in the background,
+  // see updateGradientAndHessian() with a non-blocking multiple walkers reduction
+  std::vector<std::vector<double> > mwalkers_reduction_buffers_;
+  std::vector<std::vector<double> > mwalkers_packing_buffers_;
+  std::vector<Communicator::Request> mwalkers_reduction_requests_;
+  std::vector<bool> mwalkers_reduction_pending_;
   //
   double kbt_;
   //
@@ -122,6 +138,12 @@ private:
   void initializeCoeffs(CoeffsVector*);
   std::vector<double> computeCovarianceFromAverages(const unsigned int) const;
   void multiSimSumAverages(const unsigned int, const double walker_weight=1.0);
+  void setupHessianSampleBuffers();
+  void flushHessianSampleBuffer(const unsigned int c_id = 0);
+  void addSampleBlockToHessian(const double*, const size_t, const size_t, const unsigned int c_id = 0);
+  void convertSampledAveragesToSums(const unsigned int c_id = 0);
+  void convertSampledSumsToAverages(const unsigned int c_id = 0);
+  bool multiSimSumAveragesNonBlocking(const unsigned int, unsigned int&, const double walker_weight=1.0);
 protected:
   //
   void checkThatTemperatureIsGiven();
@@ -132,7 +154,6 @@ protected:
   //
   std::string getCoeffsSetLabelString(const std::string&, const unsigned int coeffs_id = 0) const;
   void clearCoeffsPntrsVector() {coeffs_pntrs_.clear();}
-  void addToSampledAverages(const std::vector<double>&, const unsigned int c_id = 0);
   void setTargetDistAverages(const std::vector<double>&, const unsigned int coeffs_id = 0);
   void setTargetDistAverages(const CoeffsVector&, const unsigned int coeffs_id= 0);
   void setTargetDistAveragesToZero(const unsigned int coeffs_id= 0);
@@ -197,14 +218,25 @@ public:
   //
   unsigned int getIterationCounter() const;
   //
-  void updateGradientAndHessian(const bool);
+  // add the derivatives of the bias with respect to the coefficients for one sample to the averages
+  void addToSampledAverages(const std::vector<double>&, const unsigned int c_id = 0);
+  // same as above for a sample where only the coefficients with the given indices have non-zero derivatives
+  void addToSampledAverages(const std::vector<double>&, const std::vector<size_t>&, const unsigned int c_id = 0);
+  // add the derivatives for several samples at once, given as values[i+ncoeffs*s] for sample s,
+  // such that the averages are only updated once for the whole block of samples
+  void addToSampledAveragesBatch(const size_t, const std::vector<double>&, const unsigned int c_id = 0);
+  bool updateGradientAndHessian(const bool, const bool nonblocking_mwalkers=false);
   void clearGradientAndHessian() {};
   //
   virtual void updateTargetDistributions() {};
   virtual void restartTargetDistributions() {};
+  // called by the optimizer after the coefficients have been updated
+  virtual void coeffsUpdated() {};
+  // add samples that have been buffered by the bias to the sampled averages, called before the gradient is updated
+  virtual void addBufferedSamplesToAverages() {};
   //
   void linkOptimizer(Optimizer*);
-  void enableHessian(const bool diagonal_hessian=true);
+  void enableHessian(const bool diagonal_hessian=true, const std::vector<unsigned int>& bandwidth=std::vector<unsigned int>(0));
   void disableHessian();
   //
   void enableMultipleCoeffsSets() {use_multiple_coeffssets_=true;}
@@ -368,9 +400,11 @@ std::vector<double> VesBias::computeCovarianceFromAverages(const unsigned int c_
     covariance[midx] = sampled_cross_averages[c_id][midx] - sampled_averages[c_id][i]*sampled_averages[c_id][i];
   }
   if(!diagonal_hessian_) {
+    // only the stored elements of the upper triangle, see CoeffsMatrix::rowBegin()
+    const CoeffsMatrix& hessian = *hessian_pntrs_[c_id];
     for(size_t i=0; i<ncoeffs; i++) {
-      for(size_t j=(i+1); j<ncoeffs; j++) {
-        size_t midx = getHessianIndex(i,j,c_id);
+      for(size_t midx=hessian.rowBegin(i)+1; midx<hessian.rowEnd(i); midx++) {
+        size_t j = hessian.getColumnIndex(i,midx);
         covariance[midx] = sampled_cross_averages[c_id][midx] - sampled_averages[c_id][i]*sampled_averages[c_id][j];
       }
     }
@@ -105,6 +105,26 @@ also used for the output files (see next section).
 The size of the grid is determined by the GRID_BINS keyword. By default it has
 100 grid points in each dimension, and generally this value should be sufficent.
 
+By using the BIAS_INTERPOLATION keyword the bias and the forces are not
+evaluated from the basis set expansion in each MD step but rather interpolated
+from the same grid, either with splines (SPLINE) or linearly (LINEAR).
+The grid is only recalculated when the coefficients are updated by the
+optimizer, such that the cost of each MD step does not depend on the size of
+the basis set. The basis functions that are needed for the optimization
+are then evaluated in batches of samples. Note that the interpolation
+introduces an error that depends on the number of grid bins.
+
+By using the SAMPLE_BATCH_SIZE keyword the averages of the basis functions
+that are needed for the optimization are not updated in each MD step.
+Instead the CV values are kept in a buffer of the given size, and the basis functions
+are evaluated and added to the averages in one batch when the buffer is full
+or when the coefficients are updated. This reduces the memory traffic for
+large basis sets, as the averages are then only updated once for each batch
+of samples. The keyword also sets the size of the batches used with
+BIAS_INTERPOLATION, where it is 100 by default. It is not used for basis
+functions with compact support, where only the few active coefficients
+are updated in each step.
+
 \par Outputting Free Energy Surfaces and Other Files
 
 It is possible to output on-the-fly during the simulation the free energy surface
@@ -287,12 +307,33 @@ private:
   LinearBasisSetExpansion* bias_expansion_pntr_;
   size_t ncoeffs_;
   Value* valueForce2_;
+  // kept between calls such that calculate() does not allocate memory
+  std::vector<double> cv_values_;
+  std::vector<double> forces_;
+  std::vector<double> coeffsderivs_values_;
+  bool bias_interpolation_grid_outdated_;
+  // samples kept until they are added to the averages in one batch, when the bias is interpolated
+  // from a grid or if requested with SAMPLE_BATCH_SIZE
+  bool sample_batching_;
+  unsigned int sample_batch_size_;
+  unsigned int sample_buffer_counter_;
+  std::vector<double> sample_args_buffer_;
+  std::vector<double> sample_cutoff_factors_buffer_;
+  std::vector<double> sample_basisset_values_;
+  // for basis functions with compact support only the active coefficients are considered
+  std::vector<double> active_coeffsderivs_values_;
+  std::vector<size_t> active_coeffs_indices_;
+  //
+  void setBiasAndOutputForces(const double);
 public:
   explicit VesLinearExpansion(const ActionOptions&);
   ~VesLinearExpansion();
   void calculate();
   void updateTargetDistributions();
   void restartTargetDistributions();
+  void coeffsUpdated();
+  void addBufferedSamplesToAverages();
+  void addSampleToBuffer(const double);
   //
   void setupBiasFileOutput();
   void writeBiasToFile();
@@ -326,6 +367,9 @@ void VesLinearExpansion::registerKeywords( Keywords& keys ) {
   //
   keys.use("ARG");
   keys.add("compulsory","BASIS_FUNCTIONS","the label of the one dimensional basis functions that should be used.");
+  keys.addFlag("FACTORIZED_EVALUATION",false,"evaluate the bias, the forces and the coefficient derivatives by contracting the coefficients with the basis functions one dimension at a time. The cost then scales linearly with the number of coefficients, which is considerably faster for two- and three-dimensional expansions.");
+  keys.add("optional","BIAS_INTERPOLATION","evaluate the bias and the forces in each step by interpolating them from a grid (SPLINE or LINEAR) rather than from the basis set expansion. The grid is given by the GRID_BINS keyword and is only recalculated when the coefficients are updated, while the basis functions needed for the optimization are evaluated in batches of samples.");
+  keys.add("optional","SAMPLE_BATCH_SIZE","buffer the CV values of this number of steps and add them to the averages needed for the optimization in one batch, rather than in each step.");
   keys.addOutputComponent("force2","default","the instantaneous value of the squared force due to this bias potential.");
 }
 
@@ -334,10 +378,30 @@ VesLinearExpansion::VesLinearExpansion(const ActionOptions&ao):
   nargs_(getNumberOfArguments()),
   basisf_pntrs_(0),
   bias_expansion_pntr_(NULL),
-  valueForce2_(NULL)
+  valueForce2_(NULL),
+  cv_values_(nargs_),
+  forces_(nargs_),
+  bias_interpolation_grid_outdated_(true),
+  sample_batching_(false),
+  sample_batch_size_(100),
+  sample_buffer_counter_(0),
+  sample_args_buffer_(0),
+  sample_cutoff_factors_buffer_(0),
+  sample_basisset_values_(0),
+  active_coeffsderivs_values_(0),
+  active_coeffs_indices_(0)
 {
   std::vector<std::string> basisf_labels;
   parseMultipleValues("BASIS_FUNCTIONS",basisf_labels,nargs_);
+  bool factorized_evaluation=false;
+  parseFlag("FACTORIZED_EVALUATION",factorized_evaluation);
+  std::string bias_interpolation="";
+  parse("BIAS_INTERPOLATION",bias_interpolation);
+  if(bias_interpolation.size()>0 && bias_interpolation!="SPLINE" && bias_interpolation!="LINEAR") {
+    plumed_merror("BIAS_INTERPOLATION should be either SPLINE or LINEAR");
+  }
+  unsigned int sample_batch_size=0;
+  parse("SAMPLE_BATCH_SIZE",sample_batch_size);
   checkRead();
 
   std::string error_msg = "";
@@ -360,12 +424,47 @@ VesLinearExpansion::VesLinearExpansion(const ActionOptions&ao):
 
   addCoeffsSet(args_pntrs,basisf_pntrs_);
   ncoeffs_ = numberOfCoeffs();
+  coeffsderivs_values_.assign(ncoeffs_,0.0);
   bool coeffs_read = readCoeffsFromFiles();
 
   checkThatTemperatureIsGiven();
   bias_expansion_pntr_ = new LinearBasisSetExpansion(getLabel(),getBeta(),comm,args_pntrs,basisf_pntrs_,getCoeffsPntr());
   bias_expansion_pntr_->linkVesBias(this);
   bias_expansion_pntr_->setGridBins(this->getGridBins());
+  if(factorized_evaluation) {
+    bias_expansion_pntr_->enableFactorizedEvaluation();
+    log.printf("  bias, forces and coefficient derivatives evaluated by contracting the coefficients one dimension at a time\n");
+  }
+  if(bias_expansion_pntr_->compactSupport()) {
+    log.printf("  all basis functions have compact support, only the coefficients that are active at the current CV values are considered\n");
+  }
+  if(sample_batch_size>0) {
+    sample_batch_size_ = sample_batch_size;
+  }
+  if(bias_interpolation.size()>0) {
+    bias_expansion_pntr_->setupBiasInterpolationGrid(bias_interpolation=="LINEAR");
+    if(bias_interpolation=="LINEAR") {
+      log.printf("  bias and forces linearly interpolated from a grid that is updated when the coefficients change\n");
+    }
+    else {
+      log.printf("  bias and forces interpolated with splines from a grid that is updated when the coefficients change\n");
+    }
+    sample_batching_ = true;
+  }
+  else if(sample_batch_size>0) {
+    if(bias_expansion_pntr_->compactSupport()) {
+      log.printf("  SAMPLE_BATCH_SIZE is not used as only the active coefficients are updated in each step\n");
+    }
+    else {
+      sample_batching_ = true;
+    }
+  }
+  if(sample_batching_) {
+    log.printf("  the basis functions for the sampled averages are evaluated in batches of %u samples\n",sample_batch_size_);
+    sample_args_buffer_.assign(nargs_*sample_batch_size_,0.0);
+    sample_cutoff_factors_buffer_.assign(sample_batch_size_,1.0);
+    sample_basisset_values_.assign(ncoeffs_*sample_batch_size_,0.0);
+  }
   //
 
 
@@ -408,31 +507,119 @@ VesLinearExpansion::~VesLinearExpansion() {
 
 void VesLinearExpansion::calculate() {
 
-  std::vector<double> cv_values(nargs_);
-  std::vector<double> forces(nargs_);
-  std::vector<double> coeffsderivs_values(ncoeffs_);
-
   for(unsigned int k=0; k<nargs_; k++) {
-    cv_values[k]=getArgument(k);
+    cv_values_[k]=getArgument(k);
   }
 
   bool all_inside = true;
-  double bias = bias_expansion_pntr_->getBiasAndForces(cv_values,all_inside,forces,coeffsderivs_values);
-  if(biasCutoffActive()) {
-    applyBiasCutoff(bias,forces,coeffsderivs_values);
-    coeffsderivs_values[0]=1.0;
+  if(sample_batching_) {
+    double bias;
+    if(bias_expansion_pntr_->biasInterpolationActive()) {
+      if(bias_interpolation_grid_outdated_) {
+        bias_expansion_pntr_->updateBiasInterpolationGrid();
+        bias_interpolation_grid_outdated_ = false;
+      }
+      bias = bias_expansion_pntr_->getBiasAndForcesFromInterpolationGrid(cv_values_,all_inside,forces_);
+    }
+    else {
+      bias = bias_expansion_pntr_->getBiasAndForces(cv_values_,all_inside,forces_);
+    }
+    double cutoff_factor = 1.0;
+    if(biasCutoffActive()) {
+      getBiasCutoffSwitchingFunction(bias,cutoff_factor);
+      applyBiasCutoff(bias,forces_);
+    }
+    setBiasAndOutputForces(bias);
+    // the basis functions are only needed for the averages used by the optimizer,
+    // they are evaluated later for a whole batch
+    if(all_inside && optimizeCoeffs()) {
+      addSampleToBuffer(cutoff_factor);
+    }
+  }
+  else if(bias_expansion_pntr_->compactSupport()) {
+    double bias = bias_expansion_pntr_->getBiasAndForcesCompact(cv_values_,all_inside,forces_,active_coeffsderivs_values_,active_coeffs_indices_);
+    if(biasCutoffActive()) {
+      applyBiasCutoff(bias,forces_,active_coeffsderivs_values_);
+      // the constant is always the first active coefficient
+      active_coeffsderivs_values_[0]=1.0;
+    }
+    setBiasAndOutputForces(bias);
+    if(all_inside) {
+      addToSampledAverages(active_coeffsderivs_values_,active_coeffs_indices_);
+    }
   }
+  else {
+    double bias = bias_expansion_pntr_->getBiasAndForces(cv_values_,all_inside,forces_,coeffsderivs_values_);
+    if(biasCutoffActive()) {
+      applyBiasCutoff(bias,forces_,coeffsderivs_values_);
+      coeffsderivs_values_[0]=1.0;
+    }
+    setBiasAndOutputForces(bias);
+    if(all_inside) {
+      addToSampledAverages(coeffsderivs_values_);
+    }
+  }
+}
+
+
+void VesLinearExpansion::setBiasAndOutputForces(const double bias) {
   double totalForce2 = 0.0;
   for(unsigned int k=0; k<nargs_; k++) {
-    setOutputForce(k,forces[k]);
-    totalForce2 += forces[k]*forces[k];
+    setOutputForce(k,forces_[k]);
+    totalForce2 += forces_[k]*forces_[k];
   }
-
   setBias(bias);
   valueForce2_->set(totalForce2);
-  if(all_inside) {
-    addToSampledAverages(coeffsderivs_values);
+}
+
+
+void VesLinearExpansion::coeffsUpdated() {
+  bias_interpolation_grid_outdated_ = true;
+}
+
+
+void VesLinearExpansion::addSampleToBuffer(const double cutoff_factor) {
+  std::copy(cv_values_.begin(),cv_values_.end(),sample_args_buffer_.begin()+nargs_*sample_buffer_counter_);
+  sample_cutoff_factors_buffer_[sample_buffer_counter_] = cutoff_factor;
+  sample_buffer_counter_++;
+  if(sample_buffer_counter_==sample_batch_size_) {
+    addBufferedSamplesToAverages();
+  }
+}
+
+
+void VesLinearExpansion::addBufferedSamplesToAverages() {
+  if(sample_buffer_counter_==0) {return;}
+  if(bias_expansion_pntr_->compactSupport()) {
+    std::vector<double> args(nargs_);
+    for(unsigned int s=0; s<sample_buffer_counter_; s++) {
+      std::copy(sample_args_buffer_.begin()+nargs_*s,sample_args_buffer_.begin()+nargs_*(s+1),args.begin());
+      bool all_inside = true;
+      bias_expansion_pntr_->getBiasAndForcesCompact(args,all_inside,forces_,active_coeffsderivs_values_,active_coeffs_indices_);
+      if(biasCutoffActive()) {
+        for(size_t a=0; a<active_coeffsderivs_values_.size(); a++) {
+          active_coeffsderivs_values_[a] *= sample_cutoff_factors_buffer_[s];
+        }
+        active_coeffsderivs_values_[0]=1.0;
+      }
+      addToSampledAverages(active_coeffsderivs_values_,active_coeffs_indices_);
+    }
+    sample_buffer_counter_=0;
+    return;
+  }
+  // with a diagonal Hessian each MPI process only needs the values of its own coefficients
+  bias_expansion_pntr_->getBasisSetValuesBatch(sample_buffer_counter_,sample_args_buffer_,sample_basisset_values_,!diagonalHessian());
+  if(biasCutoffActive()) {
+    for(unsigned int s=0; s<sample_buffer_counter_; s++) {
+      double* values = &sample_basisset_values_[ncoeffs_*s];
+      for(size_t i=0; i<ncoeffs_; i++) {
+        values[i] *= sample_cutoff_factors_buffer_[s];
+      }
+      values[0]=1.0;
+    }
   }
+  addToSampledAveragesBatch(sample_buffer_counter_,sample_basisset_values_);
+  sample_buffer_counter_=0;
 }
 
 